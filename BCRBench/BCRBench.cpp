@@ -0,0 +1,255 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "JuceHeader.h"
+
+#include "BenchmarkRunner.h"
+#include "PresetGenerator.h"
+
+#include "BCR2000.h"
+#include "BCLDecoder.h"
+#include "BCLEditor.h"
+#include "BCRTransmitter.h"
+#include "DocumentIO.h"
+#include "DumpSession.h"
+#include "Settings.h"
+#include "SyxScanner.h"
+#include "Sysex.h"
+
+#include <iostream>
+
+// Benchmarks of the conversion, dump handling and editor hot paths, printing JSON lines:
+//
+//   bcr_bench [--min-time <ms>] [--filter <text>] [--out <file>]
+
+namespace {
+
+	class StdoutStream : public OutputStream {
+	public:
+		void flush() override { std::cout.flush(); }
+		bool setPosition(int64) override { return false; }
+		int64 getPosition() override { return 0; }
+		bool write(const void *data, size_t size) override {
+			std::cout.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+			return true;
+		}
+	};
+
+	int64 totalSize(std::vector<MidiMessage> const &messages) {
+		int64 result = 0;
+		for (auto const &message : messages) {
+			result += message.getRawDataSize();
+		}
+		return result;
+	}
+
+	void benchmarkConversion(BenchmarkRunner &runner, midikraft::BCR2000 &bcr, PresetGenerator::Spec const &spec, std::string const &text, std::vector<MidiMessage> const &syx) {
+		auto bytes = static_cast<int64>(text.size());
+		runner.run("convertToSyx", "verbatim", spec.name, bytes, [&]() {
+			gBenchmarkSink += bcr.convertToSyx(text, true).size();
+		});
+		runner.run("convertToSyx", "nonverbatim", spec.name, bytes, [&]() {
+			gBenchmarkSink += bcr.convertToSyx(text, false).size();
+		});
+
+		auto syxBytes = totalSize(syx);
+		runner.run("convertSyxToText", "per-message", spec.name, syxBytes, [&]() {
+			for (auto const &message : syx) {
+				gBenchmarkSink += midikraft::BCR2000::convertSyxToText(message).size();
+			}
+		});
+		runner.run("convertSyxToText", "BCLDecoder", spec.name, syxBytes, [&]() {
+			gBenchmarkSink += BCLDecoder::decodeToText(syx).size();
+		});
+	}
+
+	void benchmarkFiltering(BenchmarkRunner &runner, PresetGenerator::Spec const &spec, std::vector<MidiMessage> const &mixed, File const &mixedFile) {
+		auto bytes = totalSize(mixed);
+		runner.run("isSysexFromBCR2000", "MidiMessage", spec.name, bytes, [&]() {
+			size_t found = 0;
+			for (auto const &message : mixed) {
+				if (midikraft::BCR2000::isSysexFromBCR2000(message)) found++;
+			}
+			gBenchmarkSink += found;
+		});
+		SyxScanner scanner(mixedFile);
+		runner.run("isSysexFromBCR2000", "SyxScanner", spec.name, bytes, [&]() {
+			size_t found = 0;
+			scanner.forEachBCR2000Message([&found](SyxScanner::MessageView const &) { found++; });
+			gBenchmarkSink += found;
+		});
+	}
+
+	void benchmarkLargeArchive(BenchmarkRunner &runner, midikraft::BCR2000 &bcr, File const &directory) {
+		// Opening a big archive in the editor, before and after the SyxScanner: load time and how much memory it takes on top
+		const int64 kArchiveBytes = 50 * 1024 * 1024;
+		auto preset = bcr.convertToSyx(PresetGenerator::generate({ "store", 64, 2 }), true);
+		auto file = directory.getChildFile("archive50MB.syx");
+		{
+			FileOutputStream out(file);
+			while (out.getPosition() < kArchiveBytes) {
+				for (auto const &message : preset) {
+					out.write(message.getRawData(), static_cast<size_t>(message.getRawDataSize()));
+				}
+			}
+		}
+		auto bytes = file.getSize();
+		auto path = file.getFullPathName().toStdString();
+		// The scanner goes first, where the peak memory can't be reset it must not be hidden by the bigger one
+		runner.runWithMemory("archiveLoad", "SyxScanner", "50MB", bytes, [&]() {
+			SyxScanner scanner(file);
+			gBenchmarkSink += BCLDecoder::decodeToText(scanner).size();
+		});
+		runner.runWithMemory("archiveLoad", "Sysex::loadSysex", "50MB", bytes, [&]() {
+			gBenchmarkSink += BCLDecoder::decodeToText(Sysex::loadSysex(path)).size();
+		});
+		file.deleteFile();
+	}
+
+	void benchmarkOpenPresets(BenchmarkRunner &runner, std::string const &text) {
+		// Opening a backup opens one tab per preset: what 100 of them cost, and how long until the last one is shown and painted.
+		// Only the shown tab creates its editor component, peak_bytes is what all tabs together hold on to
+		const int kPresets = 100;
+		auto bcr = std::make_shared<midikraft::BCR2000>();
+		auto transmitter = std::make_shared<BCRTransmitter>(bcr);
+		auto openPresets = [&](bool showLast) {
+			TabbedComponent tabs(TabbedButtonBar::Orientation::TabsAtTop);
+			tabs.setSize(1200, 800);
+			OwnedArray<BCLEditor> editors;
+			for (int i = 0; i < kPresets; i++) {
+				auto editor = editors.add(new BCLEditor(bcr, transmitter, nullptr, nullptr));
+				editor->loadDocument(text);
+				tabs.addTab("Preset " + String(i + 1), Colours::black, editor, false);
+			}
+			if (showLast) {
+				tabs.setCurrentTabIndex(kPresets - 1);
+				// Painting into an image does what the window would do with the newly shown tab
+				gBenchmarkSink += static_cast<size_t>(tabs.createComponentSnapshot(tabs.getLocalBounds()).getWidth());
+			}
+			tabs.clearTabs();
+		};
+		auto bytes = static_cast<int64>(text.size()) * kPresets;
+		runner.runWithMemory("openPresets", "open", "100 tabs", bytes, [&]() { openPresets(false); });
+		runner.runWithMemory("openPresets", "interactive", "100 tabs", bytes, [&]() { openPresets(true); });
+		transmitter->stop();
+	}
+
+	void benchmarkDumpAssembly(BenchmarkRunner &runner, midikraft::BCR2000 &bcr, PresetGenerator::Spec const &spec, std::vector<MidiMessage> const &syx) {
+		// A dump arrives one message at a time, and after each one we need to know if it is complete
+		auto bytes = totalSize(syx);
+		runner.run("isDumpFinished", "growing-dump", spec.name, bytes, [&]() {
+			std::vector<MidiMessage> dump;
+			for (auto const &message : syx) {
+				dump.push_back(message);
+				if (bcr.isDumpFinished(dump)) break;
+			}
+			gBenchmarkSink += dump.size();
+		});
+		runner.run("isDumpFinished", "DumpAssembler", spec.name, bytes, [&]() {
+			DumpAssembler assembler;
+			for (auto const &message : syx) {
+				if (assembler.addMessage(message)) break;
+			}
+			gBenchmarkSink += assembler.messages().size();
+		});
+	}
+
+	void benchmarkFiles(BenchmarkRunner &runner, PresetGenerator::Spec const &spec, std::vector<MidiMessage> const &syx, File const &directory) {
+		auto file = directory.getChildFile(String(spec.name) + ".syx");
+		auto path = file.getFullPathName().toStdString();
+		auto bytes = totalSize(syx);
+		runner.run("syxSave", "Sysex::saveSysex", spec.name, bytes, [&]() {
+			file.deleteFile();
+			Sysex::saveSysex(path, syx);
+		});
+		runner.run("syxLoad", "Sysex::loadSysex", spec.name, bytes, [&]() {
+			gBenchmarkSink += Sysex::loadSysex(path).size();
+		});
+		runner.run("syxLoad", "SyxScanner", spec.name, bytes, [&]() {
+			SyxScanner scanner(file);
+			size_t found = 0;
+			scanner.forEachBCR2000Message([&found](SyxScanner::MessageView const &) { found++; });
+			gBenchmarkSink += found;
+		});
+		runner.run("syxLoadDecode", "Sysex::loadSysex", spec.name, bytes, [&]() {
+			gBenchmarkSink += BCLDecoder::decodeToText(Sysex::loadSysex(path)).size();
+		});
+		runner.run("syxLoadDecode", "SyxScanner", spec.name, bytes, [&]() {
+			SyxScanner scanner(file);
+			gBenchmarkSink += BCLDecoder::decodeToText(scanner).size();
+		});
+	}
+
+}
+
+int main(int argc, char *argv[])
+{
+	// The editor benchmarks need the message manager and the GUI classes
+	ScopedJuceInitialiser_GUI juce;
+	Settings::setSettingsID("BCRBench");
+	auto options = BenchmarkRunner::defaultOptions();
+	File outputFile;
+	for (int i = 1; i < argc; i++) {
+		String arg(argv[i]);
+		if (arg == "--min-time" && i + 1 < argc) {
+			options.minTimeMs = String(argv[++i]).getDoubleValue();
+		}
+		else if (arg == "--filter" && i + 1 < argc) {
+			options.filter = argv[++i];
+		}
+		else if (arg == "--out" && i + 1 < argc) {
+			outputFile = File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+		}
+		else {
+			std::cerr << "Usage: bcr_bench [--min-time <ms>] [--filter <text>] [--out <file>]" << std::endl;
+			return 1;
+		}
+	}
+
+	// Without an output file every result line goes to stdout right away
+	StdoutStream console;
+	std::unique_ptr<FileOutputStream> file;
+	if (outputFile != File()) {
+		outputFile.deleteFile();
+		file.reset(outputFile.createOutputStream());
+		if (!file || !file->openedOk()) {
+			std::cerr << "Could not write " << outputFile.getFullPathName() << std::endl;
+			return 1;
+		}
+	}
+	BenchmarkRunner runner(options, file ? static_cast<OutputStream &>(*file) : console);
+
+	TemporaryFile workDirectory;
+	workDirectory.getFile().createDirectory();
+	midikraft::BCR2000 bcr;
+	for (auto const &spec : PresetGenerator::standardSpecs()) {
+		auto text = PresetGenerator::generate(spec);
+		auto syx = bcr.convertToSyx(text, true);
+
+		std::vector<MidiMessage> mixed;
+		for (size_t i = 0; i < syx.size(); i++) {
+			mixed.push_back(syx[i]);
+			if (i % 4 == 0) mixed.push_back(PresetGenerator::foreignSysex(64));
+		}
+		auto mixedFile = workDirectory.getFile().getChildFile(String(spec.name) + "-mixed.syx");
+		Sysex::saveSysex(mixedFile.getFullPathName().toStdString(), mixed);
+
+		benchmarkConversion(runner, bcr, spec, text, syx);
+		benchmarkFiltering(runner, spec, mixed, mixedFile);
+		if (spec.presets == 1) {
+			benchmarkDumpAssembly(runner, bcr, spec, syx);
+		}
+		benchmarkFiles(runner, spec, syx, workDirectory.getFile());
+	}
+	benchmarkLargeArchive(runner, bcr, workDirectory.getFile());
+	benchmarkOpenPresets(runner, PresetGenerator::generate({ "full64", 64, 1 }));
+	workDirectory.getFile().deleteRecursively();
+
+	DocumentIO::shutdown();
+
+	std::cerr << runner.numberOfBenchmarksRun() << " benchmarks run" << std::endl;
+	return 0;
+}
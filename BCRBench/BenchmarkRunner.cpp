@@ -0,0 +1,121 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BenchmarkRunner.h"
+
+#include "Trace.h"
+
+#include <algorithm>
+
+std::atomic<size_t> gBenchmarkSink(0);
+
+namespace {
+	// Increase when the meaning of a field changes, so old and new results are not compared by accident
+	const int kFormatVersion = 1;
+}
+
+BenchmarkRunner::BenchmarkRunner(Options const &options, OutputStream &out) : options_(options), out_(out), benchmarksRun_(0)
+{
+}
+
+BenchmarkRunner::Options BenchmarkRunner::defaultOptions()
+{
+	Options options;
+	options.minTimeMs = 250.0;
+	options.minIterations = 3;
+	options.maxIterations = 100000;
+	return options;
+}
+
+bool BenchmarkRunner::isSelected(String const &benchmark, String const &variant, String const &input) const
+{
+	String id = benchmark + "/" + variant + "/" + input;
+	return options_.filter.isEmpty() || id.contains(options_.filter);
+}
+
+void BenchmarkRunner::run(String const &benchmark, String const &variant, String const &input, int64 bytes, std::function<void()> body)
+{
+	if (!isSelected(benchmark, variant, input)) {
+		return;
+	}
+
+	// One run to warm up caches and lazily initialized tables
+	body();
+
+	std::vector<double> micros;
+	double started = Time::getMillisecondCounterHiRes();
+	while (static_cast<int>(micros.size()) < options_.maxIterations
+		&& (static_cast<int>(micros.size()) < options_.minIterations || Time::getMillisecondCounterHiRes() - started < options_.minTimeMs)) {
+		auto start = Time::getHighResolutionTicks();
+		body();
+		auto end = Time::getHighResolutionTicks();
+		micros.push_back(Time::highResolutionTicksToSeconds(end - start) * 1.0e6);
+	}
+	report(benchmark, variant, input, bytes, micros, -1);
+}
+
+void BenchmarkRunner::runWithMemory(String const &benchmark, String const &variant, String const &input, int64 bytes, std::function<void()> body)
+{
+	if (!isSelected(benchmark, variant, input)) {
+		return;
+	}
+
+	std::vector<double> micros;
+	int64 peakBytes = -1;
+	for (int i = 0; i < options_.minIterations; i++) {
+		Trace::resetPeakResidentBytes();
+		auto before = Trace::residentBytes();
+		auto peakBefore = Trace::peakResidentBytes();
+		auto start = Time::getHighResolutionTicks();
+		body();
+		auto end = Time::getHighResolutionTicks();
+		micros.push_back(Time::highResolutionTicksToSeconds(end - start) * 1.0e6);
+		auto peak = Trace::peakResidentBytes();
+		// Where the peak can't be reset, it only belongs to the body if the body raised it
+		if (i == 0 && before >= 0 && peak >= 0 && (peakBefore <= before || peak > peakBefore)) {
+			peakBytes = jmax(int64(0), peak - before);
+		}
+	}
+	report(benchmark, variant, input, bytes, micros, peakBytes);
+}
+
+void BenchmarkRunner::report(String const &benchmark, String const &variant, String const &input, int64 bytes, std::vector<double> &micros, int64 peakBytes)
+{
+	std::sort(micros.begin(), micros.end());
+	double total = 0.0;
+	for (auto value : micros) total += value;
+	double mean = total / micros.size();
+	auto percentile = [&micros](double p) { return micros[std::min(micros.size() - 1, static_cast<size_t>(p * micros.size()))]; };
+
+	DynamicObject::Ptr result = new DynamicObject();
+	result->setProperty("format", kFormatVersion);
+	result->setProperty("benchmark", benchmark);
+	result->setProperty("variant", variant);
+	result->setProperty("input", input);
+	result->setProperty("bytes", bytes);
+	result->setProperty("iterations", static_cast<int>(micros.size()));
+	result->setProperty("min_us", micros.front());
+	result->setProperty("mean_us", mean);
+	result->setProperty("p50_us", percentile(0.5));
+	result->setProperty("p90_us", percentile(0.9));
+	result->setProperty("max_us", micros.back());
+	result->setProperty("mb_per_s", mean > 0.0 ? bytes / mean : 0.0); // Bytes per microsecond are MB per second
+	if (peakBytes >= 0) {
+		result->setProperty("peak_bytes", peakBytes);
+	}
+	result->setProperty("host", SystemStats::getComputerName());
+	result->setProperty("cpus", SystemStats::getNumCpus());
+	result->setProperty("os", SystemStats::getOperatingSystemName());
+	result->setProperty("timestamp", Time::getCurrentTime().toISO8601(true));
+	out_ << JSON::toString(var(result.get()), true) << "\n";
+	out_.flush();
+	benchmarksRun_++;
+}
+
+int BenchmarkRunner::numberOfBenchmarksRun() const
+{
+	return benchmarksRun_;
+}
@@ -0,0 +1,47 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+// Runs a benchmark body until a minimum time has passed and prints one JSON object per line, so the results of
+// different builds and hosts can be collected and compared by scripts
+class BenchmarkRunner {
+public:
+	struct Options {
+		double minTimeMs;
+		int minIterations;
+		int maxIterations;
+		String filter; // Only run benchmarks whose "benchmark/variant/input" contains this
+	};
+
+	BenchmarkRunner(Options const &options, OutputStream &out);
+
+	// bytes is the size of the input processed per iteration, for the throughput figure
+	void run(String const &benchmark, String const &variant, String const &input, int64 bytes, std::function<void()> body);
+	// For bodies too slow to repeat often, like loading a big file: runs the body minIterations times without warm up and also
+	// reports how far the resident memory of the process rose above what it was before, at its peak during the first run.
+	// On Windows the peak can't be reset, so it is only reported if the body set a new one
+	void runWithMemory(String const &benchmark, String const &variant, String const &input, int64 bytes, std::function<void()> body);
+
+	int numberOfBenchmarksRun() const;
+
+	static Options defaultOptions();
+
+private:
+	bool isSelected(String const &benchmark, String const &variant, String const &input) const;
+	void report(String const &benchmark, String const &variant, String const &input, int64 bytes, std::vector<double> &micros, int64 peakBytes);
+
+	Options options_;
+	OutputStream &out_;
+	int benchmarksRun_;
+};
+
+// Results are stored here so the compiler can't optimize the benchmarked calls away
+extern std::atomic<size_t> gBenchmarkSink;
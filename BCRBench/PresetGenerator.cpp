@@ -0,0 +1,78 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PresetGenerator.h"
+
+namespace {
+	const int kNumEncoders = 56;
+	const int kNumPresetsOnDevice = 32;
+}
+
+std::vector<PresetGenerator::Spec> PresetGenerator::standardSpecs()
+{
+	return {
+		{ "tiny", 1, 1 },
+		{ "small", 8, 1 },
+		{ "medium", 32, 1 },
+		{ "full64", 64, 1 },
+		{ "archive32x64", 64, 32 },
+		{ "archive256x64", 64, 256 }
+	};
+}
+
+std::string PresetGenerator::generate(Spec const &spec)
+{
+	std::string result;
+	for (int preset = 0; preset < spec.presets; preset++) {
+		appendPreset(result, preset, spec.elements, spec.presets > 1);
+	}
+	return result;
+}
+
+void PresetGenerator::appendPreset(std::string &out, int presetNo, int elements, bool store)
+{
+	out += "$rev R1\n";
+	out += "$preset\n";
+	out += "  .name 'Synthetic " + std::to_string(presetNo + 1) + "'\n";
+	out += "  .snapshot off\n  .request off\n  .egroups 4\n  .fkeys on\n  .lock off\n  .init\n";
+	for (int i = 0; i < elements; i++) {
+		int channel = 1 + (i % 16);
+		if (i < kNumEncoders) {
+			out += "$encoder " + std::to_string(i + 1) + "\n";
+			out += "  .showvalue on\n  .mode 1dot\n  .resolution 96 96 96 96\n  .default 0\n";
+			// Mix the message types the way real maps do
+			switch (i % 4) {
+			case 0:
+			case 1:
+				out += "  .easypar CC " + std::to_string(channel) + " " + std::to_string(i % 128) + " 0 127 absolute\n";
+				break;
+			case 2:
+				out += "  .easypar NRPN " + std::to_string(channel) + " " + std::to_string(i * 3) + " 0 16383 absolute/14\n";
+				break;
+			default:
+				out += "  .minmax 0 127\n  .tx $F0 $00 $20 $32 $00 $15 val $F7\n";
+				break;
+			}
+		}
+		else {
+			out += "$button " + std::to_string(i - kNumEncoders + 1) + "\n";
+			out += "  .showvalue on\n  .easypar CC " + std::to_string(channel) + " " + std::to_string(64 + i % 64) + " 127 0 toggleoff\n  .mode down\n";
+		}
+	}
+	if (store) {
+		out += "$store " + std::to_string(presetNo % kNumPresetsOnDevice + 1) + "\n";
+	}
+	out += "$end\n";
+}
+
+MidiMessage PresetGenerator::foreignSysex(int size)
+{
+	// A Yamaha style bulk message
+	std::vector<uint8> data(static_cast<size_t>(jmax(4, size)), 0x11);
+	data[0] = 0x43;
+	data[1] = 0x00;
+	return MidiMessage::createSysExMessage(data.data(), static_cast<int>(data.size()));
+}
@@ -0,0 +1,32 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <string>
+
+// Creates synthetic but valid BCL presets of a given size, deterministically so runs on different machines are comparable
+class PresetGenerator {
+public:
+	struct Spec {
+		std::string name;
+		int elements; // Encoders first, up to the 56 the BCR2000 has, then buttons
+		int presets;  // More than one gives an archive with a $store per preset
+	};
+
+	// From a single encoder to multi-preset archives of full 64 element maps
+	static std::vector<Spec> standardSpecs();
+
+	static std::string generate(Spec const &spec);
+
+	// Sysex of another manufacturer, to mix into dumps for the filter benchmarks
+	static MidiMessage foreignSysex(int size);
+
+private:
+	static void appendPreset(std::string &out, int presetNo, int elements, bool store);
+};
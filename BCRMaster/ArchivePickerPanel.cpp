@@ -0,0 +1,137 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "ArchivePickerPanel.h"
+
+#include "Logger.h"
+
+namespace {
+	// More rows don't help anybody, narrow down the filter instead
+	const size_t kMaxRows = 5000;
+}
+
+template <>
+void visit(ArchivePickerPanel::Row const &row, int column, std::function<void(std::string const &)> visitor) {
+	switch (column) {
+	case 1: visitor(row.entry.name.toStdString()); break;
+	case 2: visitor(row.entry.slot >= 0 ? String(row.entry.slot + 1).toStdString() : std::string()); break;
+	case 3: visitor((String(row.entry.size) + " bytes").toStdString()); break;
+	}
+}
+
+ArchivePickerPanel::ArchivePickerPanel(File const &archiveFile, std::shared_ptr<midikraft::BCR2000> bcr, TOpenHandler openHandler) : bcr_(bcr), openHandler_(openHandler),
+	table_({ "Preset", "Slot", "Size" }, {}, [this](int rowSelected) { openRow(rowSelected); })
+{
+	filter_.setTextToShowWhenEmpty("Filter by name", Colours::grey);
+	filter_.addListener(this);
+	addAndMakeVisible(filter_);
+
+	addButton_.setButtonText("Add files...");
+	addButton_.onClick = [this]() { addFiles(); };
+	addAndMakeVisible(addButton_);
+
+	exportButton_.setButtonText("Export all...");
+	exportButton_.onClick = [this]() { exportAll(); };
+	addAndMakeVisible(exportButton_);
+
+	addAndMakeVisible(statusLabel_);
+	addAndMakeVisible(table_);
+
+	String error;
+	double startTime = Time::getMillisecondCounterHiRes();
+	if (archive_.open(archiveFile, error)) {
+		openStatus_ = "opened in " + String(Time::getMillisecondCounterHiRes() - startTime, 1) + " ms";
+	}
+	else {
+		openStatus_ = error;
+		addButton_.setEnabled(false);
+		exportButton_.setEnabled(false);
+	}
+	filter();
+	setSize(700, 600);
+}
+
+void ArchivePickerPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto top = area.removeFromTop(28);
+	exportButton_.setBounds(top.removeFromRight(120));
+	addButton_.setBounds(top.removeFromRight(120).withTrimmedRight(8));
+	filter_.setBounds(top.withTrimmedRight(8));
+	statusLabel_.setBounds(area.removeFromBottom(24));
+	table_.setBounds(area.withTrimmedTop(8));
+}
+
+void ArchivePickerPanel::textEditorTextChanged(TextEditor &)
+{
+	filter();
+}
+
+void ArchivePickerPanel::filter()
+{
+	auto text = filter_.getText().trim();
+	rows_.clear();
+	for (int i = 0; i < archive_.size() && rows_.size() < kMaxRows; i++) {
+		auto const &entry = archive_.entry(i);
+		if (text.isEmpty() || entry.name.containsIgnoreCase(text)) {
+			rows_.push_back({ i, entry });
+		}
+	}
+	table_.updateData(rows_);
+	statusLabel_.setText(String(rows_.size()) + " of " + String(archive_.size()) + " presets in " + archive_.file().getFileName() + ", " + openStatus_, dontSendNotification);
+}
+
+void ArchivePickerPanel::openRow(int row)
+{
+	if (row < 0 || row >= static_cast<int>(rows_.size())) {
+		return;
+	}
+	double startTime = Time::getMillisecondCounterHiRes();
+	std::vector<MidiMessage> messages;
+	String error;
+	if (!archive_.read(rows_[row].index, messages, error)) {
+		SimpleLogger::instance()->postMessage(error);
+		return;
+	}
+	SimpleLogger::instance()->postMessage("Read " + rows_[row].entry.name + " from the library in " + String(Time::getMillisecondCounterHiRes() - startTime, 1) + " ms");
+	openHandler_(rows_[row].entry.name, messages);
+}
+
+void ArchivePickerPanel::addFiles()
+{
+	FileChooser chooser("Add presets to the library", File::getSpecialLocation(File::userDocumentsDirectory), "*.syx;*.bcl;*.bcr");
+	if (!chooser.browseForMultipleFilesToOpen()) {
+		return;
+	}
+	std::vector<PresetArchive::Preset> presets;
+	for (auto const &file : chooser.getResults()) {
+		auto imported = PresetArchive::importFile(file, *bcr_);
+		presets.insert(presets.end(), imported.begin(), imported.end());
+	}
+	String error;
+	int added = archive_.append(presets, error);
+	if (added < 0) {
+		SimpleLogger::instance()->postMessage(error);
+		return;
+	}
+	SimpleLogger::instance()->postMessage("Added " + String(added) + " of " + String(presets.size()) + " presets to " + archive_.file().getFileName()
+		+ ", the others were already in it");
+	filter();
+}
+
+void ArchivePickerPanel::exportAll()
+{
+	FileChooser chooser("Export all presets as .syx files into", File::getSpecialLocation(File::userDocumentsDirectory));
+	if (!chooser.browseForDirectory()) {
+		return;
+	}
+	StringArray errors;
+	int exported = archive_.exportAll(chooser.getResult(), errors);
+	for (auto const &error : errors) {
+		SimpleLogger::instance()->postMessage(error);
+	}
+	SimpleLogger::instance()->postMessage("Exported " + String(exported) + " presets to " + chooser.getResult().getFullPathName());
+}
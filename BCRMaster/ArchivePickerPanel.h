@@ -0,0 +1,49 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "PresetArchive.h"
+#include "SimpleTable.h"
+
+// Lists the presets of a .bcrlib file, filtered by name with every keystroke. Selecting a preset reads just that one and opens it.
+// Files can be added to the library, and all presets exported as .syx files.
+class ArchivePickerPanel : public Component,
+	private TextEditor::Listener
+{
+public:
+	struct Row {
+		int index;
+		PresetArchive::Entry entry;
+	};
+
+	typedef std::function<void(String const &name, std::vector<MidiMessage> const &messages)> TOpenHandler;
+
+	ArchivePickerPanel(File const &archiveFile, std::shared_ptr<midikraft::BCR2000> bcr, TOpenHandler openHandler);
+
+	void resized() override;
+
+private:
+	void textEditorTextChanged(TextEditor &editor) override;
+	void filter();
+	void openRow(int row);
+	void addFiles();
+	void exportAll();
+
+	PresetArchive archive_;
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	TOpenHandler openHandler_;
+	std::vector<Row> rows_;
+	String openStatus_;
+	TextEditor filter_;
+	TextButton addButton_;
+	TextButton exportButton_;
+	Label statusLabel_;
+	SimpleTable<std::vector<Row>> table_;
+};
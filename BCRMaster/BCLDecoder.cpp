@@ -0,0 +1,107 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCLDecoder.h"
+
+#include "BCR2000.h"
+
+#include "Trace.h"
+
+namespace {
+	// Layout of the BCL text message without the F0/F7 framing: 00 20 32 <device> <model> 20 <index msb> <index lsb> <text>
+	const int kCommandOffset = 5;
+	const int kHeaderSize = 8;
+	const uint8 kBCLTextCommand = 0x20;
+}
+
+const char *BCLDecoder::bclText(MidiMessage const &message, size_t &length)
+{
+	if (!midikraft::BCR2000::isSysexFromBCR2000(message)) {
+		return nullptr;
+	}
+	int size = message.getSysExDataSize();
+	auto data = message.getSysExData();
+	if (size < kHeaderSize || data[kCommandOffset] != kBCLTextCommand) {
+		return nullptr;
+	}
+	length = static_cast<size_t>(size - kHeaderSize);
+	return reinterpret_cast<const char *>(data + kHeaderSize);
+}
+
+void BCLDecoder::decode(std::vector<MidiMessage> const &messages, TLineSink const &sink)
+{
+	Trace::Span span("decodeBCL");
+	for (auto const &message : messages) {
+		size_t length;
+		auto text = bclText(message, length);
+		if (text) {
+			sink(text, length);
+		}
+		else if (midikraft::BCR2000::isSysexFromBCR2000(message)) {
+			// Not a plain text message, let the device implementation decide how to render it
+			Trace::Span convertSpan("BCLDecoder.convertMessage");
+			auto line = midikraft::BCR2000::convertSyxToText(message);
+			sink(line.data(), line.size());
+		}
+	}
+}
+
+void BCLDecoder::decodeInto(std::vector<MidiMessage> const &messages, std::string &output)
+{
+	output.reserve(output.size() + estimatedTextSize(messages));
+	decode(messages, [&output](const char *text, size_t length) {
+		output.append(text, length);
+		output.push_back('\n');
+	});
+}
+
+std::string BCLDecoder::decodeToText(std::vector<MidiMessage> const &messages)
+{
+	std::string result;
+	decodeInto(messages, result);
+	return result;
+}
+
+void BCLDecoder::decode(SyxScanner const &scanner, TLineSink const &sink)
+{
+	Trace::Span span("decodeBCL");
+	scanner.forEachBCR2000Message([&sink](SyxScanner::MessageView const &message) {
+		size_t length;
+		auto text = message.bclText(length);
+		if (text) {
+			sink(text, length);
+		}
+		else {
+			Trace::Span convertSpan("BCLDecoder.convertMessage");
+			auto line = midikraft::BCR2000::convertSyxToText(message.toMidiMessage());
+			sink(line.data(), line.size());
+		}
+	});
+}
+
+std::string BCLDecoder::decodeToText(SyxScanner const &scanner)
+{
+	std::string result;
+	// The text is never larger than the file it is decoded from
+	result.reserve(scanner.fileSize());
+	decode(scanner, [&result](const char *text, size_t length) {
+		result.append(text, length);
+		result.push_back('\n');
+	});
+	return result;
+}
+
+size_t BCLDecoder::estimatedTextSize(std::vector<MidiMessage> const &messages)
+{
+	size_t result = 0;
+	for (auto const &message : messages) {
+		if (message.isSysEx()) {
+			// Payload plus the line break
+			result += static_cast<size_t>(message.getSysExDataSize()) + 1;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,35 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "SyxScanner.h"
+
+// Turns BCR2000 sysex messages into BCL text lines without building intermediate streams.
+// Each BCL message of the dump becomes exactly one line, messages not from a BCR2000 are skipped.
+class BCLDecoder {
+public:
+	// Called once per decoded line, the text is not terminated and doesn't include the line break
+	typedef std::function<void(const char *text, size_t length)> TLineSink;
+
+	static void decode(std::vector<MidiMessage> const &messages, TLineSink const &sink);
+
+	// Appends all lines separated by '\n' to output, reserving the required capacity up front
+	static void decodeInto(std::vector<MidiMessage> const &messages, std::string &output);
+	static std::string decodeToText(std::vector<MidiMessage> const &messages);
+
+	// Same for a memory mapped file, decoding directly from the mapping without creating MidiMessages
+	static void decode(SyxScanner const &scanner, TLineSink const &sink);
+	static std::string decodeToText(SyxScanner const &scanner);
+
+	// Upper bound of the text size produced by decodeInto, computed from the sysex payload sizes
+	static size_t estimatedTextSize(std::vector<MidiMessage> const &messages);
+
+	// If the message is a BCL text message, returns the pointer to the text payload and stores its length
+	static const char *bclText(MidiMessage const &message, size_t &length);
+};
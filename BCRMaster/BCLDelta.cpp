@@ -0,0 +1,172 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCLDelta.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+
+namespace {
+	// Commands that open a block of property lines which can be redefined on its own
+	const char *kBlockCommands[] = { "$preset", "$encoder", "$button", "$global" };
+
+	std::string commandOf(std::string const &normalizedLine) {
+		auto space = normalizedLine.find(' ');
+		return space == std::string::npos ? normalizedLine : normalizedLine.substr(0, space);
+	}
+
+	bool isBlockCommand(std::string const &command) {
+		for (auto block : kBlockCommands) {
+			if (command == block) return true;
+		}
+		return false;
+	}
+}
+
+std::string BCLDelta::normalize(std::string const &line)
+{
+	std::string result;
+	bool inString = false;
+	bool pendingSpace = false;
+	for (char c : line) {
+		if (c == '\'') {
+			inString = !inString;
+		}
+		else if (c == ';' && !inString) {
+			break;
+		}
+		if (!inString && std::isspace(static_cast<unsigned char>(c))) {
+			pendingSpace = !result.empty();
+			continue;
+		}
+		if (pendingSpace) {
+			result.push_back(' ');
+			pendingSpace = false;
+		}
+		result.push_back(inString ? c : static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+	}
+	return result;
+}
+
+std::string BCLDelta::propertyName(std::string const &normalizedLine)
+{
+	return commandOf(normalizedLine);
+}
+
+BCLDelta::Structure BCLDelta::parse(std::vector<std::string> const &lines)
+{
+	Structure result;
+	result.valid = false;
+	result.revLine = -1;
+	result.endLine = -1;
+
+	for (int i = 0; i < static_cast<int>(lines.size()); i++) {
+		auto line = normalize(lines[i]);
+		if (line.empty()) {
+			continue;
+		}
+		if (result.endLine != -1) {
+			// Content after $end
+			return result;
+		}
+		if (line[0] == '$') {
+			auto command = commandOf(line);
+			if (command == "$rev") {
+				if (result.revLine != -1) return result;
+				result.revLine = i;
+			}
+			else if (command == "$end") {
+				result.endLine = i;
+			}
+			else if (isBlockCommand(command) && result.revLine != -1) {
+				Block block;
+				block.key = line;
+				block.firstLine = i;
+				block.lastLine = i;
+				result.blocks.push_back(block);
+			}
+			else {
+				// $store, $recall and anything else we don't know acts on the whole preset
+				return result;
+			}
+		}
+		else if (line[0] == '.' && !result.blocks.empty()) {
+			result.blocks.back().properties.push_back(line);
+		}
+		else {
+			return result;
+		}
+		if (!result.blocks.empty() && result.endLine == -1) {
+			result.blocks.back().lastLine = i;
+		}
+	}
+	result.valid = result.revLine != -1 && result.endLine != -1;
+	return result;
+}
+
+bool BCLDelta::linesToUpload(std::vector<std::string> const &previous, std::vector<std::string> const &current, std::vector<int> &outLines)
+{
+	outLines.clear();
+	auto before = parse(previous);
+	auto after = parse(current);
+	if (!before.valid || !after.valid) {
+		return false;
+	}
+	if (normalize(previous[before.revLine]) != normalize(current[after.revLine])) {
+		return false;
+	}
+
+	std::map<std::string, Block const *> oldBlocks;
+	for (auto const &block : before.blocks) {
+		if (!oldBlocks.emplace(block.key, &block).second) return false;
+	}
+
+	std::vector<Block const *> changed;
+	std::set<std::string> seen;
+	for (auto const &block : after.blocks) {
+		if (!seen.insert(block.key).second) {
+			return false;
+		}
+		auto found = oldBlocks.find(block.key);
+		if (found == oldBlocks.end()) {
+			changed.push_back(&block);
+			continue;
+		}
+		if (found->second->properties == block.properties) {
+			continue;
+		}
+		if (commandOf(block.key) == "$preset") {
+			// Preset settings like .init affect the whole preset
+			return false;
+		}
+		// Properties that are not mentioned keep their value on the device, so a property can't be removed by resending the block
+		std::set<std::string> names;
+		for (auto const &property : block.properties) {
+			names.insert(propertyName(property));
+		}
+		for (auto const &property : found->second->properties) {
+			if (names.find(propertyName(property)) == names.end()) return false;
+		}
+		changed.push_back(&block);
+	}
+	for (auto const &old : oldBlocks) {
+		if (seen.find(old.first) == seen.end()) {
+			// Element was removed, there is no way to undefine it
+			return false;
+		}
+	}
+
+	outLines.push_back(after.revLine);
+	for (auto block : changed) {
+		for (int i = block->firstLine; i <= block->lastLine; i++) {
+			outLines.push_back(i);
+		}
+	}
+	outLines.push_back(after.endLine);
+	return true;
+}
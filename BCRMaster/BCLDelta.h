@@ -0,0 +1,40 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Compares two versions of a BCL document at the granularity of its elements ($preset, $encoder n, $button n, ...)
+// to find the smallest $rev ... $end sequence that brings a device holding the old version to the new one.
+class BCLDelta {
+public:
+	struct Block {
+		std::string key; // Normalized command line, e.g. "$encoder 12"
+		int firstLine;
+		int lastLine;
+		std::vector<std::string> properties; // Normalized property lines, in document order
+	};
+
+	struct Structure {
+		bool valid;
+		int revLine;
+		int endLine;
+		std::vector<Block> blocks;
+	};
+
+	static Structure parse(std::vector<std::string> const &lines);
+
+	// Fills the zero-based lines of current that need to be sent, or returns false if only a full upload is safe
+	static bool linesToUpload(std::vector<std::string> const &previous, std::vector<std::string> const &current, std::vector<int> &outLines);
+
+	// Strips comments and surplus whitespace, returns an empty string for lines without content
+	static std::string normalize(std::string const &line);
+
+private:
+	static std::string propertyName(std::string const &normalizedLine);
+};
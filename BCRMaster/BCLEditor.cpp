@@ -1,5 +1,8 @@
 #include "BCLEditor.h"
 
+#include "BCLDecoder.h"
+#include "BCLDelta.h"
+#include "Trace.h"
 #include "StreamLogger.h"
 #include "MidiController.h"
 
@@ -11,10 +14,12 @@
 #include "Settings.h"
 
 #include <memory>
-#include <sstream>
 
 const char *kLastPath = "LastDocumentPath";
 
+// How long a hidden tab keeps its editor component, so quickly switching back and forth stays cheap
+static const int kReleaseDelayMs = 30000;
+
 template <>
 void visit(midikraft::BCR2000::BCRError const &errorStruct, int column, std::function<void(std::string const &)> visitor) {
 	switch (column) {
@@ -25,44 +30,161 @@ void visit(midikraft::BCR2000::BCRError const &errorStruct, int column, std::fun
 	}
 }
 
-BCLEditor::BCLEditor(std::shared_ptr<midikraft::BCR2000> bcr, std::function<void()> detectedHandler) : bcr_(bcr), detectedHandler_(detectedHandler),
-	grabbedFocus_(false),
-	currentError_({ "Line", "Error code", "Error description", "Text" }, { }, [this](int rowSelected) {
+BCLEditor::BCLEditor(std::shared_ptr<midikraft::BCR2000> bcr, std::shared_ptr<BCRTransmitter> transmitter, std::function<void()> detectedHandler,
+	std::function<void()> uploadedHandler) : bcr_(bcr), detectedHandler_(detectedHandler), uploadedHandler_(uploadedHandler),
+	transmitter_(transmitter), uploadProgress_(0.0), uploadProgressBar_(uploadProgress_),
+	compilationCache_(bcr), lineCount_(0), lastSentGeneration_(-1), ioIsSave_(false), editCount_(0), ioGeneration_(0), caretPosition_(document_, 0, 0), firstLineOnScreen_(0),
+	hiddenGeneration_(0), grabbedFocus_(false)
+{
+	// Keep the caret where it was when the editor component is released, even if the text is changed meanwhile
+	caretPosition_.setPositionMaintained(true);
+	addAndMakeVisible(uploadProgressBar_);
+	addAndMakeVisible(uploadStatus_);
+	cancelButton_.setButtonText("Cancel");
+	cancelButton_.onClick = [this]() {
+		if (ioTask_) {
+			ioTask_->cancel();
+		}
+	};
+	addChildComponent(cancelButton_);
+	validator_ = std::make_unique<BCLValidator>([this](std::vector<midikraft::BCR2000::BCRError> const &errors) {
+		showValidatorErrors(errors);
+	});
+	lineCount_ = document_.getNumLines();
+	document_.addListener(this);
+
+	// The editor component and the error table are only created once the tab is shown
+}
+
+BCLEditor::~BCLEditor()
+{
+	if (ioTask_) {
+		ioTask_->cancel();
+	}
+	dematerialize();
+	document_.removeListener(this);
+}
+
+void BCLEditor::resized()
+{
+	Rectangle<int> area(getLocalBounds());
+	auto errorArea = area.removeFromBottom(160).withTrimmedTop(8);
+	auto statusRow = area.removeFromBottom(28).withTrimmedTop(8);
+	uploadProgressBar_.setBounds(statusRow.removeFromLeft(200));
+	cancelButton_.setBounds(statusRow.removeFromLeft(88).withTrimmedLeft(8));
+	uploadStatus_.setBounds(statusRow.withTrimmedLeft(8));
+	if (editor_) {
+		currentError_->setBounds(errorArea);
+		editor_->setBounds(area);
+	}
+}
+
+void BCLEditor::visibilityChanged()
+{
+	// Any pending release is for an earlier time the tab was hidden
+	int generation = ++hiddenGeneration_;
+	if (isVisible()) {
+		materialize();
+	}
+	else if (editor_) {
+		Component::SafePointer<BCLEditor> safeThis(this);
+		Timer::callAfterDelay(kReleaseDelayMs, [safeThis, generation]() {
+			if (safeThis && safeThis->hiddenGeneration_ == generation && !safeThis->isVisible()) {
+				safeThis->dematerialize();
+			}
+		});
+	}
+}
+
+bool BCLEditor::isMaterialized() const
+{
+	return editor_ != nullptr;
+}
+
+void BCLEditor::materialize()
+{
+	if (editor_) {
+		return;
+	}
+	Trace::Span span("BCLEditor.materialize");
+	editor_ = std::make_unique<CodeEditorComponent>(document_, &tokeniser_);
+	editor_->setWantsKeyboardFocus(true);
+	editor_->moveCaretTo(caretPosition_, false);
+	editor_->scrollToLine(firstLineOnScreen_);
+	addAndMakeVisible(editor_.get());
+
+	currentError_ = std::make_unique<SimpleTable<std::vector<midikraft::BCR2000::BCRError>>>(std::vector<std::string>({ "Line", "Error code", "Error description", "Text" }),
+		lastErrors_, [this](int rowSelected) {
 		jumpToLine(rowSelected - 1);
 		int errorRow = -1;
 		if (rowSelected < lastErrors_.size()) {
 			errorRow = lastErrors_[rowSelected].lineNumber;
 		}
 		editor_->selectRegion(CodeDocument::Position(document_, errorRow - 1, 0), CodeDocument::Position(document_, errorRow, 0));
-	})
-{
-	editor_ = std::make_unique<CodeEditorComponent>(document_, nullptr);
-	addAndMakeVisible(editor_.get());
-	addAndMakeVisible(currentError_);
-	document_.addListener(this);
+	});
+	addAndMakeVisible(*currentError_);
+	resized();
 
-	editor_->setWantsKeyboardFocus(true);
+	grabbedFocus_ = false;
 	startTimer(100);
 }
 
-BCLEditor::~BCLEditor()
+void BCLEditor::dematerialize()
 {
-	document_.removeListener(this);
+	if (!editor_) {
+		return;
+	}
+	// The document with its undo history stays, only the view is released
+	caretPosition_.setPosition(editor_->getCaretPos().getPosition());
+	firstLineOnScreen_ = editor_->getFirstLineOnScreen();
+	stopTimer();
+	currentError_.reset();
+	editor_.reset();
 }
 
-void BCLEditor::resized()
+void BCLEditor::showValidatorErrors(std::vector<midikraft::BCR2000::BCRError> const &errors)
 {
-	Rectangle<int> area(getLocalBounds());
-	currentError_.setBounds(area.removeFromBottom(160).withTrimmedTop(8));
-	editor_->setBounds(area);
+	validatorErrors_ = errors;
+	updateErrorTable();
+}
+
+void BCLEditor::showDeviceErrors(std::vector<midikraft::BCR2000::BCRError> const &errors)
+{
+	deviceErrors_ = errors;
+	updateErrorTable();
+}
+
+void BCLEditor::updateErrorTable()
+{
+	// What the device rejected comes first, it is what actually went wrong
+	lastErrors_ = deviceErrors_;
+	lastErrors_.insert(lastErrors_.end(), validatorErrors_.begin(), validatorErrors_.end());
+	if (currentError_) {
+		currentError_->updateData(lastErrors_);
+	}
+}
+
+void BCLEditor::setContent(String const &text)
+{
+	if (editor_) {
+		editor_->loadContent(text);
+	}
+	else {
+		// The same as CodeEditorComponent::loadContent does
+		document_.replaceAllContent(text);
+		document_.clearUndoHistory();
+		document_.setSavePoint();
+		caretPosition_.setPosition(0);
+		firstLineOnScreen_ = 0;
+	}
 }
 
 void BCLEditor::loadDocument(std::string const &document)
 {
-	editor_->loadContent(document);
+	setContent(document);
 }
 
-bool BCLEditor::loadDocument()
+bool BCLEditor::loadDocument(File &outChosenFile)
 {
 	std::string lastPath = Settings::instance().get(kLastPath, File::getSpecialLocation(File::userDocumentsDirectory).getFullPathName().toStdString());
 	FileChooser chooser("Please select the BCR2000 preset file to load...",
@@ -73,62 +195,147 @@ bool BCLEditor::loadDocument()
 	{
 		File bclFile(chooser.getResult());
 		Settings::instance().set(kLastPath, bclFile.getParentDirectory().getFullPathName().toStdString());
-		if (!bclFile.existsAsFile()) {
-			return false;
-		}
-		currentFilePath_ = bclFile.getFullPathName();
-		if (bclFile.getFileExtension() == ".syx") {
-			auto messages = Sysex::loadSysex(bclFile.getFullPathName().toStdString());
-			loadDocumentFromSyx(messages);
-		}
-		else {
-			editor_->loadContent(bclFile.loadFileAsString());
-		}
-		return true;
+		outChosenFile = bclFile;
+		return loadFile(bclFile);
 	}
 	return false;
 }
 
-void BCLEditor::loadDocumentFromSyx(std::vector<MidiMessage> const &messages)
+bool BCLEditor::loadFile(File const &bclFile)
 {
-	std::stringstream result;
-	for (const auto& message : messages) {
-		if (midikraft::BCR2000::isSysexFromBCR2000(message)) {
-			result << midikraft::BCR2000::convertSyxToText(message) << std::endl;
-		}
+	if (!bclFile.existsAsFile() || refuseWhileSaving()) {
+		return false;
 	}
-	editor_->loadContent(result.str());
+	Component::SafePointer<BCLEditor> safeThis(this);
+	int generation = ++ioGeneration_;
+	startIO("Loading " + bclFile.getFileName() + "...", DocumentIO::instance().load(bclFile, [safeThis, generation](double progress) {
+		if (safeThis && safeThis->ioGeneration_ == generation) safeThis->uploadProgress_ = progress;
+	}, [safeThis, generation](DocumentIO::Result const &result) {
+		if (!safeThis) return;
+		if (result.success) {
+			// Only now the editor shows the file, a failed load must not make the next save overwrite it
+			safeThis->setContent(result.text);
+			safeThis->currentFilePath_ = result.file.getFullPathName();
+		}
+		safeThis->ioFinished(result, "Loaded", generation);
+	}), false);
+	return true;
+}
+
+void BCLEditor::loadDocumentFromSyx(std::vector<MidiMessage> const &messages)
+{
+	auto text = BCLDecoder::decodeToText(messages);
+	setContent(String(text.data(), text.size()));
 }
 
 void BCLEditor::jumpToLine(int rowNumber)
 {
-	editor_->scrollToLine(rowNumber);
+	if (editor_) {
+		editor_->scrollToLine(rowNumber);
+	}
+	else {
+		firstLineOnScreen_ = jmax(0, rowNumber);
+	}
+}
+
+void BCLEditor::selectRange(int startIndex, int endIndex)
+{
+	CodeDocument::Position start(document_, startIndex);
+	jumpToLine(jmax(0, start.getLineNumber() - 3));
+	if (editor_) {
+		editor_->selectRegion(start, CodeDocument::Position(document_, endIndex));
+	}
+	else {
+		caretPosition_.setPosition(startIndex);
+	}
+}
+
+int BCLEditor::editCount() const
+{
+	return editCount_;
+}
+
+bool BCLEditor::applyEdits(std::vector<DocumentSearch::Edit> const &edits, int expectedEditCount)
+{
+	if (editCount_ != expectedEditCount) {
+		return false;
+	}
+	// Back to front, so the positions of the edits not yet applied stay valid
+	document_.newTransaction();
+	for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+		document_.replaceSection(edit->start, edit->end, edit->replacement);
+	}
+	document_.newTransaction();
+	return true;
 }
 
 void BCLEditor::saveDocument()
 {
 	if (currentFilePath_.isNotEmpty()) {
-		File bclFile(currentFilePath_);
-		if (bclFile.existsAsFile() && bclFile.hasWriteAccess()) {
-			bclFile.deleteFile();
-		}
-		if (bclFile.getFileExtension().toLowerCase() == ".syx") {
-			auto messages = bcr_->convertToSyx(document_.getAllContent().toStdString(), true);
-			Sysex::saveSysex(bclFile.getFullPathName().toStdString(), messages);
-		}
-		else {
-			// Write as ASCII text
-			FileOutputStream out(bclFile);
-			if (out.openedOk()) {
-				out.writeText(document_.getAllContent(), false, false, nullptr);
+		// Snapshot the document, whatever is typed while the save runs is not part of it
+		int editCount = editCount_;
+		Component::SafePointer<BCLEditor> safeThis(this);
+		int generation = ++ioGeneration_;
+		startIO("Saving " + File(currentFilePath_).getFileName() + "...", DocumentIO::instance().save(File(currentFilePath_), document_.getAllContent(), [safeThis, generation](double progress) {
+			if (safeThis && safeThis->ioGeneration_ == generation) safeThis->uploadProgress_ = progress;
+		}, [safeThis, editCount, generation](DocumentIO::Result const &result) {
+			if (!safeThis) return;
+			if (result.success && safeThis->editCount_ == editCount) {
+				safeThis->document_.setSavePoint();
 			}
-		}
+			safeThis->ioFinished(result, "Saved", generation);
+		}), true);
 	}
 	else {
 		saveAsDocument();
 	}
 }
 
+bool BCLEditor::refuseWhileSaving()
+{
+	// Loading would cancel the save, and the user asked for that file to be written
+	if (ioTask_ && ioIsSave_) {
+		uploadStatus_.setText("Still saving, please wait for the save to finish", dontSendNotification);
+		return true;
+	}
+	return false;
+}
+
+void BCLEditor::startIO(String const &status, DocumentIO::TTaskHandle task, bool isSave)
+{
+	if (ioTask_) {
+		// Only the latest load or save counts, a newer save replaces an older one completely
+		ioTask_->cancel();
+	}
+	ioTask_ = task;
+	ioIsSave_ = isSave;
+	uploadProgress_ = 0.0;
+	uploadStatus_.setText(status, dontSendNotification);
+	cancelButton_.setVisible(true);
+}
+
+void BCLEditor::ioFinished(DocumentIO::Result const &result, String const &verb, int generation)
+{
+	String message;
+	if (result.cancelled) {
+		message = "Cancelled, " + result.file.getFileName() + " was not changed";
+	}
+	else if (result.success) {
+		message = verb + " " + result.file.getFileName() + " in " + String(result.milliseconds, 1) + " ms";
+	}
+	else {
+		message = "Error with " + result.file.getFullPathName() + ": " + result.errorMessage;
+		SimpleLogger::instance()->postMessage(message);
+	}
+	// A cancelled task might report back after the next one was started, then the status belongs to the newer one
+	if (generation == ioGeneration_) {
+		ioTask_.reset();
+		cancelButton_.setVisible(false);
+		uploadProgress_ = 1.0;
+		uploadStatus_.setText(message, dontSendNotification);
+	}
+}
+
 void BCLEditor::saveAsDocument()
 {
 	std::string lastPath = Settings::instance().get(kLastPath, File::getSpecialLocation(File::userDocumentsDirectory).getFullPathName().toStdString());
@@ -145,14 +352,87 @@ void BCLEditor::saveAsDocument()
 	}
 }
 
-void BCLEditor::sendToBCR()
+bool BCLEditor::sendToBCR()
 {
-	auto sysex = bcr_->convertToSyx(document_.getAllContent().toStdString(), true); // Make sure to set verbatim flag, otherwise the line numbers won't match
-	bcr_->sendSysExToBCR(midikraft::MidiController::instance()->getMidiOutput(bcr_->midiOutput()), sysex, SimpleLogger::instance(), [this](std::vector<midikraft::BCR2000::BCRError> const &errors) {
-		bcr_->invalidateListOfPresets();
-		currentError_.updateData(errors);
-		lastErrors_ = errors;
+	std::vector<int> messageLines;
+	auto sysex = compilationCache_.compile(document_, &messageLines); // The cache encodes verbatim, otherwise the line numbers won't match
+	return upload(sysex, messageLines);
+}
+
+bool BCLEditor::sendChangesToBCR()
+{
+	std::vector<int> changedLines;
+	if (lastSentGeneration_ != transmitter_->uploadGeneration() || !BCLDelta::linesToUpload(lastSentLines_, documentLines(), changedLines)) {
+		SimpleLogger::instance()->postMessage("Changes can't be sent on their own, sending the complete preset");
+		return sendToBCR();
+	}
+	std::vector<int> messageLines;
+	auto sysex = compilationCache_.compileLines(document_, changedLines, &messageLines);
+	SimpleLogger::instance()->postMessage("Sending " + String(changedLines.size()) + " of " + String(document_.getNumLines()) + " lines to the BCR2000");
+	return upload(sysex, messageLines);
+}
+
+bool BCLEditor::upload(std::vector<MidiMessage> const &sysex, std::vector<int> const &messageLines)
+{
+	if (transmitter_->isBusy()) {
+		SimpleLogger::instance()->postMessage("Still sending to the BCR2000, please wait for the upload to finish");
+		return false;
+	}
+	auto sentLines = documentLines();
+	// Sends only happen on the message thread, so this is the generation the send below starts
+	int generation = transmitter_->uploadGeneration() + 1;
+	uploadProgress_ = 0.0;
+	Component::SafePointer<BCLEditor> safeThis(this);
+	transmitter_->send(sysex, [safeThis](BCRTransmitter::Statistics const &statistics) {
+		MessageManager::callAsync([safeThis, statistics]() {
+			if (safeThis) {
+				safeThis->uploadProgress_ = statistics.messagesTotal > 0 ? statistics.messagesAcknowledged / (double) statistics.messagesTotal : 1.0;
+				safeThis->uploadStatus_.setText(statistics.toString(), dontSendNotification);
+			}
+		});
+	}, [safeThis, messageLines, sentLines, generation](std::vector<midikraft::BCR2000::BCRError> const &errors, bool aborted, BCRTransmitter::Statistics const &statistics) {
+		MessageManager::callAsync([safeThis, messageLines, sentLines, generation, errors, aborted, statistics]() {
+			if (!safeThis) return;
+			auto self = safeThis.getComponent();
+			self->bcr_->invalidateListOfPresets();
+			if (self->uploadedHandler_) {
+				self->uploadedHandler_();
+			}
+			// The device counts the messages it received, map that back to the lines of the document
+			auto mapped = errors;
+			for (auto &error : mapped) {
+				int messageNo = error.lineNumber - 1;
+				if (messageNo >= 0 && messageNo < static_cast<int>(messageLines.size())) {
+					int documentLine = messageLines[messageNo];
+					error.lineNumber = documentLine + 1;
+					error.lineText = sentLines[documentLine];
+				}
+			}
+			if (mapped.empty() && !aborted) {
+				self->lastSentLines_ = sentLines;
+				self->lastSentGeneration_ = generation;
+			}
+			else {
+				// Unclear what the device holds now, next time send everything
+				self->lastSentLines_.clear();
+				self->lastSentGeneration_ = -1;
+			}
+			self->uploadStatus_.setText((aborted ? "Aborted: " : "Done: ") + statistics.toString(), dontSendNotification);
+			SimpleLogger::instance()->postMessage("Upload to BCR2000 " + String(aborted ? "aborted" : "finished") + ", " + statistics.toString());
+			self->showDeviceErrors(mapped);
+		});
 	});
+	return true;
+}
+
+std::vector<std::string> BCLEditor::documentLines() const
+{
+	std::vector<std::string> result;
+	result.reserve(static_cast<size_t>(document_.getNumLines()));
+	for (int i = 0; i < document_.getNumLines(); i++) {
+		result.push_back(document_.getLine(i).trimCharactersAtEnd("\r\n").toStdString());
+	}
+	return result;
 }
 
 juce::String BCLEditor::currentFileName() const
@@ -160,17 +440,51 @@ juce::String BCLEditor::currentFileName() const
 	return currentFilePath_;
 }
 
+String BCLEditor::documentText() const
+{
+	return document_.getAllContent();
+}
+
+std::vector<MidiMessage> BCLEditor::compiledSysex()
+{
+	return compilationCache_.compile(document_);
+}
+
+bool BCLEditor::hasUnsavedChanges() const
+{
+	return document_.hasChangedSinceSavePoint();
+}
+
 void BCLEditor::codeDocumentTextInserted(const String& newText, int insertIndex)
 {
+	documentLinesChanged(CodeDocument::Position(document_, insertIndex).getLineNumber());
 }
 
 void BCLEditor::codeDocumentTextDeleted(int startIndex, int endIndex)
 {
+	// The text is already gone, so the start position is where the remaining lines were joined
+	documentLinesChanged(CodeDocument::Position(document_, startIndex).getLineNumber());
+}
+
+void BCLEditor::documentLinesChanged(int firstChangedLine)
+{
+	editCount_++;
+	compilationCache_.documentChanged(document_, firstChangedLine);
+
+	// Inserting n line breaks turns the first changed line into n + 1 lines, deleting n line breaks joins n + 1 lines into one
+	int numLines = document_.getNumLines();
+	int delta = numLines - lineCount_;
+	std::vector<std::string> newLines;
+	for (int i = firstChangedLine; i <= firstChangedLine + jmax(0, delta) && i < numLines; i++) {
+		newLines.push_back(document_.getLine(i).trimCharactersAtEnd("\r\n").toStdString());
+	}
+	validator_->linesChanged(firstChangedLine, 1 + jmax(0, -delta), newLines);
+	lineCount_ = numLines;
 }
 
 void BCLEditor::timerCallback()
 {
-	if (editor_->isShowing()) {
+	if (editor_ && editor_->isShowing()) {
 		editor_->grabKeyboardFocus();
 		grabbedFocus_ = true;
 		stopTimer();
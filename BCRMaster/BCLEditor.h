@@ -11,22 +11,36 @@
 #include "BCR2000.h"
 
 #include "SimpleTable.h"
+#include "SyxCompilationCache.h"
+#include "BCRTransmitter.h"
+#include "BCLValidator.h"
+#include "BCLTokeniser.h"
+#include "DocumentIO.h"
+#include "DocumentSearch.h"
 
 class BCLEditor : public Component,
 	private CodeDocument::Listener,
 	private Timer
 {
 public:
-	BCLEditor(std::shared_ptr<midikraft::BCR2000> bcr, std::function<void()> detectedHandler);
+	// The transmitter is the one of the device, shared with everyone else sending to it
+	BCLEditor(std::shared_ptr<midikraft::BCR2000> bcr, std::shared_ptr<BCRTransmitter> transmitter, std::function<void()> detectedHandler, std::function<void()> uploadedHandler);
 	virtual ~BCLEditor();
 
 	virtual void resized() override;
+	virtual void visibilityChanged() override;
 	
 	void loadDocument(std::string const &document);
 	void loadDocumentFromSyx(std::vector<MidiMessage> const &messages);
 
 	// Navigate document
 	void jumpToLine(int rowNumber);
+	void selectRange(int startIndex, int endIndex);
+
+	// Counts every change to the document, to check that it is still the version edits were computed for
+	int editCount() const;
+	// Applies all edits as one undoable transaction, unless the document changed since expectedEditCount
+	bool applyEdits(std::vector<DocumentSearch::Edit> const &edits, int expectedEditCount);
 
 	// Code document listener
 	virtual void codeDocumentTextInserted(const String& newText, int insertIndex) override;
@@ -35,21 +49,67 @@ public:
 	// This is only to grab focus once
 	virtual void timerCallback() override;
 
-	bool loadDocument();
+	// Asks for a file and starts loading it, the editor only takes its name once the load succeeded
+	bool loadDocument(File &outChosenFile);
+	bool loadFile(File const &bclFile);
 	void saveDocument();
 	void saveAsDocument();
-	void sendToBCR();
+	// Both return false when the upload was refused, because the transmitter is still busy with another one
+	bool sendToBCR();
+	bool sendChangesToBCR();
 
 	String currentFileName() const;
+	String documentText() const;
+	// The complete preset as sysex, for sending it somewhere else than this editor's BCR2000
+	std::vector<MidiMessage> compiledSysex();
+	bool hasUnsavedChanges() const;
+
+	// The CodeEditorComponent and error table only exist while the tab is shown and a while after
+	bool isMaterialized() const;
+	void materialize();
+	void dematerialize();
 
 private:
+	bool upload(std::vector<MidiMessage> const &sysex, std::vector<int> const &messageLines);
+	std::vector<std::string> documentLines() const;
+	void documentLinesChanged(int firstChangedLine);
+	void setContent(String const &text);
+	void showValidatorErrors(std::vector<midikraft::BCR2000::BCRError> const &errors);
+	void showDeviceErrors(std::vector<midikraft::BCR2000::BCRError> const &errors);
+	void updateErrorTable();
+	bool refuseWhileSaving();
+	void startIO(String const &status, DocumentIO::TTaskHandle task, bool isSave);
+	void ioFinished(DocumentIO::Result const &result, String const &verb, int generation);
+
 	std::shared_ptr<midikraft::BCR2000> bcr_;
 	std::function<void()> detectedHandler_;	
+	std::function<void()> uploadedHandler_;
+	BCLTokeniser tokeniser_;
 	std::unique_ptr<CodeEditorComponent> editor_;
+	std::shared_ptr<BCRTransmitter> transmitter_;
+	double uploadProgress_;
+	ProgressBar uploadProgressBar_;
+	Label uploadStatus_;
 	CodeDocument document_;
-	SimpleTable<std::vector<midikraft::BCR2000::BCRError>> currentError_;
+	SyxCompilationCache compilationCache_;
+	std::unique_ptr<BCLValidator> validator_;
+	int lineCount_;
+	std::unique_ptr<SimpleTable<std::vector<midikraft::BCR2000::BCRError>>> currentError_;
 	StringArray errors_;
-	std::vector<midikraft::BCR2000::BCRError> lastErrors_;	
+	// The validator reports for the text as it is typed, the device for the last upload. Neither replaces the other
+	std::vector<midikraft::BCR2000::BCRError> validatorErrors_;
+	std::vector<midikraft::BCR2000::BCRError> deviceErrors_;
+	std::vector<midikraft::BCR2000::BCRError> lastErrors_; // Both, as shown in the table
+	std::vector<std::string> lastSentLines_;
+	int lastSentGeneration_; // The transmitter's upload generation that left lastSentLines_ on the device
+	DocumentIO::TTaskHandle ioTask_;
+	bool ioIsSave_;
+	TextButton cancelButton_;
+	int editCount_;
+	int ioGeneration_;
+	CodeDocument::Position caretPosition_;
+	int firstLineOnScreen_;
+	int hiddenGeneration_;
 
 	String currentFilePath_;
 	bool grabbedFocus_;
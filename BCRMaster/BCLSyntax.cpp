@@ -0,0 +1,211 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCLSyntax.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+	const int kNumberOfPresets = 32;
+	const int kElementContexts = BCLSyntax::EncoderContext | BCLSyntax::ButtonContext;
+
+	const BCLSyntax::Command kCommands[] = {
+		{ "$button", BCLSyntax::ButtonContext, 64 },
+		{ "$encoder", BCLSyntax::EncoderContext, 56 },
+		{ "$end", BCLSyntax::NoContext, 0 },
+		{ "$global", BCLSyntax::GlobalContext, 0 },
+		{ "$preset", BCLSyntax::PresetContext, 0 },
+		{ "$recall", BCLSyntax::NoContext, kNumberOfPresets },
+		{ "$rev", BCLSyntax::NoContext, 0 },
+		{ "$store", BCLSyntax::NoContext, kNumberOfPresets },
+	};
+
+	const BCLSyntax::Property kProperties[] = {
+		{ ".deadtime", BCLSyntax::GlobalContext, 1 },
+		{ ".default", kElementContexts, 1 },
+		{ ".deviceid", BCLSyntax::GlobalContext, 1 },
+		{ ".easypar", kElementContexts, 2 },
+		{ ".egroups", BCLSyntax::PresetContext, 1 },
+		{ ".fkeys", BCLSyntax::PresetContext, 1 },
+		{ ".footsw", BCLSyntax::GlobalContext, 1 },
+		{ ".init", BCLSyntax::PresetContext, 0 },
+		{ ".keyoverride", kElementContexts, 1 },
+		{ ".lock", BCLSyntax::PresetContext, 1 },
+		{ ".midimode", BCLSyntax::GlobalContext, 1 },
+		{ ".minmax", kElementContexts, 2 },
+		{ ".mode", kElementContexts, 1 },
+		{ ".name", BCLSyntax::PresetContext, 1 },
+		{ ".request", BCLSyntax::PresetContext, 1 },
+		{ ".resolution", BCLSyntax::EncoderContext, 1 },
+		{ ".rxch", BCLSyntax::GlobalContext, 1 },
+		{ ".showvalue", kElementContexts, 1 },
+		{ ".snapshot", BCLSyntax::PresetContext, 1 },
+		{ ".startup", BCLSyntax::GlobalContext, 1 },
+		{ ".tx", kElementContexts, 1 },
+		{ ".txinterval", BCLSyntax::GlobalContext, 1 },
+	};
+
+	const char *kErrorDescriptions[] = {
+		"No error",
+		"Unknown token",
+		"Data without token",
+		"Argument missing",
+		"Wrong device",
+		"Wrong revision",
+		"Missing revision",
+		"Internal error",
+		"Mode missing",
+		"Bad item index",
+		"Not a number",
+		"Value out of range",
+		"Invalid argument",
+		"Invalid command",
+		"Wrong number of arguments",
+		"Too much data",
+		"Already defined",
+		"Preset missing",
+		"Preset too complex",
+		"Wrong preset",
+		"Preset too new",
+		"Preset check",
+		"Sequence error",
+		"Wrong context",
+	};
+
+	// Splits the line into lower case words, dropping the comment. Quoted strings stay one word.
+	void tokenize(std::string const &line, std::vector<std::string> &words) {
+		words.clear();
+		std::string current;
+		bool inString = false;
+		for (char c : line) {
+			if (c == '\'') {
+				inString = !inString;
+				current.push_back(c);
+				continue;
+			}
+			if (!inString && c == ';') {
+				break;
+			}
+			if (!inString && std::isspace(static_cast<unsigned char>(c))) {
+				if (!current.empty()) {
+					words.push_back(current);
+					current.clear();
+				}
+				continue;
+			}
+			current.push_back(inString ? c : static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+		}
+		if (!current.empty()) {
+			words.push_back(current);
+		}
+	}
+
+	bool parseIndex(std::string const &word, int &outIndex) {
+		char *end = nullptr;
+		long value = std::strtol(word.c_str(), &end, 10);
+		if (end == word.c_str() || *end != '\0') {
+			return false;
+		}
+		outIndex = static_cast<int>(value);
+		return true;
+	}
+}
+
+BCLSyntax::Command const *BCLSyntax::findCommand(std::string const &name)
+{
+	for (auto const &command : kCommands) {
+		if (name == command.name) return &command;
+	}
+	return nullptr;
+}
+
+BCLSyntax::Property const *BCLSyntax::findProperty(std::string const &name)
+{
+	for (auto const &property : kProperties) {
+		if (name == property.name) return &property;
+	}
+	return nullptr;
+}
+
+bool BCLSyntax::isCommandLine(std::string const &line)
+{
+	for (char c : line) {
+		if (!std::isspace(static_cast<unsigned char>(c))) {
+			return c == '$';
+		}
+	}
+	return false;
+}
+
+int BCLSyntax::checkLine(std::string const &line, LineState &state)
+{
+	std::vector<std::string> words;
+	tokenize(line, words);
+	if (words.empty()) {
+		return NoError;
+	}
+
+	auto const &first = words[0];
+	if (first[0] == '$') {
+		auto command = findCommand(first);
+		if (!command) {
+			return state.revisionSeen ? UnknownToken : MissingRevision;
+		}
+		if (first == "$rev") {
+			state.revisionSeen = true;
+			state.context = NoContext;
+			return words.size() < 2 ? ArgumentMissing : NoError;
+		}
+		if (!state.revisionSeen) {
+			return MissingRevision;
+		}
+		if (first == "$end") {
+			state.revisionSeen = false;
+			state.context = NoContext;
+			return NoError;
+		}
+		state.context = command->opens;
+		if (command->maxIndex > 0) {
+			int index;
+			if (words.size() < 2) return ArgumentMissing;
+			if (!parseIndex(words[1], index)) return NotANumber;
+			if (index < 1 || index > command->maxIndex) return BadItemIndex;
+		}
+		return NoError;
+	}
+
+	if (!state.revisionSeen) {
+		return MissingRevision;
+	}
+	if (first[0] == '.') {
+		auto property = findProperty(first);
+		if (!property) {
+			return UnknownToken;
+		}
+		if ((property->contexts & state.context) == 0) {
+			return WrongContext;
+		}
+		if (static_cast<int>(words.size()) - 1 < property->minArguments) {
+			return ArgumentMissing;
+		}
+		if (first == ".showvalue" && words[1] != "on" && words[1] != "off") {
+			return InvalidArgument;
+		}
+		return NoError;
+	}
+	return DataWithoutToken;
+}
+
+const char *BCLSyntax::errorDescription(int errorCode)
+{
+	if (errorCode >= 0 && errorCode < static_cast<int>(sizeof(kErrorDescriptions) / sizeof(kErrorDescriptions[0]))) {
+		return kErrorDescriptions[errorCode];
+	}
+	return "Unknown error";
+}
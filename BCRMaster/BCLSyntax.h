@@ -0,0 +1,65 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <string>
+
+// What we know about the BCL language: commands, element properties, item ranges and the device's error codes
+class BCLSyntax {
+public:
+	// Blocks opened by a command, used as bit mask for the properties valid in them
+	enum Context {
+		NoContext = 0,
+		PresetContext = 1,
+		GlobalContext = 2,
+		EncoderContext = 4,
+		ButtonContext = 8
+	};
+
+	// Error codes as reported by the BCR2000 in its BCL reply
+	enum ErrorCode {
+		NoError = 0,
+		UnknownToken = 1,
+		DataWithoutToken = 2,
+		ArgumentMissing = 3,
+		MissingRevision = 6,
+		BadItemIndex = 9,
+		NotANumber = 10,
+		InvalidArgument = 12,
+		WrongContext = 23
+	};
+
+	struct Command {
+		const char *name;
+		Context opens; // NoContext if the command doesn't open a block
+		int maxIndex; // 0 if the command has no index argument
+	};
+
+	struct Property {
+		const char *name;
+		int contexts;
+		int minArguments;
+	};
+
+	// State carried from line to line while checking a document
+	struct LineState {
+		LineState() : revisionSeen(false), context(NoContext) {}
+		bool revisionSeen;
+		Context context;
+	};
+
+	static Command const *findCommand(std::string const &name);
+	static Property const *findProperty(std::string const &name);
+
+	// Checks one line and updates the state for the lines following it. Returns the error code the device would most likely report.
+	static int checkLine(std::string const &line, LineState &state);
+
+	// True for lines starting with a $ command, these determine the context of the lines below
+	static bool isCommandLine(std::string const &line);
+
+	static const char *errorDescription(int errorCode);
+};
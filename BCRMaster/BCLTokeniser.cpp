@@ -0,0 +1,158 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCLTokeniser.h"
+
+#include "BCLSyntax.h"
+
+#include <cstring>
+
+namespace {
+	// Arguments of .easypar, .showvalue, .mode and the special bytes in .tx lines. Must be sorted for the binary search, which is checked at compile time.
+	constexpr const char *kKeywords[] = {
+		"12dot", "12dot/off", "1dot", "1dot/off", "absolute", "absolute/14", "bar", "bar/off", "cc", "cks-1", "cks-2", "cks-3", "cks-4", "cut", "damp", "down",
+		"gs/xg", "ifn", "ifp", "increment", "note", "nrpn", "off", "on", "pan", "pb", "pc", "qual", "relative-1", "relative-2", "relative-3", "spread",
+		"toggleoff", "toggleon", "up", "val", "val0.13", "val0.3", "val0.6", "val1.7", "val4.7", "val7.13"
+	};
+	constexpr int kNumKeywords = sizeof(kKeywords) / sizeof(kKeywords[0]);
+
+	constexpr int compareWords(const char *a, const char *b) {
+		return (*a != *b || *a == '\0') ? static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b) : compareWords(a + 1, b + 1);
+	}
+
+	constexpr bool isSortedTable(const char *const *table, int size) {
+		return size < 2 || (compareWords(table[0], table[1]) < 0 && isSortedTable(table + 1, size - 1));
+	}
+
+	static_assert(isSortedTable(kKeywords, kNumKeywords), "BCL keyword table must be sorted");
+
+	bool isWordChar(juce_wchar c) {
+		return CharacterFunctions::isLetterOrDigit(c) || c == '/' || c == '-' || c == '.' || c == '_' || c == '+';
+	}
+
+	bool isHexWord(const char *word) {
+		if (*word == '\0') return false;
+		for (; *word; word++) {
+			if (!CharacterFunctions::isDigit(*word) && !(*word >= 'a' && *word <= 'f')) return false;
+		}
+		return true;
+	}
+
+	bool isNumberWord(const char *word) {
+		if (*word == '-') word++;
+		if (*word == '\0') return false;
+		for (; *word; word++) {
+			if (!CharacterFunctions::isDigit(*word)) return false;
+		}
+		return true;
+	}
+}
+
+bool BCLTokeniser::isKeyword(const char *word)
+{
+	int low = 0;
+	int high = kNumKeywords - 1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		int comparison = std::strcmp(word, kKeywords[middle]);
+		if (comparison == 0) return true;
+		if (comparison < 0) high = middle - 1; else low = middle + 1;
+	}
+	return false;
+}
+
+int BCLTokeniser::readWord(CodeDocument::Iterator& source, char *buffer)
+{
+	int length = 0;
+	while (isWordChar(source.peekNextChar())) {
+		auto c = source.nextChar();
+		if (length < kMaxWordLength - 1) {
+			buffer[length++] = static_cast<char>(CharacterFunctions::toLowerCase(c));
+		}
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+int BCLTokeniser::readNextToken(CodeDocument::Iterator& source)
+{
+	auto c = source.peekNextChar();
+	if (c == '\n' || c == '\r' || CharacterFunctions::isWhitespace(c)) {
+		source.skipWhitespace();
+		return tokenType_whitespace;
+	}
+
+	char word[kMaxWordLength + 1];
+	switch (c) {
+	case ';':
+		source.skipToEndOfLine();
+		return tokenType_comment;
+	case '\'':
+		// Strings end at the closing quote or the end of the line
+		source.skip();
+		while (!source.isEOF()) {
+			auto next = source.peekNextChar();
+			if (next == '\n' || next == '\r') break;
+			source.skip();
+			if (next == '\'') break;
+		}
+		return tokenType_string;
+	case '$': {
+		source.skip();
+		word[0] = '$';
+		readWord(source, word + 1);
+		if (BCLSyntax::findCommand(word)) return tokenType_command;
+		// $F0 style hex bytes in .tx lines
+		return isHexWord(word + 1) ? tokenType_hexNumber : tokenType_error;
+	}
+	case '.': {
+		source.skip();
+		word[0] = '.';
+		readWord(source, word + 1);
+		return BCLSyntax::findProperty(word) ? tokenType_property : tokenType_error;
+	}
+	default:
+		break;
+	}
+
+	if (isWordChar(c)) {
+		readWord(source, word);
+		if (isNumberWord(word)) return tokenType_number;
+		if (isKeyword(word)) return tokenType_keyword;
+		return tokenType_identifier;
+	}
+
+	source.skip();
+	return tokenType_error;
+}
+
+CodeEditorComponent::ColourScheme BCLTokeniser::getDefaultColourScheme()
+{
+	struct Type {
+		const char *name;
+		uint32 colour;
+	};
+
+	// In the order of the TokenType enum
+	const Type types[] = {
+		{ "Error", 0xffcc0000 },
+		{ "Comment", 0xff3c8c3c },
+		{ "Command", 0xff0000cc },
+		{ "Property", 0xff8a2be2 },
+		{ "Keyword", 0xffb8860b },
+		{ "Number", 0xff880000 },
+		{ "Hex number", 0xffb03060 },
+		{ "String", 0xff2f4f4f },
+		{ "Identifier", 0xff000000 },
+		{ "Whitespace", 0xff000000 }
+	};
+
+	CodeEditorComponent::ColourScheme scheme;
+	for (auto const &type : types) {
+		scheme.set(type.name, Colour(type.colour));
+	}
+	return scheme;
+}
@@ -0,0 +1,38 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Syntax highlighting for BCL. No BCL token spans more than one line, so every line starts in the same lexer state
+// and the CodeEditorComponent only needs to tokenise the lines it shows or that were changed.
+class BCLTokeniser : public CodeTokeniser {
+public:
+	enum TokenType {
+		tokenType_error = 0,
+		tokenType_comment,
+		tokenType_command,
+		tokenType_property,
+		tokenType_keyword,
+		tokenType_number,
+		tokenType_hexNumber,
+		tokenType_string,
+		tokenType_identifier,
+		tokenType_whitespace
+	};
+
+	int readNextToken(CodeDocument::Iterator& source) override;
+	CodeEditorComponent::ColourScheme getDefaultColourScheme() override;
+
+	static bool isKeyword(const char *word);
+
+private:
+	static const int kMaxWordLength = 32;
+
+	// Reads the rest of a word into the buffer, lower case, and returns its length
+	static int readWord(CodeDocument::Iterator& source, char *buffer);
+};
@@ -0,0 +1,161 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCLValidator.h"
+
+#include "BCLSyntax.h"
+
+#include <cctype>
+#include <limits>
+
+BCLValidator::BCLValidator(TErrorHandler errorHandler) : Thread("BCLValidator"), errorHandler_(errorHandler), alive_(std::make_shared<std::atomic<bool>>(true))
+{
+	startThread(3);
+}
+
+BCLValidator::~BCLValidator()
+{
+	*alive_ = false;
+	signalThreadShouldExit();
+	editsArrived_.signal();
+	stopThread(1000);
+}
+
+void BCLValidator::linesChanged(int firstLine, int numberOfOldLines, std::vector<std::string> const &newLines)
+{
+	Edit edit;
+	edit.firstLine = firstLine;
+	edit.numberOfOldLines = numberOfOldLines;
+	edit.newLines = newLines;
+	{
+		ScopedLock lock(editLock_);
+		pendingEdits_.push_back(edit);
+	}
+	editsArrived_.signal();
+}
+
+void BCLValidator::run()
+{
+	while (!threadShouldExit()) {
+		editsArrived_.wait(-1);
+		std::vector<Edit> edits;
+		{
+			ScopedLock lock(editLock_);
+			edits.swap(pendingEdits_);
+		}
+		if (edits.empty()) {
+			continue;
+		}
+		int dirtyFrom = std::numeric_limits<int>::max();
+		int dirtyTo = -1;
+		for (auto const &edit : edits) {
+			applyEdit(edit, dirtyFrom, dirtyTo);
+		}
+		if (dirtyFrom <= dirtyTo) {
+			checkLines(dirtyFrom, dirtyTo);
+		}
+		publish();
+	}
+}
+
+void BCLValidator::applyEdit(Edit const &edit, int &dirtyFrom, int &dirtyTo)
+{
+	int size = static_cast<int>(lines_.size());
+	int first = jlimit(0, size, edit.firstLine);
+	int numberOld = jlimit(0, size - first, edit.numberOfOldLines);
+
+	// A changed $rev or $end changes the state of everything below
+	bool boundaryChanged = false;
+	for (int i = first; i < first + numberOld; i++) {
+		boundaryChanged = boundaryChanged || isRevisionBoundary(lines_[i]);
+	}
+	for (auto const &line : edit.newLines) {
+		boundaryChanged = boundaryChanged || isRevisionBoundary(line);
+	}
+
+	lines_.erase(lines_.begin() + first, lines_.begin() + first + numberOld);
+	lines_.insert(lines_.begin() + first, edit.newLines.begin(), edit.newLines.end());
+	errorCodes_.erase(errorCodes_.begin() + first, errorCodes_.begin() + first + numberOld);
+	errorCodes_.insert(errorCodes_.begin() + first, edit.newLines.size(), 0);
+
+	// Earlier dirty lines moved with this edit
+	int shift = static_cast<int>(edit.newLines.size()) - numberOld;
+	if (dirtyTo >= first + numberOld) {
+		dirtyTo += shift;
+	}
+	else if (dirtyTo >= first) {
+		dirtyTo = first + static_cast<int>(edit.newLines.size()) - 1;
+	}
+
+	int last = first + static_cast<int>(edit.newLines.size()) - 1;
+	if (boundaryChanged) {
+		last = static_cast<int>(lines_.size()) - 1;
+	}
+	else {
+		// The lines below the edit up to the next command belong to the same block, and their context might have changed
+		last = jmax(last, first);
+		while (last + 1 < static_cast<int>(lines_.size()) && !BCLSyntax::isCommandLine(lines_[last + 1])) {
+			last++;
+		}
+	}
+	dirtyFrom = jmin(dirtyFrom, first);
+	dirtyTo = jmin(jmax(dirtyTo, last), static_cast<int>(lines_.size()) - 1);
+}
+
+void BCLValidator::checkLines(int from, int to)
+{
+	// Find the command line above for the context, and the $rev or $end above that for the revision state
+	int blockStart = from;
+	while (blockStart > 0 && !BCLSyntax::isCommandLine(lines_[blockStart])) {
+		blockStart--;
+	}
+	BCLSyntax::LineState state;
+	for (int i = blockStart - 1; i >= 0; i--) {
+		if (isRevisionBoundary(lines_[i])) {
+			BCLSyntax::checkLine(lines_[i], state);
+			break;
+		}
+	}
+	for (int i = blockStart; i <= to && i < static_cast<int>(lines_.size()); i++) {
+		int errorCode = BCLSyntax::checkLine(lines_[i], state);
+		if (i >= from) {
+			errorCodes_[i] = errorCode;
+		}
+	}
+}
+
+void BCLValidator::publish()
+{
+	std::vector<midikraft::BCR2000::BCRError> errors;
+	for (size_t i = 0; i < errorCodes_.size(); i++) {
+		if (errorCodes_[i] != BCLSyntax::NoError) {
+			midikraft::BCR2000::BCRError error;
+			error.errorCode = errorCodes_[i];
+			error.lineNumber = static_cast<int>(i) + 1;
+			error.errorText = BCLSyntax::errorDescription(errorCodes_[i]);
+			error.lineText = lines_[i];
+			errors.push_back(error);
+		}
+	}
+	auto alive = alive_;
+	auto handler = errorHandler_;
+	MessageManager::callAsync([alive, handler, errors]() {
+		if (*alive) {
+			handler(errors);
+		}
+	});
+}
+
+bool BCLValidator::isRevisionBoundary(std::string const &line)
+{
+	if (!BCLSyntax::isCommandLine(line)) {
+		return false;
+	}
+	auto start = line.find('$');
+	auto command = line.substr(start, 4);
+	for (auto &c : command) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	return command == "$rev" || command == "$end";
+}
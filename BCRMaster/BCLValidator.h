@@ -0,0 +1,54 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+#include <atomic>
+
+// Checks a BCL document on a background thread without the device, reporting errors in the same shape as the device does.
+// The validator keeps its own copy of the lines, updated by the edits reported from the CodeDocument listener,
+// and only re-checks the blocks touched by an edit.
+class BCLValidator : private Thread {
+public:
+	// Called on the message thread with all errors of the document whenever a check has finished
+	typedef std::function<void(std::vector<midikraft::BCR2000::BCRError> const &errors)> TErrorHandler;
+
+	explicit BCLValidator(TErrorHandler errorHandler);
+	virtual ~BCLValidator();
+
+	// Replace the lines [firstLine, firstLine + numberOfOldLines) by the new lines
+	void linesChanged(int firstLine, int numberOfOldLines, std::vector<std::string> const &newLines);
+
+private:
+	struct Edit {
+		int firstLine;
+		int numberOfOldLines;
+		std::vector<std::string> newLines;
+	};
+
+	void run() override;
+	void applyEdit(Edit const &edit, int &dirtyFrom, int &dirtyTo);
+	void checkLines(int from, int to);
+	void publish();
+	static bool isRevisionBoundary(std::string const &line);
+
+	TErrorHandler errorHandler_;
+
+	CriticalSection editLock_;
+	std::vector<Edit> pendingEdits_;
+	WaitableEvent editsArrived_;
+
+	// Owned by the validator thread
+	std::vector<std::string> lines_;
+	std::vector<int> errorCodes_;
+
+	// Set to false on destruction, so results still queued for the message thread are dropped
+	std::shared_ptr<std::atomic<bool>> alive_;
+};
@@ -0,0 +1,330 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCR2000Emulator.h"
+
+#include "BCLDecoder.h"
+#include "BCLSyntax.h"
+
+#include "Sysex.h"
+
+namespace {
+	const uint8 kBehringer[] = { 0x00, 0x20, 0x32 };
+	const uint8 kModelBCR2000 = 0x15;
+	const uint8 kModelAny = 0x7f;
+	const uint8 kDeviceAny = 0x7f;
+
+	// Commands, found after manufacturer, device and model
+	const uint8 kRequestIdentity = 0x01;
+	const uint8 kSendIdentity = 0x02;
+	const uint8 kBCLText = 0x20;
+	const uint8 kBCLReply = 0x21;
+	const uint8 kSelectPreset = 0x22;
+	const uint8 kRequestData = 0x40;
+	const uint8 kRequestPresetName = 0x42;
+	const uint8 kCurrentPreset = 0x7e;
+
+	const char *kIdentity = "BCR2000 1.10";
+
+	const char *kEmulateFlag = "--emulate";
+}
+
+BCR2000Emulator::BCR2000Emulator() : Thread("BCR2000Emulator"), storeSlot_(-1), received_(0),
+	inputFreeAt_(0.0), outputFreeAt_(0.0), sent_(0)
+{
+	for (int i = 0; i < kNumberOfPresets; i++) {
+		presets_.add("$rev R1\n$preset\n  .name 'Emulated preset " + String(i + 1) + "'\n  .init\n$end\n");
+	}
+}
+
+BCR2000Emulator::~BCR2000Emulator()
+{
+	stop();
+}
+
+bool BCR2000Emulator::start(Options const &options)
+{
+	stop();
+	options_ = options;
+	// Our output is what the application sees as input from the device and vice versa
+	output_ = MidiOutput::createNewDevice(options_.portName);
+	input_ = MidiInput::createNewDevice(options_.portName, this);
+	if (!output_ || !input_) {
+		output_.reset();
+		input_.reset();
+		return false;
+	}
+	inputFreeAt_ = outputFreeAt_ = Time::getMillisecondCounterHiRes();
+	startThread(8);
+	input_->start();
+	return true;
+}
+
+void BCR2000Emulator::stop()
+{
+	if (input_) {
+		input_->stop();
+	}
+	signalThreadShouldExit();
+	queueChanged_.signal();
+	stopThread(1000);
+	input_.reset();
+	output_.reset();
+	ScopedLock lock(queueLock_);
+	queue_.clear();
+}
+
+void BCR2000Emulator::setPreset(int slot, String const &bcl)
+{
+	ScopedLock lock(stateLock_);
+	if (slot >= 0 && slot < kNumberOfPresets) {
+		presets_.set(slot, bcl);
+	}
+}
+
+String BCR2000Emulator::preset(int slot) const
+{
+	ScopedLock lock(stateLock_);
+	return presets_[slot];
+}
+
+void BCR2000Emulator::loadPresetsFromDirectory(File const &directory)
+{
+	auto files = directory.findChildFiles(File::findFiles, false, "*.bcl;*.syx");
+	files.sort();
+	for (int i = 0; i < files.size() && i < kNumberOfPresets; i++) {
+		if (files[i].getFileExtension().toLowerCase() == ".syx") {
+			auto text = BCLDecoder::decodeToText(Sysex::loadSysex(files[i].getFullPathName().toStdString()));
+			setPreset(i, String(text.data(), text.size()));
+		}
+		else {
+			setPreset(i, files[i].loadFileAsString());
+		}
+	}
+}
+
+int BCR2000Emulator::messagesReceived() const
+{
+	ScopedLock lock(stateLock_);
+	return received_;
+}
+
+int BCR2000Emulator::messagesSent() const
+{
+	return sent_.load();
+}
+
+void BCR2000Emulator::handleIncomingMidiMessage(MidiInput* source, const MidiMessage& message)
+{
+	ignoreUnused(source);
+	if (!message.isSysEx()) {
+		return;
+	}
+	auto data = message.getSysExData();
+	int size = message.getSysExDataSize();
+	if (size < 6 || memcmp(data, kBehringer, sizeof(kBehringer)) != 0) {
+		return;
+	}
+	if ((data[3] != options_.deviceId && data[3] != kDeviceAny) || (data[4] != kModelBCR2000 && data[4] != kModelAny)) {
+		return;
+	}
+
+	{
+		ScopedLock lock(stateLock_);
+		received_++;
+	}
+	// The request has to come through the slow line first
+	double now = Time::getMillisecondCounterHiRes();
+	{
+		ScopedLock lock(queueLock_);
+		inputFreeAt_ = jmax(inputFreeAt_, now) + wireTimeMs(message.getRawDataSize());
+	}
+
+	switch (data[5]) {
+	case kRequestIdentity:
+		sendIdentity();
+		break;
+	case kBCLText:
+		if (size >= 8) {
+			int index = (data[6] << 7) | data[7];
+			handleBCL(index, String(reinterpret_cast<const char *>(data + 8), static_cast<size_t>(size - 8)));
+		}
+		break;
+	case kSelectPreset:
+		// Nothing to emulate, the edit buffer is what was uploaded last
+		break;
+	case kRequestData:
+		if (size >= 7) sendDump(data[6]);
+		break;
+	case kRequestPresetName:
+		if (size >= 7) sendPresetName(data[6]);
+		break;
+	default:
+		break;
+	}
+}
+
+void BCR2000Emulator::handleBCL(int messageIndex, String const &line)
+{
+	int errorCode = 0;
+	{
+		ScopedLock lock(stateLock_);
+		bool wasInUpload = state_.revisionSeen;
+		errorCode = BCLSyntax::checkLine(line.toStdString(), state_);
+		auto command = line.trim().upToFirstOccurrenceOf(" ", false, false).toLowerCase();
+		if (command == "$rev") {
+			upload_.clear();
+			storeSlot_ = -1;
+		}
+		if (errorCode == 0 && command == "$store") {
+			storeSlot_ = line.trim().fromFirstOccurrenceOf(" ", false, false).getIntValue() - 1;
+		}
+		else if (errorCode == 0 && command != "$recall") {
+			upload_.add(line);
+		}
+		if (command == "$end" && wasInUpload && storeSlot_ >= 0 && storeSlot_ < kNumberOfPresets) {
+			presets_.set(storeSlot_, upload_.joinIntoString("\n") + "\n");
+		}
+	}
+
+	std::vector<uint8> payload = { kBCLReply, static_cast<uint8>((messageIndex >> 7) & 0x7f), static_cast<uint8>(messageIndex & 0x7f), static_cast<uint8>(errorCode) };
+	reply(payload);
+}
+
+void BCR2000Emulator::sendIdentity()
+{
+	std::vector<uint8> payload = { kSendIdentity };
+	for (const char *c = kIdentity; *c; c++) {
+		payload.push_back(static_cast<uint8>(*c));
+	}
+	reply(payload);
+}
+
+void BCR2000Emulator::sendPresetName(int slot)
+{
+	String name;
+	{
+		ScopedLock lock(stateLock_);
+		name = presetName(slot == kCurrentPreset ? upload_.joinIntoString("\n") : presets_[slot]);
+	}
+	StringArray lines;
+	lines.add("$rev R1");
+	lines.add("$preset");
+	lines.add("  .name '" + name + "'");
+	lines.add("$end");
+	sendBCLLines(lines);
+}
+
+void BCR2000Emulator::sendDump(int slot)
+{
+	String bcl;
+	{
+		ScopedLock lock(stateLock_);
+		bcl = slot == kCurrentPreset ? upload_.joinIntoString("\n") : presets_[slot];
+	}
+	StringArray lines;
+	lines.addLines(bcl);
+	while (lines.size() > 0 && lines[lines.size() - 1].trim().isEmpty()) {
+		lines.remove(lines.size() - 1);
+	}
+	sendBCLLines(lines);
+}
+
+void BCR2000Emulator::sendBCLLines(StringArray const &lines)
+{
+	int index = 0;
+	for (auto const &line : lines) {
+		std::vector<uint8> payload = { kBCLText, static_cast<uint8>((index >> 7) & 0x7f), static_cast<uint8>(index & 0x7f) };
+		for (auto c : line.toStdString()) {
+			payload.push_back(static_cast<uint8>(c & 0x7f));
+		}
+		reply(payload);
+		index++;
+	}
+}
+
+void BCR2000Emulator::reply(std::vector<uint8> const &payload)
+{
+	std::vector<uint8> data(kBehringer, kBehringer + sizeof(kBehringer));
+	data.push_back(options_.deviceId);
+	data.push_back(kModelBCR2000);
+	data.insert(data.end(), payload.begin(), payload.end());
+	auto message = MidiMessage::createSysExMessage(data.data(), static_cast<int>(data.size()));
+
+	ScopedLock lock(queueLock_);
+	double ready = jmax(inputFreeAt_ + options_.latencyMs, outputFreeAt_);
+	outputFreeAt_ = ready + wireTimeMs(message.getRawDataSize());
+	queue_.push_back({ outputFreeAt_, message });
+	queueChanged_.signal();
+}
+
+double BCR2000Emulator::wireTimeMs(int numBytes) const
+{
+	// One start and one stop bit per byte
+	return options_.baudRate > 0 ? numBytes * 10 * 1000.0 / options_.baudRate : 0.0;
+}
+
+void BCR2000Emulator::run()
+{
+	while (!threadShouldExit()) {
+		double waitMs = 100.0;
+		std::vector<MidiMessage> due;
+		{
+			ScopedLock lock(queueLock_);
+			double now = Time::getMillisecondCounterHiRes();
+			while (!queue_.empty() && queue_.front().dueTime <= now) {
+				due.push_back(queue_.front().message);
+				queue_.pop_front();
+			}
+			if (!queue_.empty()) {
+				waitMs = queue_.front().dueTime - now;
+			}
+		}
+		for (auto const &message : due) {
+			output_->sendMessageNow(message);
+			sent_++;
+		}
+		if (due.empty()) {
+			queueChanged_.wait(jmax(1, roundToInt(waitMs)));
+		}
+	}
+}
+
+String BCR2000Emulator::presetName(String const &bcl)
+{
+	StringArray lines;
+	lines.addLines(bcl);
+	for (auto const &line : lines) {
+		auto trimmed = line.trim();
+		if (trimmed.startsWithIgnoreCase(".name")) {
+			return trimmed.fromFirstOccurrenceOf("'", false, false).upToLastOccurrenceOf("'", false, false);
+		}
+	}
+	return String();
+}
+
+bool BCR2000Emulator::isEmulatorCommandLine(String const &commandLine)
+{
+	return StringArray::fromTokens(commandLine, true).contains(kEmulateFlag);
+}
+
+BCR2000Emulator::Options BCR2000Emulator::optionsFromCommandLine(String const &commandLine, File &presetDirectory)
+{
+	Options options;
+	auto tokens = StringArray::fromTokens(commandLine, true);
+	for (int i = 0; i + 1 < tokens.size(); i++) {
+		if (tokens[i] == "--latency") {
+			options.latencyMs = tokens[++i].getDoubleValue();
+		}
+		else if (tokens[i] == "--baud") {
+			options.baudRate = tokens[++i].getIntValue();
+		}
+		else if (tokens[i] == "--presets") {
+			presetDirectory = File::getCurrentWorkingDirectory().getChildFile(tokens[++i].unquoted());
+		}
+	}
+	return options;
+}
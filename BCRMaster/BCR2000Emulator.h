@@ -0,0 +1,91 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCLSyntax.h"
+
+#include <atomic>
+#include <deque>
+
+// Software stand-in for a BCR2000, registering a pair of virtual MIDI ports (ALSA on Linux, CoreMIDI on macOS).
+// It answers identity and preset name requests, serves dump requests from its 32 preset slots and accepts BCL uploads,
+// replying to each line with the device's error code. Latency and line speed are configurable, so it can
+// behave like the real 31250 baud link or run at full speed for benchmarks.
+//
+//   BCRMaster --emulate [--latency <ms>] [--baud <rate, 0 = unlimited>] [--presets <directory>]
+class BCR2000Emulator : public MidiInputCallback,
+	private Thread
+{
+public:
+	struct Options {
+		String portName = "BCR2000 Emulator";
+		double latencyMs = 2.0;
+		int baudRate = 31250;
+		uint8 deviceId = 0;
+	};
+
+	static const int kNumberOfPresets = 32;
+
+	BCR2000Emulator();
+	virtual ~BCR2000Emulator();
+
+	bool start(Options const &options);
+	void stop();
+
+	void setPreset(int slot, String const &bcl);
+	String preset(int slot) const;
+	void loadPresetsFromDirectory(File const &directory);
+
+	int messagesReceived() const;
+	int messagesSent() const;
+
+	static bool isEmulatorCommandLine(String const &commandLine);
+	static Options optionsFromCommandLine(String const &commandLine, File &presetDirectory);
+
+	// MidiInputCallback
+	void handleIncomingMidiMessage(MidiInput* source, const MidiMessage& message) override;
+
+private:
+	struct PendingMessage {
+		double dueTime;
+		MidiMessage message;
+	};
+
+	void run() override;
+
+	void handleBCL(int messageIndex, String const &line);
+	void sendIdentity();
+	void sendPresetName(int slot);
+	void sendDump(int slot);
+	void sendBCLLines(StringArray const &lines);
+	void reply(std::vector<uint8> const &payload);
+	double wireTimeMs(int numBytes) const;
+
+	static String presetName(String const &bcl);
+
+	Options options_;
+	std::unique_ptr<MidiInput> input_;
+	std::unique_ptr<MidiOutput> output_;
+
+	// Device state, only touched from the MIDI input callback and the preset setters
+	mutable CriticalSection stateLock_;
+	StringArray presets_;
+	StringArray upload_;
+	BCLSyntax::LineState state_;
+	int storeSlot_;
+	int received_;
+
+	// Outgoing queue, delivered by the emulator thread respecting latency and line speed
+	CriticalSection queueLock_;
+	std::deque<PendingMessage> queue_;
+	WaitableEvent queueChanged_;
+	double inputFreeAt_;
+	double outputFreeAt_;
+	std::atomic<int> sent_;
+};
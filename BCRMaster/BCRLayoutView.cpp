@@ -0,0 +1,224 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCRLayoutView.h"
+
+#include "Trace.h"
+
+namespace {
+	const int kFramesPerSecond = 30;
+	const int kMaxUpdatesPerMessage = 16;
+	const int kColumns = 9; // 8 controls per row, plus the column with the four buttons bottom right
+	const int kRows = 9; // 4 rows of push encoders (one per group), 2 rows of buttons, 3 rows of encoders
+	const int kNumPushEncoders = 32;
+	const int kFirstRowButton = 33;
+	const int kFirstCornerButton = 49;
+	const int kNumCornerButtons = 4;
+
+	const Colour kBackground(0xff1c1c1c);
+	const Colour kControl(0xff3a3a3a);
+	const Colour kUnmapped(0xff262626);
+	const Colour kValue(0xffff9a1f);
+}
+
+BCRLayoutView::BCRLayoutView(std::shared_ptr<midikraft::BCR2000> bcr) : bcr_(bcr), handle_(midikraft::MidiController::makeOneHandle()), map_(nullptr),
+	readers_(0), messagesMapped_(0), bounds_(ControllerMap::kNumControls), mappedControls_(0), lastStatusUpdate_(0.0), lastMessagesMapped_(0)
+{
+	// Everything is painted by us, so repainting a single control doesn't need the parent to paint first
+	setOpaque(true);
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleMessage(source, message);
+	});
+	startTimerHz(kFramesPerSecond);
+	setSize(900, 640);
+}
+
+BCRLayoutView::~BCRLayoutView()
+{
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+	stopTimer();
+}
+
+void BCRLayoutView::setDefinition(std::string const &bcl, String const &presetName)
+{
+	{
+		SpinLock::ScopedLockType lock(inputNameLock_);
+		inputName_ = String(bcr_->midiInput());
+	}
+	auto map = ControllerMap::fromBCL(bcl);
+	mappedControls_ = map->numberOfMappedControls();
+	map_.store(map.get());
+	if (current_) {
+		retired_.push_back(std::move(current_));
+	}
+	current_ = std::move(map);
+	freeRetiredMaps();
+	presetName_ = presetName;
+	values_.clear();
+	repaint();
+}
+
+void BCRLayoutView::handleMessage(MidiInput *source, MidiMessage const &message)
+{
+	// Called on the MIDI thread
+	if (source) {
+		SpinLock::ScopedLockType lock(inputNameLock_);
+		if (inputName_.isNotEmpty() && source->getName() != inputName_) {
+			return;
+		}
+	}
+	// Both sequentially consistent: once setDefinition has stored a new map and then sees no reader, nobody can still hold the old one
+	readers_++;
+	auto map = map_.load();
+	if (!map) {
+		readers_--;
+		return;
+	}
+	ControllerMap::Update updates[kMaxUpdatesPerMessage];
+	int count = map->process(message, nrpn_, updates, kMaxUpdatesPerMessage);
+	readers_--;
+	for (int i = 0; i < count; i++) {
+		values_.set(updates[i].control, updates[i].position);
+	}
+	if (count > 0) {
+		messagesMapped_++;
+	}
+}
+
+void BCRLayoutView::freeRetiredMaps()
+{
+	if (!retired_.empty() && readers_.load() == 0) {
+		retired_.clear();
+	}
+}
+
+void BCRLayoutView::timerCallback()
+{
+	freeRetiredMaps();
+	auto startTicks = Trace::now();
+	int repainted = 0;
+	for (int word = 0; word < ControllerValues::kNumWords; word++) {
+		auto dirty = values_.takeDirty(word);
+		for (int bit = 0; dirty != 0; bit++, dirty >>= 1) {
+			if ((dirty & 1) && !bounds_[word * 64 + bit].isEmpty()) {
+				repaint(bounds_[word * 64 + bit]);
+				repainted++;
+			}
+		}
+	}
+	if (repainted > 0) {
+		Trace::record("layoutView.frame", startTicks, Trace::now());
+	}
+
+	double now = Time::getMillisecondCounterHiRes();
+	if (now - lastStatusUpdate_ >= 1000.0) {
+		int mapped = messagesMapped_.load();
+		auto rate = String(static_cast<int>((mapped - lastMessagesMapped_) * 1000.0 / (now - lastStatusUpdate_))) + " messages/s";
+		if (rate != rate_) {
+			rate_ = rate;
+			repaint(statusArea_);
+		}
+		lastMessagesMapped_ = mapped;
+		lastStatusUpdate_ = now;
+	}
+}
+
+void BCRLayoutView::resized()
+{
+	for (auto &bounds : bounds_) {
+		bounds = Rectangle<int>();
+	}
+
+	auto area = getLocalBounds().reduced(8);
+	statusArea_ = area.removeFromBottom(20);
+	int cellWidth = area.getWidth() / kColumns;
+	int cellHeight = area.getHeight() / kRows;
+	auto cell = [&](int row, int column) {
+		return Rectangle<int>(area.getX() + column * cellWidth, area.getY() + row * cellHeight, cellWidth, cellHeight);
+	};
+	auto encoder = [](Rectangle<int> const &cellBounds) {
+		int size = jmin(cellBounds.getWidth(), cellBounds.getHeight()) - 6;
+		return cellBounds.withSizeKeepingCentre(size, size);
+	};
+
+	for (int i = 0; i < kNumPushEncoders; i++) {
+		// The push function of the top encoders is shown in the encoder itself
+		auto bounds = encoder(cell(i / 8, i % 8));
+		bounds_[ControllerMap::encoderIndex(i + 1)] = bounds;
+		bounds_[ControllerMap::buttonIndex(i + 1)] = bounds;
+	}
+	for (int i = 0; i < 16; i++) {
+		bounds_[ControllerMap::buttonIndex(kFirstRowButton + i)] = cell(4 + i / 8, i % 8).reduced(6, cellHeight / 4);
+	}
+	for (int i = kNumPushEncoders; i < ControllerMap::kNumEncoders; i++) {
+		int lower = i - kNumPushEncoders;
+		bounds_[ControllerMap::encoderIndex(i + 1)] = encoder(cell(6 + lower / 8, lower % 8));
+	}
+	auto corner = cell(6, 8).withBottom(cell(8, 8).getBottom());
+	int cornerHeight = corner.getHeight() / kNumCornerButtons;
+	for (int i = 0; i < kNumCornerButtons; i++) {
+		bounds_[ControllerMap::buttonIndex(kFirstCornerButton + i)] = corner.removeFromTop(cornerHeight).reduced(6, cornerHeight / 4);
+	}
+}
+
+void BCRLayoutView::paint(Graphics &g)
+{
+	g.fillAll(kBackground);
+	for (int control = 0; control < ControllerMap::kNumControls; control++) {
+		// The push encoder buttons are painted with their encoder
+		if (ControllerMap::isButton(control) && control < ControllerMap::buttonIndex(kNumPushEncoders + 1)) {
+			continue;
+		}
+		if (!bounds_[control].isEmpty() && g.clipRegionIntersects(bounds_[control])) {
+			paintControl(g, control);
+		}
+	}
+	if (g.clipRegionIntersects(statusArea_)) {
+		g.setColour(Colours::lightgrey);
+		String status = presetName_.isEmpty() ? "No preset loaded" : presetName_ + ": " + String(mappedControls_) + " controls mapped";
+		g.drawText(status + ", " + rate_, statusArea_, Justification::centredLeft);
+	}
+}
+
+void BCRLayoutView::paintControl(Graphics &g, int control)
+{
+	auto map = map_.load();
+	bool mapped = map && map->isMapped(control);
+	auto bounds = bounds_[control].toFloat();
+	float position = values_.position(control) / static_cast<float>(ControllerMap::kFullScale);
+
+	if (ControllerMap::isButton(control)) {
+		g.setColour(mapped ? (position > 0.5f ? kValue : kControl) : kUnmapped);
+		g.fillRoundedRectangle(bounds, 3.0f);
+		return;
+	}
+
+	float radius = bounds.getWidth() * 0.5f;
+	auto centre = bounds.getCentre();
+	g.setColour(mapped ? kControl : kUnmapped);
+	g.fillEllipse(bounds.reduced(4.0f));
+	if (!mapped) {
+		return;
+	}
+
+	// Value ring like the LEDs around the BCR2000's encoders
+	const float start = -MathConstants<float>::pi * 0.75f;
+	const float range = MathConstants<float>::pi * 1.5f;
+	Path ring;
+	ring.addCentredArc(centre.x, centre.y, radius - 2.0f, radius - 2.0f, 0.0f, start, start + range * position, true);
+	g.setColour(kValue);
+	g.strokePath(ring, PathStrokeType(3.0f));
+
+	int number = control + 1;
+	if (number <= kNumPushEncoders) {
+		auto push = values_.position(ControllerMap::buttonIndex(number));
+		if (map->isMapped(ControllerMap::buttonIndex(number)) && push > ControllerMap::kFullScale / 2) {
+			g.fillEllipse(bounds.withSizeKeepingCentre(radius * 0.6f, radius * 0.6f));
+		}
+	}
+	g.setColour(Colours::lightgrey);
+	g.drawText(String(number), bounds.toNearestInt(), Justification::centred);
+}
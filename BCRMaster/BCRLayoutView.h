@@ -0,0 +1,59 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+#include "ControllerMap.h"
+
+// Picture of the BCR2000's encoders and buttons that follows what the device sends, for monitoring a preset live.
+// Incoming messages are mapped to controls on the MIDI thread and only stored in a ControllerValues array.
+// A timer running at a capped frame rate collects the controls that moved and repaints just their bounds, so
+// a fast sweep over all controls costs the message thread one small repaint per control and frame at most.
+class BCRLayoutView : public Component, private Timer {
+public:
+	explicit BCRLayoutView(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~BCRLayoutView();
+
+	// Takes the element definitions from this BCL text, call again when another preset is active on the device
+	void setDefinition(std::string const &bcl, String const &presetName);
+
+	void paint(Graphics &g) override;
+	void resized() override;
+
+private:
+	void handleMessage(MidiInput *source, MidiMessage const &message);
+	void timerCallback() override;
+	void freeRetiredMaps();
+	void paintControl(Graphics &g, int control);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	midikraft::MidiController::HandlerHandle handle_;
+
+	// The MIDI thread only ever reads the current map, and counts itself in readers_ while it does.
+	// Replaced maps are retired and freed by the timer once no handler is running, a handler starting later sees the new map.
+	std::atomic<ControllerMap const *> map_;
+	std::unique_ptr<ControllerMap> current_;
+	std::vector<std::unique_ptr<ControllerMap>> retired_;
+	std::atomic<int> readers_;
+	ControllerMap::NrpnState nrpn_; // Only used on the MIDI thread
+	ControllerValues values_;
+	SpinLock inputNameLock_;
+	String inputName_;
+	std::atomic<int> messagesMapped_;
+
+	std::vector<Rectangle<int>> bounds_;
+	Rectangle<int> statusArea_;
+	String presetName_;
+	int mappedControls_;
+	double lastStatusUpdate_;
+	int lastMessagesMapped_;
+	String rate_;
+};
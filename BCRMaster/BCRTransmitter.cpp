@@ -0,0 +1,316 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BCRTransmitter.h"
+
+#include "BCLDecoder.h"
+#include "BCLSyntax.h"
+#include "Trace.h"
+
+namespace {
+	// Layout of the messages without F0/F7: 00 20 32 <device> <model> <command> <index msb> <index lsb> ...
+	const int kCommandOffset = 5;
+	const int kIndexOffset = 6;
+	const int kErrorCodeOffset = 8;
+	const uint8 kBCLReplyCommand = 0x21;
+
+	const double kProgressIntervalMs = 50.0;
+}
+
+String BCRTransmitter::Statistics::toString() const
+{
+	return String(messagesAcknowledged) + "/" + String(messagesTotal) + " messages, "
+		+ String(messagesPerSecond, 1) + " msg/s, " + String(bytesPerSecond / 1024.0, 1) + " kB/s, "
+		+ "rtt " + String(roundTripMs, 1) + " ms, gap " + String(gapMs, 1) + " ms, window " + String(window, 1)
+		+ (lateReplies > 0 ? ", " + String(lateReplies) + " late replies" : String());
+}
+
+BCRTransmitter::BCRTransmitter(std::shared_ptr<midikraft::BCR2000> bcr) : Thread("BCRTransmitter"),
+	bcr_(bcr), handle_(midikraft::MidiController::makeOneHandle()), receiving_(false), base_(0), next_(0), window_(1.0), smoothedRtt_(0.0), gapMs_(0.0),
+	startTime_(0.0), lastProgress_(0.0), aborted_(false), uploadGeneration_(0)
+{
+	// Registered once for the lifetime, so adding and removing the handler both happen on the owning thread
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleReply(source, message);
+	});
+}
+
+BCRTransmitter::~BCRTransmitter()
+{
+	stop();
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+}
+
+void BCRTransmitter::setOptions(Options const &options)
+{
+	if (!isThreadRunning()) {
+		options_ = options;
+	}
+}
+
+bool BCRTransmitter::send(std::vector<MidiMessage> const &messages, TProgressHandler progressHandler, TFinishedHandler finishedHandler)
+{
+	if (isThreadRunning()) {
+		return false;
+	}
+	messages_ = messages;
+	progressHandler_ = progressHandler;
+	finishedHandler_ = finishedHandler;
+	{
+		ScopedLock lock(replyLock_);
+		inputName_ = String(bcr_->midiInput());
+		replies_.clear();
+		receiving_ = true;
+	}
+	{
+		ScopedLock lock(statisticsLock_);
+		statistics_ = Statistics();
+		statistics_.messagesTotal = static_cast<int>(messages.size());
+	}
+	uploadGeneration_++;
+	startThread();
+	return true;
+}
+
+void BCRTransmitter::abort()
+{
+	signalThreadShouldExit();
+	wakeUp_.signal();
+}
+
+void BCRTransmitter::stop()
+{
+	// The thread might be waiting for a reply, wake it up to see that it should exit
+	abort();
+	stopThread(2000);
+}
+
+bool BCRTransmitter::isBusy() const
+{
+	return isThreadRunning();
+}
+
+int BCRTransmitter::uploadGeneration() const
+{
+	return uploadGeneration_.load();
+}
+
+BCRTransmitter::Statistics BCRTransmitter::statistics() const
+{
+	ScopedLock lock(statisticsLock_);
+	return statistics_;
+}
+
+void BCRTransmitter::handleReply(MidiInput *source, MidiMessage const &message)
+{
+	Trace::Span span("BCLReply.handle");
+	if (!midikraft::BCR2000::isSysexFromBCR2000(message) || message.getSysExDataSize() <= kErrorCodeOffset) {
+		return;
+	}
+	auto data = message.getSysExData();
+	if (data[kCommandOffset] != kBCLReplyCommand) {
+		return;
+	}
+	Reply reply;
+	reply.messageIndex = (data[kIndexOffset] << 7) | data[kIndexOffset + 1];
+	reply.errorCode = data[kErrorCodeOffset];
+	{
+		ScopedLock lock(replyLock_);
+		if (!receiving_ || (source && inputName_.isNotEmpty() && source->getName() != inputName_)) {
+			return;
+		}
+		replies_.push_back(reply);
+	}
+	wakeUp_.signal();
+}
+
+void BCRTransmitter::run()
+{
+	int total = static_cast<int>(messages_.size());
+	sendTimes_.assign(messages_.size(), 0.0);
+	sendTicks_.assign(messages_.size(), 0);
+	barriers_.resize(messages_.size());
+	for (size_t i = 0; i < messages_.size(); i++) {
+		barriers_[i] = isBarrier(messages_[i]);
+	}
+	errors_.clear();
+	base_ = 0;
+	next_ = 0;
+	window_ = 1.0;
+	smoothedRtt_ = 0.0;
+	gapMs_ = options_.minGapMs;
+	aborted_ = false;
+	startTime_ = Time::getMillisecondCounterHiRes();
+	lastProgress_ = startTime_;
+	double nextSendTime = startTime_;
+	int lateBase = -1;
+
+	while (base_ < total && !aborted_) {
+		if (threadShouldExit()) {
+			addError(base_, 0, "Transmission aborted");
+			break;
+		}
+		double now = Time::getMillisecondCounterHiRes();
+		if (processReplies(now)) {
+			updateStatistics(now);
+		}
+
+		// The oldest message in flight is late. A late reply is no lost message, so nothing is sent again - the window closes
+		// until the reply arrives, and only when none arrives at all the transmission is given up
+		double timeoutMs = jmax(options_.minTimeoutMs, 4.0 * smoothedRtt_);
+		double giveUpMs = jmax(timeoutMs, options_.replyTimeoutMs);
+		bool late = base_ < next_ && now - sendTimes_[base_] > timeoutMs;
+		if (late) {
+			if (now - sendTimes_[base_] > giveUpMs) {
+				addError(base_, 0, "No reply from BCR2000 after " + String(roundToInt(now - sendTimes_[base_])) + " ms");
+				break;
+			}
+			if (lateBase != base_) {
+				lateBase = base_;
+				{
+					ScopedLock lock(statisticsLock_);
+					statistics_.lateReplies++;
+				}
+				window_ = 1.0;
+				gapMs_ = jlimit(options_.minGapMs, options_.maxGapMs, jmax(1.0, gapMs_ * 2.0));
+			}
+		}
+
+		// Send as much as the window and the pacing allow
+		while (!late && next_ < total && next_ - base_ < static_cast<int>(window_) && now >= nextSendTime) {
+			// Before and after $end and $store, everything sent must be acknowledged
+			bool barrier = barriers_[next_] || (next_ > 0 && barriers_[next_ - 1]);
+			if (barrier && base_ != next_) {
+				break;
+			}
+			sendMessage(next_++, now);
+			nextSendTime = now + gapMs_;
+			if (gapMs_ > 0.0) {
+				break;
+			}
+		}
+
+		double waitMs = base_ < next_ ? jmax(1.0, sendTimes_[base_] + (late ? giveUpMs : timeoutMs) - now) : 1.0;
+		if (!late && next_ < total && next_ - base_ < static_cast<int>(window_)) {
+			waitMs = jmin(waitMs, jmax(0.0, nextSendTime - now));
+		}
+		if (waitMs > 0.0) {
+			wakeUp_.wait(jmax(1, roundToInt(waitMs)));
+		}
+	}
+
+	{
+		ScopedLock lock(replyLock_);
+		receiving_ = false;
+	}
+	updateStatistics(Time::getMillisecondCounterHiRes());
+	if (finishedHandler_) {
+		finishedHandler_(errors_, aborted_, statistics());
+	}
+}
+
+bool BCRTransmitter::processReplies(double now)
+{
+	std::vector<Reply> replies;
+	{
+		ScopedLock lock(replyLock_);
+		replies.swap(replies_);
+	}
+	bool progress = false;
+	for (auto const &reply : replies) {
+		// The device answers in order, anything not matching the oldest message in flight belongs to a transmission before this one
+		if (base_ >= next_ || reply.messageIndex != messageIndex(messages_[base_])) {
+			continue;
+		}
+		double rtt = now - sendTimes_[base_];
+		Trace::record("BCLReply.roundTrip", sendTicks_[base_], Trace::now());
+		smoothedRtt_ = smoothedRtt_ == 0.0 ? rtt : 0.875 * smoothedRtt_ + 0.125 * rtt;
+		if (reply.errorCode != 0) {
+			addError(base_, reply.errorCode, BCLSyntax::errorDescription(reply.errorCode));
+		}
+		{
+			ScopedLock lock(statisticsLock_);
+			statistics_.messagesAcknowledged++;
+			statistics_.bytesAcknowledged += messages_[base_].getRawDataSize();
+		}
+		base_++;
+		// Additive increase of the window, and spread the window over one round trip
+		window_ = jmin(static_cast<double>(options_.maxWindow), window_ + 1.0 / window_);
+		gapMs_ = jlimit(options_.minGapMs, options_.maxGapMs, smoothedRtt_ / window_);
+		progress = true;
+	}
+	return progress;
+}
+
+void BCRTransmitter::sendMessage(int position, double now)
+{
+	Trace::Span span("sendSysExToBCR");
+	sendTimes_[position] = now;
+	sendTicks_[position] = Trace::now();
+	auto output = midikraft::MidiController::instance()->getMidiOutput(bcr_->midiOutput());
+	if (output) {
+		output->sendMessageNow(messages_[position]);
+	}
+}
+
+void BCRTransmitter::addError(int position, int errorCode, String const &description)
+{
+	midikraft::BCR2000::BCRError error;
+	error.errorCode = errorCode;
+	error.lineNumber = position + 1;
+	error.errorText = description.toStdString();
+	if (position < static_cast<int>(messages_.size())) {
+		size_t length;
+		auto text = BCLDecoder::bclText(messages_[position], length);
+		error.lineText = text ? std::string(text, length) : std::string();
+	}
+	errors_.push_back(error);
+	if (errorCode == 0) {
+		// Errors not reported by the device end the transmission
+		aborted_ = true;
+	}
+}
+
+void BCRTransmitter::updateStatistics(double now)
+{
+	Statistics current;
+	{
+		ScopedLock lock(statisticsLock_);
+		statistics_.elapsedSeconds = (now - startTime_) / 1000.0;
+		if (statistics_.elapsedSeconds > 0.0) {
+			statistics_.messagesPerSecond = statistics_.messagesAcknowledged / statistics_.elapsedSeconds;
+			statistics_.bytesPerSecond = statistics_.bytesAcknowledged / statistics_.elapsedSeconds;
+		}
+		statistics_.roundTripMs = smoothedRtt_;
+		statistics_.gapMs = gapMs_;
+		statistics_.window = window_;
+		current = statistics_;
+	}
+	if (progressHandler_ && (now - lastProgress_ >= kProgressIntervalMs || base_ == static_cast<int>(messages_.size()))) {
+		lastProgress_ = now;
+		progressHandler_(current);
+	}
+}
+
+bool BCRTransmitter::isBarrier(MidiMessage const &message)
+{
+	size_t length;
+	auto text = BCLDecoder::bclText(message, length);
+	if (!text) {
+		return false;
+	}
+	String line = String(text, length).trim().toLowerCase();
+	return line.startsWith("$end") || line.startsWith("$store");
+}
+
+int BCRTransmitter::messageIndex(MidiMessage const &message)
+{
+	if (message.getSysExDataSize() <= kIndexOffset + 1) {
+		return -1;
+	}
+	auto data = message.getSysExData();
+	return (data[kIndexOffset] << 7) | data[kIndexOffset + 1];
+}
@@ -0,0 +1,117 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+#include <atomic>
+
+// Sends BCL sysex to a BCR2000 using its reply to every message as acknowledgement.
+// A bounded window of messages is kept in flight, the gap between messages follows the measured round trip time.
+// Messages are never sent twice, as executing a line again is not the same as executing it once: when a reply is late,
+// nothing more is sent until it arrives, and the transmission is aborted if it doesn't arrive at all.
+// $end and $store wait for everything before them to be acknowledged, and the messages after them wait for their own
+// acknowledgement, as the device is busy storing then.
+class BCRTransmitter : private Thread {
+public:
+	struct Options {
+		int maxWindow = 8;
+		double minGapMs = 0.0;
+		double maxGapMs = 50.0;
+		double minTimeoutMs = 500.0; // A reply later than this and four round trips closes the window
+		double replyTimeoutMs = 5000.0; // Without a reply for this long, the transmission is aborted
+	};
+
+	struct Statistics {
+		int messagesTotal = 0;
+		int messagesAcknowledged = 0;
+		int lateReplies = 0;
+		int64 bytesAcknowledged = 0;
+		double elapsedSeconds = 0.0;
+		double messagesPerSecond = 0.0;
+		double bytesPerSecond = 0.0;
+		double roundTripMs = 0.0;
+		double gapMs = 0.0;
+		double window = 1.0;
+
+		String toString() const;
+	};
+
+	// The progress handler is called from the transmitter thread at most every 50 ms, the finished handler once from the transmitter thread.
+	// Construct and destroy the transmitter on the message thread, it listens to MIDI input for its whole lifetime
+	typedef std::function<void(Statistics const &)> TProgressHandler;
+	typedef std::function<void(std::vector<midikraft::BCR2000::BCRError> const &errors, bool aborted, Statistics const &statistics)> TFinishedHandler;
+
+	explicit BCRTransmitter(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~BCRTransmitter();
+
+	// Only takes effect with the next transmission
+	void setOptions(Options const &options);
+
+	// Returns false if a transmission is still running. Error line numbers are one-based positions in the messages given.
+	bool send(std::vector<MidiMessage> const &messages, TProgressHandler progressHandler, TFinishedHandler finishedHandler);
+	void abort();
+	// Aborts and waits for the transmitter thread to end, so none of the handlers is called anymore
+	void stop();
+	bool isBusy() const;
+	// Counts the transmissions started, i.e. every send that returned true. Whoever sent last can tell from it whether
+	// the device still holds what it sent, no matter who else uploaded to the device through this transmitter meanwhile.
+	int uploadGeneration() const;
+
+	Statistics statistics() const;
+
+private:
+	struct Reply {
+		int messageIndex;
+		int errorCode;
+	};
+
+	void run() override;
+	void handleReply(MidiInput *source, MidiMessage const &message);
+	bool processReplies(double now);
+	void sendMessage(int position, double now);
+	void addError(int position, int errorCode, String const &description);
+	void updateStatistics(double now);
+
+	static bool isBarrier(MidiMessage const &message);
+	static int messageIndex(MidiMessage const &message);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	Options options_;
+	midikraft::MidiController::HandlerHandle handle_;
+
+	// Shared with the MIDI thread
+	CriticalSection replyLock_;
+	String inputName_;
+	bool receiving_;
+	std::vector<Reply> replies_;
+	WaitableEvent wakeUp_;
+
+	// Only used by the transmitter thread while running
+	std::vector<MidiMessage> messages_;
+	std::vector<double> sendTimes_;
+	std::vector<int64> sendTicks_;
+	std::vector<bool> barriers_;
+	std::vector<midikraft::BCR2000::BCRError> errors_;
+	int base_;
+	int next_;
+	double window_;
+	double smoothedRtt_;
+	double gapMs_;
+	double startTime_;
+	double lastProgress_;
+	bool aborted_;
+	std::atomic<int> uploadGeneration_;
+	TProgressHandler progressHandler_;
+	TFinishedHandler finishedHandler_;
+
+	mutable CriticalSection statisticsLock_;
+	Statistics statistics_;
+};
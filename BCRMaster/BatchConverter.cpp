@@ -0,0 +1,316 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "BatchConverter.h"
+
+#include "BCLDecoder.h"
+#include "Trace.h"
+
+#include "Sysex.h"
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#include <cstdio>
+#endif
+
+namespace {
+
+	const char *kConvertFlag = "--convert";
+	const char *kOutputFlag = "--out";
+	const char *kJobsFlag = "--jobs";
+
+}
+
+class BatchConverter::ConversionJob : public ThreadPoolJob {
+public:
+	ConversionJob(BatchConverter &converter, File const &input, File const &outputDirectory) : ThreadPoolJob(input.getFileName()),
+		converter_(converter), input_(input), outputDirectory_(outputDirectory), failed_(false)
+	{
+	}
+
+	JobStatus runJob() override {
+		// Every job converts with its own BCR2000, they run side by side
+		midikraft::BCR2000 bcr;
+		auto result = convertFile(input_, outputDirectory_, bcr);
+		failed_ = !result.success;
+		converter_.reportResult(result);
+		converter_.jobFinished();
+		return jobHasFinished;
+	}
+
+	bool failed() const { return failed_; }
+
+private:
+	BatchConverter &converter_;
+	File input_;
+	File outputDirectory_;
+	bool failed_;
+};
+
+BatchConverter::BatchConverter(int numThreads) : numThreads_(numThreads > 0 ? numThreads : SystemStats::getNumCpus()), remainingJobs_(0)
+{
+}
+
+int BatchConverter::convert(Array<File> const &inputs, File const &outputDirectory)
+{
+	if (outputDirectory != File() && !outputDirectory.isDirectory()) {
+		outputDirectory.createDirectory();
+	}
+
+	int64 bytesIn = 0;
+	for (auto const &input : inputs) {
+		bytesIn += input.getSize();
+	}
+
+	// Two inputs with the same output, like foo.bcl and foo.syx or two foo.bcl flattened into --out, would overwrite each other
+	int failures = 0;
+	std::map<String, Array<File>> inputsOfOutput;
+	StringArray inputPaths;
+	for (auto const &input : inputs) {
+		inputsOfOutput[outputFile(input, outputDirectory).getFullPathName()].add(input);
+		inputPaths.add(input.getFullPathName());
+	}
+	Array<File> convertible;
+	for (auto const &input : inputs) {
+		auto output = outputFile(input, outputDirectory);
+		if (output == File()) {
+			// Unsupported, convertFile tells
+			convertible.add(input);
+			continue;
+		}
+		auto const &sameOutput = inputsOfOutput[output.getFullPathName()];
+		Result collision{ input, output, false, {}, input.getSize(), 0, 0.0 };
+		if (sameOutput.size() > 1) {
+			collision.errorMessage = "output " + output.getFullPathName() + " would also be written from " + sameOutput[sameOutput[0] == input ? 1 : 0].getFullPathName();
+		}
+		else if (inputPaths.contains(output.getFullPathName())) {
+			collision.errorMessage = "output would overwrite the input " + output.getFullPathName();
+		}
+		else {
+			convertible.add(input);
+			continue;
+		}
+		reportResult(collision);
+		failures++;
+	}
+
+	double startTime = Time::getMillisecondCounterHiRes();
+	OwnedArray<ConversionJob> jobs;
+	if (!convertible.isEmpty()) {
+		ThreadPool pool(numThreads_);
+		remainingJobs_ = convertible.size();
+		allJobsDone_.reset();
+		for (auto const &input : convertible) {
+			auto job = jobs.add(new ConversionJob(*this, input, outputDirectory));
+			pool.addJob(job, false);
+		}
+		// Don't let the pool destructor interrupt running jobs, wait until all are done
+		allJobsDone_.wait();
+	}
+	double seconds = (Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+
+	for (auto job : jobs) {
+		if (job->failed()) failures++;
+	}
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< "Converted " << (inputs.size() - failures) << " of " << inputs.size() << " files using " << numThreads_ << " threads in " << seconds << " s";
+	if (seconds > 0.0) {
+		std::cout << " (" << (inputs.size() / seconds) << " files/s, " << (bytesIn / (1024.0 * 1024.0) / seconds) << " MB/s)";
+	}
+	std::cout << std::endl;
+	return failures;
+}
+
+File BatchConverter::outputFile(File const &input, File const &outputDirectory)
+{
+	File targetDirectory = outputDirectory == File() ? input.getParentDirectory() : outputDirectory;
+	if (isSyxFile(input)) {
+		return targetDirectory.getChildFile(input.getFileNameWithoutExtension() + ".bcl");
+	}
+	if (isTextFile(input)) {
+		return targetDirectory.getChildFile(input.getFileNameWithoutExtension() + ".syx");
+	}
+	return {};
+}
+
+BatchConverter::Result BatchConverter::convertFile(File const &input, File const &outputDirectory, midikraft::BCR2000 &converter)
+{
+	Result result;
+	result.input = input;
+	result.output = outputFile(input, outputDirectory);
+	result.success = false;
+	result.bytesIn = input.getSize();
+	result.bytesOut = 0;
+
+	double startTime = Time::getMillisecondCounterHiRes();
+	if (result.output == File()) {
+		result.errorMessage = "unsupported file type";
+		result.milliseconds = Time::getMillisecondCounterHiRes() - startTime;
+		return result;
+	}
+	// Written next to the target and moved over it when complete, a failed conversion leaves the previous output alone
+	TemporaryFile temp(result.output);
+	if (isSyxFile(input)) {
+		SyxScanner scanner(input);
+		std::unique_ptr<FileOutputStream> out(temp.getFile().createOutputStream());
+		if (!scanner.openedOk()) {
+			result.errorMessage = "could not read input file";
+		}
+		else if (out && out->openedOk()) {
+			// Stream the decoded lines from the mapped input straight into the file
+			int lines = 0;
+			BCLDecoder::decode(scanner, [&out, &lines](const char *text, size_t length) {
+				out->write(text, length);
+				out->writeByte('\n');
+				lines++;
+			});
+			out->flush();
+			bool written = out->getStatus().wasOk();
+			out = nullptr;
+			if (lines == 0) {
+				result.errorMessage = "no BCR2000 sysex messages found";
+			}
+			else if (!written || !temp.overwriteTargetFileWithTemporary()) {
+				result.errorMessage = "could not write output file";
+			}
+			else {
+				result.success = true;
+			}
+		}
+		else {
+			result.errorMessage = "could not write output file";
+		}
+	}
+	else if (isTextFile(input)) {
+		std::vector<MidiMessage> messages;
+		{
+			Trace::Span span("convertToSyx");
+			messages = converter.convertToSyx(input.loadFileAsString().toStdString(), true);
+		}
+		if (messages.empty()) {
+			result.errorMessage = "no BCL content found";
+		}
+		else {
+			Sysex::saveSysex(temp.getFile().getFullPathName().toStdString(), messages);
+			result.success = temp.getFile().existsAsFile() && temp.overwriteTargetFileWithTemporary();
+			if (!result.success) {
+				result.errorMessage = "could not write output file";
+			}
+		}
+	}
+	result.milliseconds = Time::getMillisecondCounterHiRes() - startTime;
+	if (result.success) {
+		result.bytesOut = result.output.getSize();
+	}
+	return result;
+}
+
+void BatchConverter::reportResult(Result const &result)
+{
+	ScopedLock lock(outputLock_);
+	if (result.success) {
+		std::cout << "OK     " << std::fixed << std::setprecision(1) << std::setw(8) << result.milliseconds << " ms  "
+			<< result.input.getFullPathName() << " -> " << result.output.getFullPathName() << std::endl;
+	}
+	else {
+		std::cerr << "FAILED " << std::fixed << std::setprecision(1) << std::setw(8) << result.milliseconds << " ms  "
+			<< result.input.getFullPathName() << ": " << result.errorMessage << std::endl;
+	}
+}
+
+void BatchConverter::jobFinished()
+{
+	if (--remainingJobs_ == 0) {
+		allJobsDone_.signal();
+	}
+}
+
+bool BatchConverter::isBatchCommandLine(String const &commandLine)
+{
+	return StringArray::fromTokens(commandLine, true).contains(kConvertFlag);
+}
+
+void BatchConverter::attachConsole()
+{
+#if JUCE_WINDOWS
+	// We are built as a GUI application, so there is no console to print to unless we borrow the one we were started from
+	if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		FILE *ignored;
+		freopen_s(&ignored, "CONOUT$", "w", stdout);
+		freopen_s(&ignored, "CONOUT$", "w", stderr);
+	}
+#endif
+}
+
+int BatchConverter::runFromCommandLine(String const &commandLine)
+{
+	attachConsole();
+
+	auto tokens = StringArray::fromTokens(commandLine, true);
+	File outputDirectory;
+	int numThreads = 0;
+	StringArray paths;
+	for (int i = 0; i < tokens.size(); i++) {
+		auto token = tokens[i].unquoted();
+		if (token == kConvertFlag || token.isEmpty()) {
+			continue;
+		}
+		else if (token == kOutputFlag && i + 1 < tokens.size()) {
+			outputDirectory = File::getCurrentWorkingDirectory().getChildFile(tokens[++i].unquoted());
+		}
+		else if (token == kJobsFlag && i + 1 < tokens.size()) {
+			numThreads = tokens[++i].getIntValue();
+		}
+		else {
+			paths.add(token);
+		}
+	}
+
+	auto inputs = expandInputs(paths);
+	if (inputs.isEmpty()) {
+		std::cerr << "Usage: BCRMaster --convert [--out <directory>] [--jobs <n>] <file or directory> ..." << std::endl;
+		return 1;
+	}
+
+	BatchConverter converter(numThreads);
+	return converter.convert(inputs, outputDirectory) == 0 ? 0 : 2;
+}
+
+Array<File> BatchConverter::expandInputs(StringArray const &paths)
+{
+	Array<File> result;
+	for (auto const &path : paths) {
+		File file = File::getCurrentWorkingDirectory().getChildFile(path);
+		if (file.isDirectory()) {
+			auto children = file.findChildFiles(File::findFiles, false, "*.bcl;*.bcr;*.syx");
+			children.sort();
+			result.addArray(children);
+		}
+		else if (file.existsAsFile()) {
+			result.add(file);
+		}
+		else {
+			std::cerr << "Skipping " << path << ": no such file or directory" << std::endl;
+		}
+	}
+	return result;
+}
+
+bool BatchConverter::isTextFile(File const &file)
+{
+	auto extension = file.getFileExtension().toLowerCase();
+	return extension == ".bcl" || extension == ".bcr";
+}
+
+bool BatchConverter::isSyxFile(File const &file)
+{
+	return file.getFileExtension().toLowerCase() == ".syx";
+}
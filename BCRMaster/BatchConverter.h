@@ -0,0 +1,60 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+#include <atomic>
+
+// Headless converter between BCL text files and BCR2000 sysex files, run from the command line instead of the main window:
+//
+//   BCRMaster --convert [--out <directory>] [--jobs <n>] <file or directory> ...
+//
+// .bcl/.bcr files are converted to .syx, .syx files to .bcl. Files are spread over a pool of worker threads, each job with its own
+// converter. Outputs are written to a temporary file that replaces the target when complete. Inputs that would write the same output,
+// or overwrite another input, are not converted at all.
+class BatchConverter {
+public:
+	struct Result {
+		File input;
+		File output;
+		bool success;
+		String errorMessage;
+		int64 bytesIn;
+		int64 bytesOut;
+		double milliseconds;
+	};
+
+	explicit BatchConverter(int numThreads);
+
+	// Returns the number of files that could not be converted
+	int convert(Array<File> const &inputs, File const &outputDirectory);
+
+	// Command line entry points used by the application before any window is created
+	static bool isBatchCommandLine(String const &commandLine);
+	static int runFromCommandLine(String const &commandLine);
+	static void attachConsole();
+
+	static Array<File> expandInputs(StringArray const &paths);
+	static bool isTextFile(File const &file);
+	static bool isSyxFile(File const &file);
+
+private:
+	class ConversionJob;
+
+	static File outputFile(File const &input, File const &outputDirectory);
+	static Result convertFile(File const &input, File const &outputDirectory, midikraft::BCR2000 &converter);
+	void reportResult(Result const &result);
+	void jobFinished();
+
+	int numThreads_;
+	CriticalSection outputLock_;
+	std::atomic<int> remainingJobs_;
+	WaitableEvent allJobsDone_;
+};
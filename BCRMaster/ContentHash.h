@@ -0,0 +1,41 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// 64 bit FNV-1a fingerprint, used to recognize identical preset content. Not meant to be cryptographically secure.
+class ContentHash {
+public:
+	ContentHash() : hash_(0xcbf29ce484222325ULL) {}
+
+	void add(const void *data, size_t numBytes) {
+		auto bytes = static_cast<const uint8 *>(data);
+		for (size_t i = 0; i < numBytes; i++) {
+			hash_ ^= bytes[i];
+			hash_ *= 0x100000001b3ULL;
+		}
+	}
+
+	void add(MidiMessage const &message) {
+		add(message.getRawData(), static_cast<size_t>(message.getRawDataSize()));
+	}
+
+	uint64 value() const { return hash_; }
+	String toString() const { return String::toHexString(static_cast<int64>(hash_)).paddedLeft('0', 16); }
+
+	static ContentHash of(std::vector<MidiMessage> const &messages) {
+		ContentHash result;
+		for (auto const &message : messages) {
+			result.add(message);
+		}
+		return result;
+	}
+
+private:
+	uint64 hash_;
+};
@@ -0,0 +1,478 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "ControllerMap.h"
+
+#include "BCLDelta.h"
+
+#include <algorithm>
+
+namespace {
+	const int kNoValue = -100000;
+
+	// Accepts decimal, negative and $hex numbers as written in BCL, returns kNoValue if the text is no number
+	int parseNumber(std::string const &text) {
+		size_t start = 0;
+		int base = 10;
+		bool negative = false;
+		if (text.size() > 1 && text[0] == '$') {
+			start = 1;
+			base = 16;
+		}
+		else if (text.size() > 1 && text[0] == '-') {
+			start = 1;
+			negative = true;
+		}
+		if (start >= text.size()) return kNoValue;
+		int result = 0;
+		for (size_t i = start; i < text.size(); i++) {
+			int digit = CharacterFunctions::getHexDigitValue(static_cast<juce_wchar>(text[i]));
+			if (digit < 0 || digit >= base || result > 0xffff) return kNoValue;
+			result = result * base + digit;
+		}
+		return negative ? -result : result;
+	}
+
+	std::vector<std::string> words(std::string const &normalizedLine) {
+		std::vector<std::string> result;
+		size_t start = 0;
+		while (start < normalizedLine.size()) {
+			auto end = normalizedLine.find(' ', start);
+			if (end == std::string::npos) end = normalizedLine.size();
+			result.push_back(normalizedLine.substr(start, end - start));
+			start = end + 1;
+		}
+		return result;
+	}
+
+	int channelFromBCL(int channel) {
+		// BCL counts MIDI channels from 1
+		return jlimit(0, 15, channel - 1);
+	}
+}
+
+ControllerMap::NrpnState::NrpnState()
+{
+	parameter.fill(-1);
+	valueMsb.fill(0);
+}
+
+// Collects the definition of one $encoder or $button block at a time and turns it into a target when the block ends
+class ControllerMap::Parser {
+public:
+	explicit Parser(ControllerMap &map) : map_(map), control_(-1) {
+	}
+
+	void line(std::string const &text) {
+		auto normalized = BCLDelta::normalize(text);
+		if (normalized.empty()) {
+			return;
+		}
+		auto tokens = words(normalized);
+		if (normalized[0] == '$') {
+			finish();
+			if (tokens.size() > 1 && (tokens[0] == "$encoder" || tokens[0] == "$button")) {
+				int number = parseNumber(tokens[1]);
+				bool isEncoder = tokens[0] == "$encoder";
+				if (number >= 1 && number <= (isEncoder ? kNumEncoders : kNumButtons)) {
+					control_ = isEncoder ? encoderIndex(number) : buttonIndex(number);
+				}
+			}
+		}
+		else if (control_ >= 0) {
+			if (tokens[0] == ".easypar") easypar_ = tokens;
+			else if (tokens[0] == ".tx") tx_ = tokens;
+			else if (tokens[0] == ".minmax" && tokens.size() > 2) minmax_ = tokens;
+		}
+	}
+
+	void finish() {
+		if (control_ >= 0) {
+			// .tx replaces whatever .easypar defined
+			if (tx_.size() > 1) {
+				fromTx();
+			}
+			else if (easypar_.size() > 2) {
+				fromEasyPar();
+			}
+		}
+		control_ = -1;
+		easypar_.clear();
+		tx_.clear();
+		minmax_.clear();
+	}
+
+private:
+	int argument(std::vector<std::string> const &tokens, size_t index, int defaultValue) const {
+		if (index < tokens.size()) {
+			int value = parseNumber(tokens[index]);
+			if (value != kNoValue) return value;
+		}
+		return defaultValue;
+	}
+
+	Target target(Source source, int channel, int parameter, int minimum, int maximum) const {
+		Target result;
+		result.control = control_;
+		result.source = source;
+		result.channel = channel;
+		result.parameter = parameter;
+		result.minimum = minimum;
+		result.maximum = maximum;
+		result.next = -1;
+		return result;
+	}
+
+	void fromEasyPar() {
+		auto const &type = easypar_[1];
+		int channel = channelFromBCL(argument(easypar_, 2, 1));
+		bool button = isButton(control_);
+		if (type == "cc" || type == "nrpn") {
+			// Encoders give the value range, buttons the values for on and off
+			int defaultMax = type == "cc" ? 127 : 16383;
+			map_.add(target(type == "cc" ? Source::CC : Source::NRPN, channel, argument(easypar_, 3, 0), argument(easypar_, 4, button ? defaultMax : 0), argument(easypar_, 5, button ? 0 : defaultMax)));
+		}
+		else if (type == "note" && button) {
+			map_.add(target(Source::Note, channel, argument(easypar_, 3, 0), argument(easypar_, 4, 127), 0));
+		}
+		else if (type == "pc") {
+			if (button) {
+				map_.add(target(Source::ProgramChange, channel, argument(easypar_, 3, 0), 0, 0));
+			}
+			else {
+				map_.add(target(Source::ProgramChange, channel, 0, argument(easypar_, 3, 0), argument(easypar_, 4, 127)));
+			}
+		}
+		else if (type == "pb" && !button) {
+			map_.add(target(Source::PitchBend, channel, 0, argument(easypar_, 3, -8192), argument(easypar_, 4, 8191)));
+		}
+		else if ((type == "at" || type == "after" || type == "aftertouch") && !button) {
+			map_.add(target(Source::AfterTouch, channel, 0, argument(easypar_, 3, 0), argument(easypar_, 4, 127)));
+		}
+	}
+
+	void fromTx() {
+		int minimum = argument(minmax_, 1, 0);
+		int maximum = argument(minmax_, 2, 127);
+		if (isButton(control_)) {
+			// A button shows as on when it sends its upper value
+			std::swap(minimum, maximum);
+		}
+
+		std::vector<PatternByte> pattern;
+		for (size_t i = 1; i < tx_.size(); i++) {
+			auto const &token = tx_[i];
+			PatternByte byte = { -2, 0, 0 };
+			int literal = parseNumber(token);
+			if (literal != kNoValue) {
+				byte.literal = literal & 0xff;
+			}
+			else if (token.compare(0, 3, "val") == 0) {
+				// val is the 7 bit value, valA.B are bits A to B of it
+				byte.literal = -1;
+				byte.valueBits = 7;
+				auto dot = token.find('.');
+				if (dot != std::string::npos) {
+					int low = parseNumber(token.substr(3, dot - 3));
+					int high = parseNumber(token.substr(dot + 1));
+					if (low != kNoValue && high != kNoValue && high >= low) {
+						byte.valueShift = low;
+						byte.valueBits = std::min(7, high - low + 1);
+					}
+				}
+			}
+			pattern.push_back(byte);
+		}
+		if (pattern.empty() || pattern[0].literal < 0x80) {
+			return;
+		}
+
+		int status = pattern[0].literal;
+		int channel = status & 0x0f;
+		// Running status NRPN: $Bn $63 msb $62 lsb $06 val...
+		std::vector<int> data;
+		for (size_t i = 1; i < pattern.size(); i++) {
+			if (pattern[i].literal < 0x80) data.push_back(pattern[i].literal);
+		}
+		switch (status & 0xf0) {
+		case 0xb0:
+			if (data.size() > 4 && data[0] == 99 && data[2] == 98 && data[1] >= 0 && data[3] >= 0) {
+				map_.add(target(Source::NRPN, channel, (data[1] << 7) | data[3], minimum, maximum));
+			}
+			else if (!data.empty() && data[0] >= 0) {
+				map_.add(target(Source::CC, channel, data[0], minimum, maximum));
+			}
+			break;
+		case 0x90:
+			if (!data.empty() && data[0] >= 0) {
+				map_.add(target(Source::Note, channel, data[0], minimum, maximum));
+			}
+			break;
+		case 0xc0:
+			map_.add(target(Source::ProgramChange, channel, 0, minimum, maximum));
+			break;
+		case 0xd0:
+			map_.add(target(Source::AfterTouch, channel, 0, minimum, maximum));
+			break;
+		case 0xe0:
+			map_.add(target(Source::PitchBend, channel, 0, minimum, maximum));
+			break;
+		case 0xf0:
+			if (status == 0xf0) {
+				auto sysex = target(Source::SysEx, 0, 0, minimum, maximum);
+				sysex.pattern = pattern;
+				map_.add(sysex);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	ControllerMap &map_;
+	int control_;
+	std::vector<std::string> easypar_;
+	std::vector<std::string> tx_;
+	std::vector<std::string> minmax_;
+};
+
+ControllerMap::ControllerMap() : ccFirst_(16 * 128, -1), noteFirst_(16 * 128, -1)
+{
+	mapped_.fill(false);
+}
+
+std::unique_ptr<ControllerMap> ControllerMap::fromBCL(std::string const &bcl)
+{
+	std::unique_ptr<ControllerMap> result(new ControllerMap());
+	Parser parser(*result);
+	size_t start = 0;
+	while (start < bcl.size()) {
+		auto end = bcl.find('\n', start);
+		if (end == std::string::npos) end = bcl.size();
+		parser.line(bcl.substr(start, end - start));
+		start = end + 1;
+	}
+	parser.finish();
+	return result;
+}
+
+void ControllerMap::add(Target target)
+{
+	int index = static_cast<int>(targets_.size());
+	switch (target.source) {
+	case Source::CC:
+		target.next = ccFirst_[target.channel * 128 + (target.parameter & 0x7f)];
+		ccFirst_[target.channel * 128 + (target.parameter & 0x7f)] = index;
+		break;
+	case Source::Note:
+		target.next = noteFirst_[target.channel * 128 + (target.parameter & 0x7f)];
+		noteFirst_[target.channel * 128 + (target.parameter & 0x7f)] = index;
+		break;
+	case Source::NRPN: {
+		std::pair<int, int> key(target.channel * 16384 + (target.parameter & 0x3fff), index);
+		auto found = std::lower_bound(nrpnFirst_.begin(), nrpnFirst_.end(), key, [](std::pair<int, int> const &a, std::pair<int, int> const &b) { return a.first < b.first; });
+		if (found != nrpnFirst_.end() && found->first == key.first) {
+			target.next = found->second;
+			found->second = index;
+		}
+		else {
+			nrpnFirst_.insert(found, key);
+		}
+		break;
+	}
+	default:
+		others_.push_back(index);
+		break;
+	}
+	mapped_[target.control] = true;
+	targets_.push_back(target);
+}
+
+int ControllerMap::firstNrpn(int channel, int parameter) const
+{
+	int key = channel * 16384 + parameter;
+	auto found = std::lower_bound(nrpnFirst_.begin(), nrpnFirst_.end(), std::make_pair(key, 0), [](std::pair<int, int> const &a, std::pair<int, int> const &b) { return a.first < b.first; });
+	return found != nrpnFirst_.end() && found->first == key ? found->second : -1;
+}
+
+uint16 ControllerMap::position(Target const &target, int value) const
+{
+	if (isButton(target.control)) {
+		return value == target.minimum ? kFullScale : 0;
+	}
+	if (target.minimum == target.maximum) {
+		return 0;
+	}
+	double relative = jlimit(0.0, 1.0, (value - target.minimum) / static_cast<double>(target.maximum - target.minimum));
+	return static_cast<uint16>(relative * kFullScale + 0.5);
+}
+
+int ControllerMap::emit(int first, int value, Update *outUpdates, int count, int maxUpdates) const
+{
+	for (int i = first; i >= 0 && count < maxUpdates; i = targets_[i].next) {
+		outUpdates[count].control = targets_[i].control;
+		outUpdates[count].position = position(targets_[i], value);
+		count++;
+	}
+	return count;
+}
+
+int ControllerMap::process(MidiMessage const &message, NrpnState &nrpn, Update *outUpdates, int maxUpdates) const
+{
+	int count = 0;
+	if (message.isSysEx()) {
+		for (int index : others_) {
+			auto const &target = targets_[index];
+			int value;
+			if (target.source == Source::SysEx && count < maxUpdates && matchSysex(target, message.getRawData(), message.getRawDataSize(), value)) {
+				outUpdates[count].control = target.control;
+				outUpdates[count].position = position(target, value);
+				count++;
+			}
+		}
+		return count;
+	}
+
+	int channel = message.getChannel() - 1;
+	if (channel < 0) {
+		return 0;
+	}
+	if (message.isController()) {
+		int controller = message.getControllerNumber();
+		int value = message.getControllerValue();
+		count = emit(ccFirst_[channel * 128 + controller], value, outUpdates, count, maxUpdates);
+
+		int &parameter = nrpn.parameter[channel];
+		switch (controller) {
+		case 99:
+			parameter = (value << 7) | (parameter >= 0 ? parameter & 0x7f : 0);
+			break;
+		case 98:
+			parameter = (parameter >= 0 ? parameter & 0x3f80 : 0) | value;
+			break;
+		case 6:
+		case 38:
+			if (controller == 6) {
+				nrpn.valueMsb[channel] = value;
+			}
+			if (parameter >= 0) {
+				for (int i = firstNrpn(channel, parameter); i >= 0 && count < maxUpdates; i = targets_[i].next) {
+					auto const &target = targets_[i];
+					// Ranges up to 127 are sent as data entry MSB only, larger ones need the LSB to complete
+					bool coarse = std::max(target.minimum, target.maximum) < 128;
+					int nrpnValue;
+					if (controller == 6) {
+						nrpnValue = coarse ? value : value << 7;
+					}
+					else if (!coarse) {
+						nrpnValue = (nrpn.valueMsb[channel] << 7) | value;
+					}
+					else {
+						continue;
+					}
+					outUpdates[count].control = target.control;
+					outUpdates[count].position = position(target, nrpnValue);
+					count++;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+		return count;
+	}
+	if (message.isNoteOnOrOff()) {
+		return emit(noteFirst_[channel * 128 + message.getNoteNumber()], message.isNoteOn() ? message.getVelocity() : 0, outUpdates, count, maxUpdates);
+	}
+
+	for (int index : others_) {
+		auto const &target = targets_[index];
+		if (target.channel != channel || count >= maxUpdates) {
+			continue;
+		}
+		if (target.source == Source::ProgramChange && message.isProgramChange()) {
+			int program = message.getProgramChangeNumber();
+			outUpdates[count].control = target.control;
+			// Buttons sending a program change light up as long as their program is the current one
+			outUpdates[count].position = isButton(target.control) ? (program == target.parameter ? kFullScale : 0) : position(target, program);
+			count++;
+		}
+		else if (target.source == Source::PitchBend && message.isPitchWheel()) {
+			int value = message.getPitchWheelValue();
+			outUpdates[count].control = target.control;
+			outUpdates[count].position = position(target, target.minimum < 0 ? value - 8192 : value);
+			count++;
+		}
+		else if (target.source == Source::AfterTouch && message.isChannelPressure()) {
+			outUpdates[count].control = target.control;
+			outUpdates[count].position = position(target, message.getChannelPressureValue());
+			count++;
+		}
+	}
+	return count;
+}
+
+bool ControllerMap::matchSysex(Target const &target, const uint8 *data, int size, int &outValue)
+{
+	if (size != static_cast<int>(target.pattern.size())) {
+		return false;
+	}
+	int value = 0;
+	for (int i = 0; i < size; i++) {
+		auto const &byte = target.pattern[i];
+		if (byte.literal >= 0) {
+			if (data[i] != byte.literal) return false;
+		}
+		else if (byte.literal == -1) {
+			value |= (data[i] & ((1 << byte.valueBits) - 1)) << byte.valueShift;
+		}
+	}
+	outValue = value;
+	return true;
+}
+
+bool ControllerMap::isMapped(int control) const
+{
+	return control >= 0 && control < kNumControls && mapped_[control];
+}
+
+int ControllerMap::numberOfMappedControls() const
+{
+	return static_cast<int>(std::count(mapped_.begin(), mapped_.end(), true));
+}
+
+ControllerValues::ControllerValues()
+{
+	for (auto &position : positions_) {
+		position.store(0);
+	}
+	for (auto &word : dirty_) {
+		word.store(0);
+	}
+}
+
+void ControllerValues::set(int control, uint16 position)
+{
+	positions_[control].store(position, std::memory_order_relaxed);
+	dirty_[control / 64].fetch_or(uint64(1) << (control % 64), std::memory_order_release);
+}
+
+uint16 ControllerValues::position(int control) const
+{
+	return positions_[control].load(std::memory_order_relaxed);
+}
+
+void ControllerValues::clear()
+{
+	for (int i = 0; i < ControllerMap::kNumControls; i++) {
+		set(i, 0);
+	}
+}
+
+uint64 ControllerValues::takeDirty(int word)
+{
+	return dirty_[word].exchange(0, std::memory_order_acquire);
+}
@@ -0,0 +1,104 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <array>
+#include <atomic>
+
+// Finds the BCR2000 controls an incoming MIDI message belongs to, using the .easypar and .tx definitions of a BCL document.
+// Built once per document on the message thread, then only read, so the MIDI thread can use it without locking.
+class ControllerMap {
+public:
+	static const int kNumEncoders = 56;
+	static const int kNumButtons = 64;
+	static const int kNumControls = kNumEncoders + kNumButtons;
+	static const uint16 kFullScale = 0xffff;
+
+	struct Update {
+		int control;
+		uint16 position; // 0 to kFullScale, buttons are either off or full scale
+	};
+
+	// Running NRPN parameter numbers per channel, owned by the thread calling process()
+	struct NrpnState {
+		NrpnState();
+		std::array<int, 16> parameter;
+		std::array<int, 16> valueMsb;
+	};
+
+	static std::unique_ptr<ControllerMap> fromBCL(std::string const &bcl);
+
+	// Fills at most maxUpdates, returns how many controls the message moved. Does not allocate.
+	int process(MidiMessage const &message, NrpnState &nrpn, Update *outUpdates, int maxUpdates) const;
+
+	bool isMapped(int control) const;
+	int numberOfMappedControls() const;
+
+	// Control index used by process(), number is 1-based as in BCL
+	static int encoderIndex(int number) { return number - 1; }
+	static int buttonIndex(int number) { return kNumEncoders + number - 1; }
+	static bool isButton(int control) { return control >= kNumEncoders; }
+
+private:
+	enum class Source { CC, NRPN, Note, ProgramChange, PitchBend, AfterTouch, SysEx };
+
+	struct PatternByte {
+		int literal; // -1 for value bits, -2 for bytes that are not compared (checksums)
+		int valueShift;
+		int valueBits;
+	};
+
+	struct Target {
+		int control;
+		Source source;
+		int channel; // 0-15
+		int parameter;
+		int minimum; // For buttons, the value sent when switched on
+		int maximum;
+		std::vector<PatternByte> pattern;
+		int next; // Next target listening to the same message, -1 at the end of the chain
+	};
+
+	class Parser;
+
+	ControllerMap();
+
+	void add(Target target);
+	uint16 position(Target const &target, int value) const;
+	int emit(int first, int value, Update *outUpdates, int count, int maxUpdates) const;
+	int firstNrpn(int channel, int parameter) const;
+	static bool matchSysex(Target const &target, const uint8 *data, int size, int &outValue);
+
+	std::vector<Target> targets_;
+	std::vector<int> ccFirst_; // channel * 128 + controller number to the first target, -1 if none
+	std::vector<int> noteFirst_;
+	std::vector<std::pair<int, int>> nrpnFirst_; // Sorted by channel * 16384 + parameter
+	std::vector<int> others_; // Program change, pitch bend, aftertouch and sysex targets, checked one by one
+	std::array<bool, kNumControls> mapped_;
+};
+
+// The latest position of every control. Written from the MIDI thread, read at frame rate by the view.
+// Every write sets a dirty bit, so the reader only needs to look at the controls that moved since its last frame.
+class ControllerValues {
+public:
+	ControllerValues();
+
+	void set(int control, uint16 position);
+	uint16 position(int control) const;
+	void clear();
+
+	// Returns the dirty bits of 64 controls starting at word * 64 and resets them
+	uint64 takeDirty(int word);
+
+	static const int kNumWords = (ControllerMap::kNumControls + 63) / 64;
+
+private:
+	std::array<std::atomic<uint16>, ControllerMap::kNumControls> positions_;
+	std::array<std::atomic<uint64>, kNumWords> dirty_;
+};
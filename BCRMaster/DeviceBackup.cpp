@@ -0,0 +1,145 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DeviceBackup.h"
+
+#include "ContentHash.h"
+#include "DumpSession.h"
+
+#include "Logger.h"
+
+namespace {
+	// Number of dump requests sent ahead of the preset currently being received
+	const int kPipelineDepth = 2;
+	const double kStallTimeoutMs = 3000.0;
+	const int kCompressionLevel = 9;
+}
+
+DeviceBackup::DeviceBackup(std::shared_ptr<midikraft::BCR2000> bcr) : bcr_(bcr), handle_(midikraft::MidiController::makeOneHandle()), receiving_(0), downloadSeconds_(0.0)
+{
+}
+
+DeviceBackup::~DeviceBackup()
+{
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+}
+
+bool DeviceBackup::downloadAll(std::function<void(double)> progressHandler, std::function<bool()> shouldAbort)
+{
+	auto names = bcr_->listOfPresets();
+	{
+		ScopedLock lock(lock_);
+		dumps_.clear();
+		for (int i = 0; i < kNumberOfPresets; i++) {
+			PresetDump dump;
+			dump.slot = i;
+			dump.name = i < static_cast<int>(names.size()) ? String(names[i]) : String("Preset " + String(i + 1));
+			dump.complete = false;
+			dumps_.push_back(dump);
+		}
+		receiving_ = 0;
+	}
+	inputName_ = String(bcr_->midiInput());
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleMessage(source, message);
+	});
+
+	double startTime = Time::getMillisecondCounterHiRes();
+	double lastProgress = startTime;
+	int requested = 0;
+	int received = 0;
+	bool success = true;
+	while (received < kNumberOfPresets) {
+		if (shouldAbort && shouldAbort()) {
+			success = false;
+			break;
+		}
+		while (requested < kNumberOfPresets && requested - received < kPipelineDepth) {
+			midikraft::MidiController::instance()->getMidiOutput(bcr_->midiOutput())->sendMessageNow(bcr_->requestDump(requested++));
+		}
+		messageArrived_.wait(100);
+		int nowReceived;
+		{
+			ScopedLock lock(lock_);
+			nowReceived = receiving_;
+		}
+		double now = Time::getMillisecondCounterHiRes();
+		if (nowReceived != received) {
+			received = nowReceived;
+			lastProgress = now;
+			if (progressHandler) {
+				progressHandler(received / (double)kNumberOfPresets);
+			}
+		}
+		else if (now - lastProgress > kStallTimeoutMs) {
+			SimpleLogger::instance()->postMessage("Timeout waiting for preset " + String(received + 1) + " from the BCR2000");
+			success = false;
+			break;
+		}
+	}
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+	downloadSeconds_ = (Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+	return success;
+}
+
+void DeviceBackup::handleMessage(MidiInput *source, MidiMessage const &message)
+{
+	if (source && inputName_.isNotEmpty() && source->getName() != inputName_) {
+		return;
+	}
+	if (!bcr_->isPartOfDump(message)) {
+		return;
+	}
+	ScopedLock lock(lock_);
+	if (receiving_ < static_cast<int>(dumps_.size())) {
+		// The device answers the requests in order, so everything belongs to the oldest incomplete preset
+		auto &dump = dumps_[receiving_];
+		dump.messages.push_back(message);
+		if (DumpAssembler::isEndOfDump(message)) {
+			dump.complete = true;
+			receiving_++;
+			messageArrived_.signal();
+		}
+	}
+}
+
+std::vector<DeviceBackup::PresetDump> const &DeviceBackup::dumps() const
+{
+	return dumps_;
+}
+
+double DeviceBackup::downloadSeconds() const
+{
+	return downloadSeconds_;
+}
+
+bool DeviceBackup::writeArchive(File const &archive) const
+{
+	ZipFile::Builder builder;
+	String manifest = "# slot;name;messages;bytes;fnv1a64\n";
+	for (auto const &dump : dumps_) {
+		if (!dump.complete) continue;
+		MemoryBlock data;
+		for (auto const &message : dump.messages) {
+			data.append(message.getRawData(), static_cast<size_t>(message.getRawDataSize()));
+		}
+		ContentHash hash;
+		hash.add(data.getData(), data.getSize());
+		String fileName = String(dump.slot + 1).paddedLeft('0', 2) + " " + File::createLegalFileName(dump.name) + ".syx";
+		manifest += String(dump.slot + 1) + ";" + dump.name + ";" + String(dump.messages.size()) + ";" + String(data.getSize()) + ";" + hash.toString() + "\n";
+		builder.addEntry(new MemoryInputStream(data, true), kCompressionLevel, fileName, Time::getCurrentTime());
+	}
+	builder.addEntry(new MemoryInputStream(manifest.toRawUTF8(), manifest.getNumBytesAsUTF8(), true), kCompressionLevel, "manifest.txt", Time::getCurrentTime());
+
+	TemporaryFile temp(archive);
+	{
+		std::unique_ptr<FileOutputStream> out(temp.getFile().createOutputStream());
+		if (!out || !out->openedOk() || !builder.writeToStream(*out, nullptr)) {
+			return false;
+		}
+	}
+	return temp.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,51 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+// Downloads all presets of a BCR2000, keeping a few dump requests in flight so the device never waits for us.
+// Each preset is assembled in its own buffer, and the result can be written as a zip archive with a checksum manifest.
+class DeviceBackup {
+public:
+	struct PresetDump {
+		int slot;
+		String name;
+		std::vector<MidiMessage> messages;
+		bool complete;
+	};
+
+	static const int kNumberOfPresets = 32;
+
+	explicit DeviceBackup(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~DeviceBackup();
+
+	// Blocks until all presets have been received, so call this from a background thread.
+	// Returns false if the device stopped answering or shouldAbort returned true.
+	bool downloadAll(std::function<void(double)> progressHandler, std::function<bool()> shouldAbort);
+
+	std::vector<PresetDump> const &dumps() const;
+	double downloadSeconds() const;
+
+	bool writeArchive(File const &archive) const;
+
+private:
+	void handleMessage(MidiInput *source, MidiMessage const &message);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	midikraft::MidiController::HandlerHandle handle_;
+	String inputName_;
+
+	CriticalSection lock_;
+	std::vector<PresetDump> dumps_;
+	int receiving_;
+	WaitableEvent messageArrived_;
+	double downloadSeconds_;
+};
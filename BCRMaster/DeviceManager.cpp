@@ -0,0 +1,162 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DeviceManager.h"
+
+DeviceManager::DeviceManager(std::shared_ptr<midikraft::BCR2000> primary) : remaining_(0), startTime_(0.0)
+{
+	auto unit = std::make_unique<Unit>();
+	unit->bcr = primary;
+	unit->dumpSessions = std::make_unique<DumpSessionManager>(primary);
+	unit->transmitter = std::make_shared<BCRTransmitter>(primary);
+	units_.push_back(std::move(unit));
+}
+
+DeviceManager::~DeviceManager()
+{
+	// Stop all transmitters while the units they report to still exist, the editors might keep the primary one a bit longer
+	for (auto &unit : units_) {
+		unit->transmitter->stop();
+	}
+}
+
+bool DeviceManager::setConnections(std::vector<FastAutoDetection::Connection> const &connections)
+{
+	if (isBusy()) {
+		return false;
+	}
+	// Keep the primary unit, its BCR2000 is shared with the editors
+	units_.resize(1);
+	for (size_t i = 1; i < connections.size(); i++) {
+		auto unit = std::make_unique<Unit>();
+		unit->bcr = std::make_shared<midikraft::BCR2000>();
+		FastAutoDetection::configure(*unit->bcr, connections[i]);
+		unit->dumpSessions = std::make_unique<DumpSessionManager>(unit->bcr);
+		unit->transmitter = std::make_shared<BCRTransmitter>(unit->bcr);
+		units_.push_back(std::move(unit));
+	}
+	ScopedLock lock(statusLock_);
+	for (auto &unit : units_) {
+		unit->status = UnitStatus();
+		unit->status.name = unitName(static_cast<int>(&unit - units_.data()));
+	}
+	return true;
+}
+
+int DeviceManager::numberOfUnits() const
+{
+	return static_cast<int>(units_.size());
+}
+
+std::shared_ptr<midikraft::BCR2000> DeviceManager::bcr(int unit) const
+{
+	return units_[unit]->bcr;
+}
+
+String DeviceManager::unitName(int unit) const
+{
+	return "Unit " + String(unit + 1) + " (" + String(units_[unit]->bcr->midiOutput()) + ")";
+}
+
+DumpSessionManager &DeviceManager::dumpSessions(int unit)
+{
+	return *units_[unit]->dumpSessions;
+}
+
+std::shared_ptr<BCRTransmitter> DeviceManager::transmitter(int unit) const
+{
+	return units_[unit]->transmitter;
+}
+
+bool DeviceManager::sendToUnits(std::vector<std::vector<MidiMessage>> const &messagesPerUnit, TFinishedHandler whenDone)
+{
+	if (isBusy()) {
+		return false;
+	}
+	std::vector<int> targets;
+	for (int i = 0; i < jmin(numberOfUnits(), static_cast<int>(messagesPerUnit.size())); i++) {
+		if (!messagesPerUnit[i].empty()) {
+			targets.push_back(i);
+		}
+	}
+	{
+		ScopedLock lock(statusLock_);
+		for (int i = 0; i < numberOfUnits(); i++) {
+			units_[i]->status = UnitStatus();
+			units_[i]->status.name = unitName(i);
+			units_[i]->status.summary = "Nothing to send";
+		}
+		for (int i : targets) {
+			units_[i]->status.busy = true;
+			units_[i]->status.summary = "Waiting";
+		}
+	}
+	if (targets.empty()) {
+		MessageManager::callAsync(whenDone);
+		return true;
+	}
+
+	// Everything the transmitter threads look at is set up before the first one starts
+	whenDone_ = whenDone;
+	remaining_ = static_cast<int>(targets.size());
+	startTime_ = Time::getMillisecondCounterHiRes();
+	for (int i : targets) {
+		bool started = units_[i]->transmitter->send(messagesPerUnit[i], [this, i](BCRTransmitter::Statistics const &statistics) {
+			ScopedLock lock(statusLock_);
+			units_[i]->status.progress = statistics.messagesTotal > 0 ? statistics.messagesAcknowledged / (double) statistics.messagesTotal : 1.0;
+			units_[i]->status.summary = statistics.toString();
+		}, [this, i](std::vector<midikraft::BCR2000::BCRError> const &errors, bool aborted, BCRTransmitter::Statistics const &statistics) {
+			unitFinished(i, errors, aborted, statistics);
+		});
+		if (!started) {
+			// Someone else is using this unit's transmitter
+			unitFinished(i, {}, true, BCRTransmitter::Statistics());
+		}
+	}
+	return true;
+}
+
+void DeviceManager::unitFinished(int unit, std::vector<midikraft::BCR2000::BCRError> const &errors, bool aborted, BCRTransmitter::Statistics const &statistics)
+{
+	// Called on the unit's transmitter thread
+	{
+		ScopedLock lock(statusLock_);
+		auto &status = units_[unit]->status;
+		status.busy = false;
+		status.aborted = aborted;
+		status.errors = errors;
+		status.progress = aborted ? status.progress : 1.0;
+		status.summary = (aborted ? "Aborted: " : errors.empty() ? "Done: " : String(errors.size()) + " errors: ") + statistics.toString();
+	}
+	if (--remaining_ == 0) {
+		auto whenDone = whenDone_;
+		if (whenDone) {
+			MessageManager::callAsync(whenDone);
+		}
+	}
+}
+
+bool DeviceManager::isBusy() const
+{
+	return remaining_ > 0;
+}
+
+void DeviceManager::abortAll()
+{
+	for (auto &unit : units_) {
+		unit->transmitter->abort();
+	}
+}
+
+std::vector<DeviceManager::UnitStatus> DeviceManager::status() const
+{
+	ScopedLock lock(statusLock_);
+	std::vector<UnitStatus> result;
+	for (auto const &unit : units_) {
+		result.push_back(unit->status);
+	}
+	return result;
+}
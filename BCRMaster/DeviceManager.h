@@ -0,0 +1,74 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "BCRTransmitter.h"
+#include "DumpSession.h"
+#include "FastAutoDetection.h"
+
+#include <atomic>
+
+// All BCR2000 units found by the detection. Unit 0 is the primary device the editors talk to, every unit has its own dump sessions
+// and its own transmitter, i.e. its own thread, send queue and acknowledgement tracking. There is only one transmitter per device,
+// the editors send through the one of unit 0, as two transmitters on the same port would take each other's acknowledgements.
+// Uploads from here count in that transmitter's upload generation too, so an editor won't send a delta onto what they wrote.
+//
+// An upload to several units starts all transmitters at once and they run side by side on their separate ports, so the whole upload
+// takes about as long as the slowest unit. The status of each unit can be polled from the message thread while it runs.
+class DeviceManager {
+public:
+	struct UnitStatus {
+		String name;
+		bool busy = false;
+		bool aborted = false;
+		double progress = 0.0;
+		std::vector<midikraft::BCR2000::BCRError> errors;
+		String summary;
+	};
+
+	typedef std::function<void()> TFinishedHandler;
+
+	explicit DeviceManager(std::shared_ptr<midikraft::BCR2000> primary);
+	virtual ~DeviceManager();
+
+	// The first connection is expected to be the one the primary device was configured with. Ignored while uploading.
+	bool setConnections(std::vector<FastAutoDetection::Connection> const &connections);
+
+	int numberOfUnits() const;
+	std::shared_ptr<midikraft::BCR2000> bcr(int unit) const;
+	String unitName(int unit) const;
+	DumpSessionManager &dumpSessions(int unit);
+	std::shared_ptr<BCRTransmitter> transmitter(int unit) const;
+
+	// Sends messagesPerUnit[i] to unit i, empty lists and units beyond the list are left alone.
+	// Returns false if an upload is still running, otherwise whenDone is called on the message thread once every unit has finished.
+	bool sendToUnits(std::vector<std::vector<MidiMessage>> const &messagesPerUnit, TFinishedHandler whenDone);
+	bool isBusy() const;
+	void abortAll();
+
+	std::vector<UnitStatus> status() const;
+
+private:
+	struct Unit {
+		std::shared_ptr<midikraft::BCR2000> bcr;
+		std::unique_ptr<DumpSessionManager> dumpSessions;
+		std::shared_ptr<BCRTransmitter> transmitter;
+		UnitStatus status;
+	};
+
+	void unitFinished(int unit, std::vector<midikraft::BCR2000::BCRError> const &errors, bool aborted, BCRTransmitter::Statistics const &statistics);
+
+	std::vector<std::unique_ptr<Unit>> units_;
+	// Guards the status of all units, which is written by the transmitter threads
+	mutable CriticalSection statusLock_;
+	std::atomic<int> remaining_;
+	TFinishedHandler whenDone_;
+	double startTime_;
+};
@@ -0,0 +1,259 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DeviceMirror.h"
+
+#include "BCLDecoder.h"
+#include "BCLDelta.h"
+#include "ContentHash.h"
+#include "SyxCompilationCache.h"
+
+#include "Sysex.h"
+
+#include <algorithm>
+
+namespace {
+	const char *kMirrorTag = "DeviceMirror";
+	const char *kSlotTag = "Slot";
+	const char *kNumberAttribute = "number";
+	const char *kNameAttribute = "name";
+	const char *kDeviceHashAttribute = "deviceHash";
+	const char *kSourceHashAttribute = "sourceHash";
+
+	std::string commandOf(std::string const &normalizedLine) {
+		return normalizedLine.substr(0, normalizedLine.find(' '));
+	}
+
+	// Where the preset goes is not part of its content
+	bool isPlacement(std::string const &normalizedLine) {
+		auto command = commandOf(normalizedLine);
+		return command == "$store" || command == "$recall";
+	}
+
+	std::vector<std::string> splitLines(std::string const &text) {
+		std::vector<std::string> result;
+		size_t start = 0;
+		while (start < text.size()) {
+			auto end = text.find('\n', start);
+			if (end == std::string::npos) end = text.size();
+			auto line = text.substr(start, end - start);
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			result.push_back(line);
+			start = end + 1;
+		}
+		return result;
+	}
+}
+
+DeviceMirror::DeviceMirror(String const &device) : DeviceMirror(device, File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("BCRMaster").getChildFile("Mirror"))
+{
+}
+
+DeviceMirror::DeviceMirror(String const &device, File const &directory) : device_(device), directory_(directory)
+{
+	load();
+}
+
+void DeviceMirror::updateFromDump(int slot, std::vector<MidiMessage> const &dump)
+{
+	auto &entry = slots_[slot];
+	auto deviceHash = contentHash(dump);
+	if (entry.deviceHash.isNotEmpty() && entry.deviceHash != deviceHash) {
+		// Changed behind our back, whatever we uploaded before is gone
+		entry.sourceHash.clear();
+	}
+	entry.name = presetName(dump);
+	entry.deviceHash = deviceHash;
+	entry.seen = true;
+}
+
+void DeviceMirror::updateFromUpload(Target const &target, std::vector<MidiMessage> const &dump)
+{
+	auto &entry = slots_[target.slot];
+	entry.name = presetName(dump);
+	entry.deviceHash = contentHash(dump);
+	entry.sourceHash = target.hash;
+	entry.seen = true;
+}
+
+void DeviceMirror::forget(int slot)
+{
+	slots_.erase(slot);
+}
+
+std::vector<DeviceMirror::SlotDiff> DeviceMirror::compare(std::vector<Target> const &targets) const
+{
+	std::vector<SlotDiff> result;
+	for (int slot = 0; slot < kNumberOfSlots; slot++) {
+		SlotDiff diff;
+		diff.slot = slot;
+		auto entry = slots_.find(slot);
+		diff.deviceName = entry != slots_.end() ? entry->second.name : String();
+		auto target = std::find_if(targets.begin(), targets.end(), [slot](Target const &t) { return t.slot == slot; });
+		if (target == targets.end()) {
+			diff.state = State::NoTarget;
+		}
+		else {
+			diff.targetName = target->name;
+			if (entry == slots_.end() || !entry->second.seen || entry->second.deviceHash.isEmpty()) {
+				diff.state = State::Unknown;
+			}
+			else if (target->hash == entry->second.deviceHash || target->hash == entry->second.sourceHash) {
+				diff.state = State::Same;
+			}
+			else {
+				diff.state = State::Differs;
+			}
+		}
+		result.push_back(diff);
+	}
+	return result;
+}
+
+String DeviceMirror::contentHash(std::vector<std::string> const &lines)
+{
+	ContentHash hash;
+	for (auto const &line : lines) {
+		auto normalized = BCLDelta::normalize(line);
+		if (normalized.empty() || isPlacement(normalized)) {
+			continue;
+		}
+		// Include the line break, so the content can't be shifted between lines unnoticed
+		hash.add(normalized.data(), normalized.size() + 1);
+	}
+	return hash.toString();
+}
+
+String DeviceMirror::contentHash(std::vector<MidiMessage> const &dump)
+{
+	return contentHash(splitLines(BCLDecoder::decodeToText(dump)));
+}
+
+String DeviceMirror::presetName(std::vector<MidiMessage> const &dump)
+{
+	return presetName(splitLines(BCLDecoder::decodeToText(dump)));
+}
+
+String DeviceMirror::presetName(std::vector<std::string> const &lines)
+{
+	// The .name of the $preset, which is what the device lists
+	for (auto const &line : lines) {
+		auto normalized = BCLDelta::normalize(line);
+		if (commandOf(normalized) == ".name") {
+			return String(normalized.substr(5)).trim().unquoted().trim();
+		}
+	}
+	return {};
+}
+
+std::vector<DeviceMirror::Target> DeviceMirror::readTargets(File const &folder, StringArray &outProblems)
+{
+	std::vector<Target> result;
+	for (auto const &file : folder.findChildFiles(File::findFiles, false, "*.bcl;*.syx")) {
+		auto fileName = file.getFileNameWithoutExtension();
+		auto number = fileName.initialSectionContainingOnly("0123456789");
+		int slot = number.getIntValue() - 1;
+		if (number.isEmpty() || slot < 0 || slot >= kNumberOfSlots) {
+			outProblems.add(file.getFileName() + " doesn't start with a slot number between 1 and " + String(kNumberOfSlots));
+			continue;
+		}
+		if (std::any_of(result.begin(), result.end(), [slot](Target const &t) { return t.slot == slot; })) {
+			outProblems.add(file.getFileName() + " is not the only file for slot " + String(slot + 1));
+			continue;
+		}
+		Target target;
+		target.slot = slot;
+		target.name = fileName.substring(number.length()).trim();
+		target.file = file;
+		target.lines = splitLines(file.hasFileExtension("syx") ? BCLDecoder::decodeToText(Sysex::loadSysex(file.getFullPathName().toStdString()))
+			: file.loadFileAsString().toStdString());
+		bool hasRev = false;
+		bool hasEnd = false;
+		for (auto const &line : target.lines) {
+			auto command = commandOf(BCLDelta::normalize(line));
+			hasRev = hasRev || command == "$rev";
+			hasEnd = hasEnd || command == "$end";
+		}
+		if (!hasRev || !hasEnd) {
+			outProblems.add(file.getFileName() + " is no complete preset, it needs $rev and $end");
+			continue;
+		}
+		target.hash = contentHash(target.lines);
+		result.push_back(target);
+	}
+	std::sort(result.begin(), result.end(), [](Target const &a, Target const &b) { return a.slot < b.slot; });
+	return result;
+}
+
+std::vector<MidiMessage> DeviceMirror::uploadMessages(midikraft::BCR2000 &bcr, std::vector<Target> const &targets, std::vector<int> &outMessageSlots)
+{
+	std::vector<MidiMessage> result;
+	int index = 0;
+	for (auto const &target : targets) {
+		// Replace whatever placement the file has by our slot, right before the last $end
+		int lastEnd = -1;
+		for (int i = 0; i < static_cast<int>(target.lines.size()); i++) {
+			if (commandOf(BCLDelta::normalize(target.lines[i])) == "$end") {
+				lastEnd = i;
+			}
+		}
+		for (int i = 0; i < static_cast<int>(target.lines.size()); i++) {
+			std::vector<std::string> lines;
+			auto normalized = BCLDelta::normalize(target.lines[i]);
+			if (normalized.empty() || isPlacement(normalized)) {
+				continue;
+			}
+			if (i == lastEnd) {
+				lines.push_back("$store " + std::to_string(target.slot + 1));
+			}
+			lines.push_back(target.lines[i]);
+			for (auto const &line : lines) {
+				for (auto const &message : bcr.convertToSyx(line, true)) {
+					result.push_back(SyxCompilationCache::withMessageIndex(message, index++));
+					outMessageSlots.push_back(target.slot);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+bool DeviceMirror::save() const
+{
+	XmlElement xml(kMirrorTag);
+	for (auto const &slot : slots_) {
+		auto element = xml.createNewChildElement(kSlotTag);
+		element->setAttribute(kNumberAttribute, slot.first);
+		element->setAttribute(kNameAttribute, slot.second.name);
+		element->setAttribute(kDeviceHashAttribute, slot.second.deviceHash);
+		element->setAttribute(kSourceHashAttribute, slot.second.sourceHash);
+	}
+	directory_.createDirectory();
+	return xml.writeToFile(mirrorFile(), String());
+}
+
+void DeviceMirror::load()
+{
+	auto file = mirrorFile();
+	if (!file.existsAsFile()) {
+		return;
+	}
+	std::unique_ptr<XmlElement> xml(XmlDocument::parse(file));
+	if (xml && xml->hasTagName(kMirrorTag)) {
+		forEachXmlChildElementWithTagName(*xml, slot, kSlotTag) {
+			Entry entry;
+			entry.name = slot->getStringAttribute(kNameAttribute);
+			entry.deviceHash = slot->getStringAttribute(kDeviceHashAttribute);
+			entry.sourceHash = slot->getStringAttribute(kSourceHashAttribute);
+			slots_[slot->getIntAttribute(kNumberAttribute)] = entry;
+		}
+	}
+}
+
+File DeviceMirror::mirrorFile() const
+{
+	return directory_.getChildFile(File::createLegalFileName(device_.isEmpty() ? String("unknown") : device_) + ".xml");
+}
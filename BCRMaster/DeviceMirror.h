@@ -0,0 +1,87 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+#include <map>
+
+// Remembers what each of the 32 slots of a device holds, as a content hash of its BCL, to find the slots that differ from a folder of presets.
+//
+// The hash is taken over the normalized lines, without comments, whitespace differences and $store/$recall, so a preset saved from the
+// device hashes the same whether it is kept as .syx or .bcl. The device answers a dump with its own rendering of the preset though,
+// which is not what was sent to it. So after an upload, the mirror also records which source was uploaded to produce what the device
+// holds now, and that source counts as in sync as long as the device still holds the same.
+//
+// Target folders contain files named like the ones in a backup archive, "01 Name.syx" or "01 Name.bcl" for slot 1.
+class DeviceMirror {
+public:
+	static const int kNumberOfSlots = 32;
+
+	enum class State {
+		Same,
+		Differs,
+		Unknown, // The slot was not read from the device since the mirror was loaded
+		NoTarget // The folder has nothing for this slot, it is left alone
+	};
+
+	struct Target {
+		int slot;
+		String name; // From the file name
+		File file;
+		String hash;
+		std::vector<std::string> lines;
+	};
+
+	struct SlotDiff {
+		int slot;
+		State state;
+		String deviceName;
+		String targetName;
+	};
+
+	explicit DeviceMirror(String const &device);
+	DeviceMirror(String const &device, File const &directory);
+
+	// Records what a dump of the device showed in the slot. The uploaded source is only dropped if the device holds something else than before
+	void updateFromDump(int slot, std::vector<MidiMessage> const &dump);
+	// Records that the target was uploaded into the slot, followed by the dump showing the result
+	void updateFromUpload(Target const &target, std::vector<MidiMessage> const &dump);
+	void forget(int slot);
+
+	std::vector<SlotDiff> compare(std::vector<Target> const &targets) const;
+
+	bool save() const;
+
+	static String contentHash(std::vector<std::string> const &lines);
+	static String contentHash(std::vector<MidiMessage> const &dump);
+	static String presetName(std::vector<MidiMessage> const &dump);
+	static String presetName(std::vector<std::string> const &lines);
+
+	// Reads the presets of a folder, files that don't start with a slot number are listed in outProblems
+	static std::vector<Target> readTargets(File const &folder, StringArray &outProblems);
+
+	// The sysex to upload the targets, each stored into its slot, numbered consecutively. Receives the slot of every message returned.
+	static std::vector<MidiMessage> uploadMessages(midikraft::BCR2000 &bcr, std::vector<Target> const &targets, std::vector<int> &outMessageSlots);
+
+private:
+	struct Entry {
+		String name;
+		String deviceHash; // Of what the device dumped
+		String sourceHash; // Of what was uploaded to get that, if it was us
+		bool seen = false; // Read from the device since the mirror was loaded, not stored
+	};
+
+	void load();
+	File mirrorFile() const;
+
+	String device_;
+	File directory_;
+	std::map<int, Entry> slots_;
+};
@@ -0,0 +1,81 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DiagnosticsPanel.h"
+
+#include "Logger.h"
+
+namespace {
+	const int kRefreshHz = 2;
+}
+
+template <>
+void visit(Trace::Histogram const &histogram, int column, std::function<void(std::string const &)> visitor) {
+	switch (column) {
+	case 1: visitor(histogram.name.toStdString()); break;
+	case 2: visitor(String(static_cast<int64>(histogram.count)).toStdString()); break;
+	case 3: visitor(String(histogram.meanMs(), 3).toStdString()); break;
+	case 4: visitor(String(histogram.percentileMs(0.5), 3).toStdString()); break;
+	case 5: visitor(String(histogram.percentileMs(0.9), 3).toStdString()); break;
+	case 6: visitor(String(histogram.percentileMs(0.99), 3).toStdString()); break;
+	case 7: visitor(String(histogram.maxMs, 3).toStdString()); break;
+	case 8: visitor(String(histogram.totalMs, 1).toStdString()); break;
+	}
+}
+
+DiagnosticsPanel::DiagnosticsPanel() : table_({ "Operation", "Count", "Mean ms", "p50 ms", "p90 ms", "p99 ms", "Max ms", "Total ms" }, {}, [](int) {})
+{
+	enableButton_.setButtonText("Enable tracing");
+	enableButton_.setToggleState(Trace::isEnabled(), dontSendNotification);
+	enableButton_.onClick = [this]() { Trace::setEnabled(enableButton_.getToggleState()); };
+	addAndMakeVisible(enableButton_);
+
+	resetButton_.setButtonText("Reset");
+	resetButton_.onClick = []() { Trace::reset(); };
+	addAndMakeVisible(resetButton_);
+
+	exportButton_.setButtonText("Export Chrome trace...");
+	exportButton_.onClick = [this]() { exportTrace(); };
+	addAndMakeVisible(exportButton_);
+
+	addAndMakeVisible(table_);
+	timerCallback();
+	startTimerHz(kRefreshHz);
+	setSize(800, 400);
+}
+
+DiagnosticsPanel::~DiagnosticsPanel()
+{
+	stopTimer();
+}
+
+void DiagnosticsPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto top = area.removeFromTop(28);
+	enableButton_.setBounds(top.removeFromLeft(160));
+	exportButton_.setBounds(top.removeFromRight(180));
+	resetButton_.setBounds(top.removeFromRight(88).withTrimmedRight(8));
+	table_.setBounds(area.withTrimmedTop(8));
+}
+
+void DiagnosticsPanel::timerCallback()
+{
+	table_.updateData(Trace::histograms());
+}
+
+void DiagnosticsPanel::exportTrace()
+{
+	FileChooser chooser("Export trace as...", File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("bcrmaster-trace.json"), "*.json");
+	if (chooser.browseForFileToSave(true)) {
+		if (Trace::exportChromeTrace(chooser.getResult())) {
+			SimpleLogger::instance()->postMessage("Trace written to " + chooser.getResult().getFullPathName() + ", open it in chrome://tracing");
+		}
+		else {
+			SimpleLogger::instance()->postMessage("Could not write trace to " + chooser.getResult().getFullPathName());
+		}
+	}
+}
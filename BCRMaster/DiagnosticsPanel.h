@@ -0,0 +1,32 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "Trace.h"
+#include "SimpleTable.h"
+
+// Shows the latency histograms of the Trace spans, and allows to switch tracing on and export a Chrome trace
+class DiagnosticsPanel : public Component,
+	private Timer
+{
+public:
+	DiagnosticsPanel();
+	virtual ~DiagnosticsPanel();
+
+	void resized() override;
+
+private:
+	void timerCallback() override;
+	void exportTrace();
+
+	ToggleButton enableButton_;
+	TextButton resetButton_;
+	TextButton exportButton_;
+	SimpleTable<std::vector<Trace::Histogram>> table_;
+};
@@ -0,0 +1,224 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DocumentIO.h"
+
+#include "BCLDecoder.h"
+#include "SyxCompilationCache.h"
+#include "Sysex.h"
+#include "Trace.h"
+
+namespace {
+	const int kNumThreads = 2;
+	const size_t kWriteChunkSize = 64 * 1024;
+	const double kProgressStep = 0.01;
+	// Share of the progress bar for compiling when saving .syx, the rest is writing
+	const double kCompileShare = 0.8;
+
+	bool isSyx(File const &file) {
+		return file.getFileExtension().toLowerCase() == ".syx";
+	}
+}
+
+std::unique_ptr<DocumentIO> DocumentIO::instance_;
+
+class DocumentIO::IOJob : public ThreadPoolJob {
+public:
+	typedef std::function<Result(Task &task, std::function<void(double)> const &progress)> TWork;
+
+	IOJob(TTaskHandle task, TWork work, TProgressHandler progressHandler, TFinishedHandler finishedHandler) : ThreadPoolJob("DocumentIO"),
+		task_(task), work_(work), progressHandler_(progressHandler), finishedHandler_(finishedHandler), lastProgress_(-1.0)
+	{
+	}
+
+	JobStatus runJob() override {
+		double startTime = Time::getMillisecondCounterHiRes();
+		auto result = work_(*task_, [this](double progress) { reportProgress(progress); });
+		result.cancelled = task_->isCancelled();
+		result.success = result.success && !result.cancelled;
+		result.milliseconds = Time::getMillisecondCounterHiRes() - startTime;
+		auto finishedHandler = finishedHandler_;
+		MessageManager::callAsync([finishedHandler, result]() {
+			if (finishedHandler) {
+				finishedHandler(result);
+			}
+		});
+		return jobHasFinished;
+	}
+
+private:
+	void reportProgress(double progress) {
+		// Don't flood the message queue, a percent is as fine as any progress bar can show
+		if (!progressHandler_ || progress - lastProgress_ < kProgressStep) {
+			return;
+		}
+		lastProgress_ = progress;
+		auto progressHandler = progressHandler_;
+		MessageManager::callAsync([progressHandler, progress]() { progressHandler(progress); });
+	}
+
+	TTaskHandle task_;
+	TWork work_;
+	TProgressHandler progressHandler_;
+	TFinishedHandler finishedHandler_;
+	double lastProgress_;
+};
+
+DocumentIO::DocumentIO() : pool_(kNumThreads)
+{
+}
+
+DocumentIO & DocumentIO::instance()
+{
+	if (!instance_) {
+		instance_.reset(new DocumentIO());
+	}
+	return *instance_;
+}
+
+void DocumentIO::shutdown()
+{
+	instance_.reset();
+}
+
+DocumentIO::TTaskHandle DocumentIO::load(File const &file, TProgressHandler progressHandler, TFinishedHandler finishedHandler)
+{
+	auto task = std::make_shared<Task>();
+	pool_.addJob(new IOJob(task, [file](Task &task, std::function<void(double)> const &progress) {
+		return loadFile(file, task, progress);
+	}, progressHandler, finishedHandler), true);
+	return task;
+}
+
+DocumentIO::TTaskHandle DocumentIO::save(File const &file, String const &document, TProgressHandler progressHandler, TFinishedHandler finishedHandler)
+{
+	auto task = std::make_shared<Task>();
+	pool_.addJob(new IOJob(task, [file, document](Task &task, std::function<void(double)> const &progress) {
+		return saveFile(file, document, task, progress);
+	}, progressHandler, finishedHandler), true);
+	return task;
+}
+
+DocumentIO::Result DocumentIO::loadFile(File const &file, Task &task, std::function<void(double)> const &progress)
+{
+	Result result;
+	result.file = file;
+	result.success = false;
+	if (!file.existsAsFile()) {
+		result.errorMessage = "File not found";
+		return result;
+	}
+	if (isSyx(file)) {
+		SyxScanner scanner(file);
+		std::string text;
+		if (scanner.openedOk()) {
+			text.reserve(scanner.fileSize());
+			size_t total = scanner.fileSize();
+			BCLDecoder::decode(scanner, [&text, &task, &progress, total](const char *line, size_t length) {
+				if (task.isCancelled()) return;
+				text.append(line, length);
+				text.push_back('\n');
+				// The text is a bit shorter than the sysex it comes from, good enough for a progress bar
+				progress(jmin(1.0, text.size() / static_cast<double>(total)));
+			});
+		}
+		else {
+			text = BCLDecoder::decodeToText(Sysex::loadSysex(file.getFullPathName().toStdString()));
+		}
+		result.text = String(text.data(), text.size());
+	}
+	else {
+		result.text = file.loadFileAsString();
+	}
+	progress(1.0);
+	result.success = true;
+	return result;
+}
+
+DocumentIO::Result DocumentIO::saveFile(File const &file, String const &document, Task &task, std::function<void(double)> const &progress)
+{
+	Result result;
+	result.file = file;
+	result.success = false;
+
+	MemoryBlock data;
+	if (isSyx(file)) {
+		// Compile line by line just like the SyxCompilationCache does, so the file matches what an upload sends
+		auto lines = StringArray::fromLines(document);
+		if (lines.size() > 0 && lines[lines.size() - 1].isEmpty()) {
+			lines.remove(lines.size() - 1);
+		}
+		// The BCR2000 of the editor belongs to the message thread, this one is only used here
+		midikraft::BCR2000 converter;
+		data.ensureSize(static_cast<size_t>(document.length()) * 2);
+		size_t used = 0;
+		int index = 0;
+		for (int i = 0; i < lines.size() && !task.isCancelled(); i++) {
+			std::vector<MidiMessage> messages;
+			{
+				Trace::Span span("convertToSyx");
+				messages = converter.convertToSyx(lines[i].toStdString(), true);
+			}
+			for (auto const &message : messages) {
+				auto indexed = SyxCompilationCache::withMessageIndex(message, index++);
+				size_t size = static_cast<size_t>(indexed.getRawDataSize());
+				data.ensureSize(used + size, false);
+				memcpy(static_cast<uint8 *>(data.getData()) + used, indexed.getRawData(), size);
+				used += size;
+			}
+			progress(kCompileShare * (i + 1) / lines.size());
+		}
+		data.setSize(used);
+		if (index == 0 && !task.isCancelled()) {
+			result.errorMessage = "Nothing to save, the document contains no BCL";
+			return result;
+		}
+	}
+	else {
+		// Write as ASCII text
+		data.append(document.toRawUTF8(), document.getNumBytesAsUTF8());
+	}
+	if (task.isCancelled()) {
+		return result;
+	}
+
+	double writeStart = isSyx(file) ? kCompileShare : 0.0;
+	result.success = writeAtomically(file, data, task, [&progress, writeStart](double written) {
+		progress(writeStart + (1.0 - writeStart) * written);
+	}, result.errorMessage);
+	return result;
+}
+
+bool DocumentIO::writeAtomically(File const &file, MemoryBlock const &data, Task &task, std::function<void(double)> const &progress, String &errorMessage)
+{
+	// The temporary file is deleted again when we leave without moving it over the target
+	TemporaryFile temp(file);
+	{
+		FileOutputStream out(temp.getFile());
+		if (!out.openedOk()) {
+			errorMessage = "Could not create " + temp.getFile().getFullPathName();
+			return false;
+		}
+		auto bytes = static_cast<const char *>(data.getData());
+		for (size_t written = 0; written < data.getSize(); written += kWriteChunkSize) {
+			if (task.isCancelled()) {
+				return false;
+			}
+			out.write(bytes + written, jmin(kWriteChunkSize, data.getSize() - written));
+			progress((written + kWriteChunkSize) / static_cast<double>(data.getSize()));
+		}
+		out.flush();
+		if (out.getStatus().failed()) {
+			errorMessage = out.getStatus().getErrorMessage();
+			return false;
+		}
+	}
+	if (!temp.overwriteTargetFileWithTemporary()) {
+		errorMessage = "Could not replace " + file.getFullPathName();
+		return false;
+	}
+	return true;
+}
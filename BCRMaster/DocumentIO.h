@@ -0,0 +1,65 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+#include <atomic>
+
+// Loads, converts and saves documents on a background thread, so big files never block the message thread.
+// Files are written to a temporary file next to the target first and then moved over it, so a crash or a cancelled
+// save leaves the previous version intact. All handlers are called on the message thread.
+class DocumentIO {
+public:
+	// Handle of a running load or save, to cancel it
+	class Task {
+	public:
+		Task() : cancelled_(false) {}
+		void cancel() { cancelled_ = true; }
+		bool isCancelled() const { return cancelled_; }
+
+	private:
+		std::atomic<bool> cancelled_;
+	};
+	typedef std::shared_ptr<Task> TTaskHandle;
+
+	struct Result {
+		File file;
+		bool success;
+		bool cancelled;
+		String errorMessage;
+		String text; // The loaded document, only for loads
+		double milliseconds;
+	};
+
+	typedef std::function<void(double progress)> TProgressHandler;
+	typedef std::function<void(Result const &result)> TFinishedHandler;
+
+	static DocumentIO &instance();
+	static void shutdown();
+
+	// .syx files are decoded into BCL, everything else is loaded as text
+	TTaskHandle load(File const &file, TProgressHandler progressHandler, TFinishedHandler finishedHandler);
+
+	// .syx targets are compiled line by line, with a converter of the save's own so no BCR2000 of the UI is used off the message thread.
+	// Everything else is written as text
+	TTaskHandle save(File const &file, String const &document, TProgressHandler progressHandler, TFinishedHandler finishedHandler);
+
+private:
+	class IOJob;
+
+	DocumentIO();
+
+	static Result loadFile(File const &file, Task &task, std::function<void(double)> const &progress);
+	static Result saveFile(File const &file, String const &document, Task &task, std::function<void(double)> const &progress);
+	static bool writeAtomically(File const &file, MemoryBlock const &data, Task &task, std::function<void(double)> const &progress, String &errorMessage);
+
+	ThreadPool pool_;
+	static std::unique_ptr<DocumentIO> instance_;
+};
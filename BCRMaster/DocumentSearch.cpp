@@ -0,0 +1,277 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DocumentSearch.h"
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <regex>
+
+namespace {
+	const int kMaxLineTextLength = 200;
+
+	bool isWordCharacter(wchar_t c) {
+		return std::iswalnum(static_cast<wint_t>(c)) || c == L'_';
+	}
+
+	// CodeDocument::Position counts code points, but on Windows wchar_t is UTF-16 and a character outside the BMP takes two
+	size_t codePoints(std::wstring const &text, size_t from, size_t to) {
+		size_t count = to - from;
+		if (sizeof(wchar_t) == 2) {
+			for (size_t i = from; i < to; i++) {
+				if (text[i] >= 0xDC00 && text[i] <= 0xDFFF) count--;
+			}
+		}
+		return count;
+	}
+
+	std::wstring lowerCase(std::wstring text) {
+		std::transform(text.begin(), text.end(), text.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(static_cast<wint_t>(c))); });
+		return text;
+	}
+
+	std::wregex compile(DocumentSearch::Query const &query) {
+		std::wstring pattern = query.text.toWideCharPointer();
+		if (query.wholeWord) {
+			pattern = L"\\b(?:" + pattern + L")\\b";
+		}
+		auto flags = std::regex_constants::ECMAScript;
+		if (!query.matchCase) {
+			flags |= std::regex_constants::icase;
+		}
+		return std::wregex(pattern, flags);
+	}
+
+	// Finds the query in one line at a time, calling back with the start, length and replacement text of every match
+	class Matcher {
+	public:
+		Matcher(DocumentSearch::Query const &query, String const &replacement) : query_(query), replacement_(replacement.toWideCharPointer()) {
+			if (query.regex) {
+				regex_ = compile(query);
+			}
+			else {
+				needle_ = query.text.toWideCharPointer();
+				if (!query.matchCase) {
+					needle_ = lowerCase(needle_);
+				}
+			}
+		}
+
+		template<typename T>
+		void forEachMatch(std::wstring const &line, bool wantReplacement, T callback) {
+			if (query_.regex) {
+				for (std::wsregex_iterator it(line.begin(), line.end(), regex_), end; it != end; ++it) {
+					// Patterns like a* also match nothing, which is nothing to show or replace
+					if (it->length() == 0) continue;
+					callback(static_cast<size_t>(it->position()), static_cast<size_t>(it->length()), wantReplacement ? it->format(replacement_) : std::wstring());
+				}
+				return;
+			}
+			auto const &haystack = query_.matchCase ? line : (lowered_ = lowerCase(line));
+			size_t start = haystack.find(needle_);
+			while (start != std::wstring::npos) {
+				size_t end = start + needle_.size();
+				bool wordStart = start == 0 || !isWordCharacter(haystack[start - 1]);
+				bool wordEnd = end >= haystack.size() || !isWordCharacter(haystack[end]);
+				if (!query_.wholeWord || (wordStart && wordEnd)) {
+					callback(start, needle_.size(), replacement_);
+					start = haystack.find(needle_, end);
+				}
+				else {
+					start = haystack.find(needle_, start + 1);
+				}
+			}
+		}
+
+	private:
+		DocumentSearch::Query query_;
+		std::wstring replacement_;
+		std::wregex regex_;
+		std::wstring needle_;
+		std::wstring lowered_;
+	};
+}
+
+struct DocumentSearch::Run {
+	Query query;
+	bool replacing;
+	String replacement;
+	std::vector<Document> documents;
+	std::vector<int> order; // Largest documents first, so no thread is left with a big one at the end
+	std::atomic<int> next;
+	std::atomic<int> done;
+	std::atomic<bool> cancelled;
+};
+
+class DocumentSearch::SearchJob : public ThreadPoolJob {
+public:
+	SearchJob(DocumentSearch &search, std::shared_ptr<Run> run) : ThreadPoolJob("Search documents"), search_(search), run_(run) {
+	}
+
+	JobStatus runJob() override {
+		// All jobs pull from the same list of documents
+		Matcher matcher(run_->query, run_->replacement);
+		int i;
+		while (!shouldExit() && !run_->cancelled && (i = run_->next++) < static_cast<int>(run_->order.size())) {
+			auto const &document = run_->documents[run_->order[i]];
+			std::vector<Match> matches;
+			DocumentEdits edits;
+			edits.documentId = document.id;
+			searchDocument(matcher, document, matches, edits);
+			if (!run_->cancelled) {
+				search_.deliver(matches, run_->replacing ? &edits : nullptr);
+			}
+			run_->done++;
+		}
+		return jobHasFinished;
+	}
+
+private:
+	void searchDocument(Matcher &matcher, Document const &document, std::vector<Match> &outMatches, DocumentEdits &outEdits) {
+		Trace::Span span("searchDocument");
+		std::wstring text = document.text.toWideCharPointer();
+		size_t lineStart = 0;
+		size_t linePosition = 0; // lineStart in code points
+		int lineNumber = 0;
+		while (lineStart <= text.size() && !shouldExit()) {
+			auto lineEnd = text.find(L'\n', lineStart);
+			if (lineEnd == std::wstring::npos) lineEnd = text.size();
+			auto contentEnd = lineEnd > lineStart && text[lineEnd - 1] == L'\r' ? lineEnd - 1 : lineEnd;
+			std::wstring line = text.substr(lineStart, contentEnd - lineStart);
+			matcher.forEachMatch(line, run_->replacing, [&](size_t start, size_t length, std::wstring const &replacement) {
+				Match match;
+				match.documentId = document.id;
+				match.line = lineNumber;
+				match.start = static_cast<int>(linePosition + codePoints(line, 0, start));
+				match.length = static_cast<int>(codePoints(line, start, start + length));
+				match.lineText = String(line.c_str()).substring(0, kMaxLineTextLength);
+				outMatches.push_back(match);
+				if (run_->replacing) {
+					outEdits.edits.push_back({ match.start, match.start + match.length, String(replacement.c_str()) });
+				}
+			});
+			linePosition += codePoints(text, lineStart, jmin(lineEnd + 1, text.size()));
+			lineStart = lineEnd + 1;
+			lineNumber++;
+		}
+	}
+
+	DocumentSearch &search_;
+	std::shared_ptr<Run> run_;
+};
+
+DocumentSearch::DocumentSearch() : pool_(jmax(1, SystemStats::getNumCpus() - 1)), numThreads_(jmax(1, SystemStats::getNumCpus() - 1))
+{
+}
+
+DocumentSearch::~DocumentSearch()
+{
+	cancel();
+}
+
+String DocumentSearch::checkQuery(Query const &query)
+{
+	if (query.text.isEmpty()) {
+		return "Nothing to search for";
+	}
+	if (query.regex) {
+		try {
+			compile(query);
+		}
+		catch (std::regex_error const &e) {
+			return "Invalid regular expression: " + String(e.what());
+		}
+	}
+	return {};
+}
+
+String DocumentSearch::search(Query const &query, std::vector<Document> const &documents)
+{
+	auto run = std::make_shared<Run>();
+	run->query = query;
+	run->replacing = false;
+	run->documents = documents;
+	return startRun(run);
+}
+
+String DocumentSearch::replace(Query const &query, String const &replacement, std::vector<Document> const &documents)
+{
+	auto run = std::make_shared<Run>();
+	run->query = query;
+	run->replacing = true;
+	run->replacement = replacement;
+	run->documents = documents;
+	return startRun(run);
+}
+
+String DocumentSearch::startRun(std::shared_ptr<Run> run)
+{
+	cancel();
+	auto error = checkQuery(run->query);
+	if (error.isNotEmpty()) {
+		return error;
+	}
+	run->next = 0;
+	run->done = 0;
+	run->cancelled = false;
+	for (int i = 0; i < static_cast<int>(run->documents.size()); i++) {
+		run->order.push_back(i);
+	}
+	std::sort(run->order.begin(), run->order.end(), [&run](int a, int b) { return run->documents[a].text.length() > run->documents[b].text.length(); });
+	run_ = run;
+	int numJobs = jmin(numThreads_, static_cast<int>(run->documents.size()));
+	for (int i = 0; i < numJobs; i++) {
+		pool_.addJob(new SearchJob(*this, run), true);
+	}
+	return {};
+}
+
+void DocumentSearch::cancel()
+{
+	if (run_) {
+		run_->cancelled = true;
+	}
+	pool_.removeAllJobs(true, 2000);
+	run_.reset();
+	ScopedLock lock(lock_);
+	matches_.clear();
+	edits_.clear();
+}
+
+bool DocumentSearch::isBusy() const
+{
+	return run_ && run_->done < static_cast<int>(run_->documents.size()) && !run_->cancelled;
+}
+
+int DocumentSearch::documentsDone() const
+{
+	return run_ ? run_->done.load() : 0;
+}
+
+void DocumentSearch::deliver(std::vector<Match> &matches, DocumentEdits *edits)
+{
+	ScopedLock lock(lock_);
+	matches_.insert(matches_.end(), std::make_move_iterator(matches.begin()), std::make_move_iterator(matches.end()));
+	if (edits && !edits->edits.empty()) {
+		edits_.push_back(std::move(*edits));
+	}
+}
+
+void DocumentSearch::takeMatches(std::vector<Match> &outMatches)
+{
+	ScopedLock lock(lock_);
+	outMatches.insert(outMatches.end(), std::make_move_iterator(matches_.begin()), std::make_move_iterator(matches_.end()));
+	matches_.clear();
+}
+
+void DocumentSearch::takeEdits(std::vector<DocumentEdits> &outEdits)
+{
+	ScopedLock lock(lock_);
+	outEdits.insert(outEdits.end(), std::make_move_iterator(edits_.begin()), std::make_move_iterator(edits_.end()));
+	edits_.clear();
+}
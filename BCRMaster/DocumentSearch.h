@@ -0,0 +1,82 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+// Find and replace over snapshots of many documents at once. Every document is searched line by line on a pool of worker threads,
+// and matches are collected as each document finishes, so the caller can show them while the rest is still being searched.
+// A replace only computes the edits, applying them to the live documents is up to the caller.
+//
+// Positions are character indexes into the snapshot text, as used by CodeDocument::Position.
+class DocumentSearch {
+public:
+	struct Query {
+		String text;
+		bool regex;
+		bool matchCase;
+		bool wholeWord;
+	};
+
+	struct Document {
+		int id;
+		String text;
+	};
+
+	struct Match {
+		int documentId;
+		int line; // Zero-based
+		int start;
+		int length;
+		String lineText;
+	};
+
+	struct Edit {
+		int start;
+		int end;
+		String replacement;
+	};
+
+	struct DocumentEdits {
+		int documentId;
+		std::vector<Edit> edits; // Sorted by position
+	};
+
+	DocumentSearch();
+	virtual ~DocumentSearch();
+
+	// Starts a new search, stopping any running one. Returns an error message if the query is not usable, e.g. a broken regex.
+	String search(Query const &query, std::vector<Document> const &documents);
+	// Like search, but computes the replacement of every match. In regex mode, $1 etc. in the replacement refer to the groups.
+	String replace(Query const &query, String const &replacement, std::vector<Document> const &documents);
+	void cancel();
+
+	bool isBusy() const;
+	int documentsDone() const;
+
+	// Hand over everything found since the last call
+	void takeMatches(std::vector<Match> &outMatches);
+	void takeEdits(std::vector<DocumentEdits> &outEdits);
+
+	static String checkQuery(Query const &query);
+
+private:
+	struct Run;
+	class SearchJob;
+
+	String startRun(std::shared_ptr<Run> run);
+	void deliver(std::vector<Match> &matches, DocumentEdits *edits);
+
+	ThreadPool pool_;
+	int numThreads_;
+	std::shared_ptr<Run> run_;
+	CriticalSection lock_;
+	std::vector<Match> matches_;
+	std::vector<DocumentEdits> edits_;
+};
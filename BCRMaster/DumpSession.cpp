@@ -0,0 +1,219 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "DumpSession.h"
+
+#include "BCLDecoder.h"
+#include "Trace.h"
+
+#include "Logger.h"
+
+namespace {
+	const int kQueueSize = 4096;
+	const int kDrainIntervalMs = 10;
+	const double kSessionTimeoutMs = 3000.0;
+}
+
+DumpAssembler::DumpAssembler() : state_(State::WaitingForStart)
+{
+}
+
+bool DumpAssembler::addMessage(MidiMessage const &message)
+{
+	if (state_ == State::Finished) {
+		return false;
+	}
+	messages_.push_back(message);
+	state_ = isEndOfDump(message) ? State::Finished : State::Receiving;
+	return state_ == State::Finished;
+}
+
+DumpAssembler::State DumpAssembler::state() const
+{
+	return state_;
+}
+
+bool DumpAssembler::isFinished() const
+{
+	return state_ == State::Finished;
+}
+
+std::vector<MidiMessage> const &DumpAssembler::messages() const
+{
+	return messages_;
+}
+
+bool DumpAssembler::isEndOfDump(MidiMessage const &message)
+{
+	size_t length;
+	auto text = BCLDecoder::bclText(message, length);
+	return text && String(text, length).trim().equalsIgnoreCase("$end");
+}
+
+DumpSessionManager::DumpSessionManager(std::shared_ptr<midikraft::BCR2000> bcr) : bcr_(bcr), handle_(midikraft::MidiController::makeOneHandle()), nextSessionId_(1),
+	fifo_(kQueueSize), buffer_(kQueueSize), overflows_(0), pending_(0), discardingRest_(false), lastDiscarded_(0.0)
+{
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleMessage(source, message);
+	});
+}
+
+DumpSessionManager::~DumpSessionManager()
+{
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+}
+
+int DumpSessionManager::requestDump(int slot, TFinishedHandler whenDone)
+{
+	{
+		// Replies are only accepted from the port the device is currently on
+		SpinLock::ScopedLockType lock(inputNameLock_);
+		inputName_ = String(bcr_->midiInput());
+	}
+	if (sessions_.empty() && !discardingRest_) {
+		// Anything queued now arrived before anybody asked for it
+		discardQueued();
+	}
+	Session session;
+	session.id = nextSessionId_++;
+	session.slot = slot;
+	session.whenDone = whenDone;
+	session.lastActivity = Time::getMillisecondCounterHiRes();
+	session.startTicks = Trace::now();
+	sessions_.push_back(session);
+	pending_ = static_cast<int>(sessions_.size());
+	midikraft::MidiController::instance()->getMidiOutput(bcr_->midiOutput())->sendMessageNow(bcr_->requestDump(slot));
+	startTimer(kDrainIntervalMs);
+	return session.id;
+}
+
+void DumpSessionManager::cancelAll()
+{
+	sessions_.clear();
+	pending_ = 0;
+	discardingRest_ = false;
+	discardQueued();
+	stopTimer();
+}
+
+void DumpSessionManager::discardQueued()
+{
+	// Only the consumer side of the FIFO is touched, so this is safe while the MIDI thread keeps writing
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+	for (int i = start1; i < start1 + size1; i++) buffer_[i] = MidiMessage();
+	for (int i = start2; i < start2 + size2; i++) buffer_[i] = MidiMessage();
+	fifo_.finishedRead(size1 + size2);
+}
+
+int DumpSessionManager::numberOfPendingSessions() const
+{
+	return static_cast<int>(sessions_.size());
+}
+
+void DumpSessionManager::handleMessage(MidiInput *source, MidiMessage const &message)
+{
+	// Called on the MIDI thread. Without a pending session nobody wants dump messages, e.g. preset name refreshes or another unit's traffic.
+	if (pending_.load() == 0) {
+		return;
+	}
+	if (source) {
+		SpinLock::ScopedLockType lock(inputNameLock_);
+		if (inputName_.isEmpty() || source->getName() != inputName_) {
+			return;
+		}
+	}
+	if (!bcr_->isPartOfDump(message)) {
+		return;
+	}
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(1, start1, size1, start2, size2);
+	if (size1 > 0) {
+		buffer_[start1] = message;
+		fifo_.finishedWrite(1);
+	}
+	else {
+		overflows_++;
+	}
+}
+
+void DumpSessionManager::timerCallback()
+{
+	Trace::Span span("dump.assemble");
+	double now = Time::getMillisecondCounterHiRes();
+	int start1, size1, start2, size2;
+	fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+	int consumed = 0;
+	// Handlers are called after the read has finished, they might well request the next dump
+	std::vector<Session> finishedSessions;
+	auto consume = [this, now, &consumed, &finishedSessions](int start, int size) {
+		for (int i = start; i < start + size; i++) {
+			consumed++;
+			if (discardingRest_) {
+				// The rest of a dump whose session is gone, up to and including its $end
+				discardingRest_ = !DumpAssembler::isEndOfDump(buffer_[i]);
+				lastDiscarded_ = now;
+				if (!sessions_.empty()) {
+					sessions_.front().lastActivity = now;
+				}
+				buffer_[i] = MidiMessage();
+				continue;
+			}
+			if (sessions_.empty()) {
+				// Nobody asked for this
+				buffer_[i] = MidiMessage();
+				continue;
+			}
+			auto &session = sessions_.front();
+			session.lastActivity = now;
+			if (session.assembler.addMessage(buffer_[i])) {
+				auto finished = session;
+				Trace::record("dump.retrievePatch", finished.startTicks, Trace::now());
+				sessions_.pop_front();
+				pending_ = static_cast<int>(sessions_.size());
+				if (!sessions_.empty()) {
+					// The next dump starts now
+					sessions_.front().lastActivity = now;
+				}
+				finishedSessions.push_back(finished);
+			}
+			buffer_[i] = MidiMessage();
+		}
+	};
+	consume(start1, size1);
+	consume(start2, size2);
+	fifo_.finishedRead(consumed);
+	for (auto const &finished : finishedSessions) {
+		finished.whenDone(finished.assembler.messages());
+	}
+
+	auto abandonFront = [this, now](String const &reason) {
+		SimpleLogger::instance()->postMessage(reason + String(sessions_.front().slot + 1) + " from the BCR2000");
+		if (sessions_.front().assembler.state() == DumpAssembler::State::Receiving) {
+			// Whatever else of this dump arrives must not end up in the next session
+			discardingRest_ = true;
+			lastDiscarded_ = now;
+		}
+		sessions_.pop_front();
+		pending_ = static_cast<int>(sessions_.size());
+		if (!sessions_.empty()) {
+			sessions_.front().lastActivity = now;
+		}
+	};
+	if (overflows_.exchange(0) > 0 && !sessions_.empty()) {
+		abandonFront("Dump messages arrived faster than they could be processed, lost parts of preset ");
+	}
+	if (!sessions_.empty() && now - sessions_.front().lastActivity > kSessionTimeoutMs) {
+		abandonFront("Timeout waiting for the dump of preset ");
+	}
+	if (discardingRest_ && now - lastDiscarded_ > kSessionTimeoutMs) {
+		// The device stopped sending the abandoned dump
+		discardingRest_ = false;
+	}
+	if (sessions_.empty() && !discardingRest_) {
+		stopTimer();
+	}
+}
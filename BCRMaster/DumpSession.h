@@ -0,0 +1,88 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+#include <atomic>
+#include <deque>
+
+// Collects the messages of one preset dump, knowing with each message in constant time whether the dump is complete
+class DumpAssembler {
+public:
+	enum class State {
+		WaitingForStart,
+		Receiving,
+		Finished
+	};
+
+	DumpAssembler();
+
+	// Returns true when this message completed the dump
+	bool addMessage(MidiMessage const &message);
+
+	State state() const;
+	bool isFinished() const;
+	std::vector<MidiMessage> const &messages() const;
+
+	static bool isEndOfDump(MidiMessage const &message);
+
+private:
+	State state_;
+	std::vector<MidiMessage> messages_;
+};
+
+// Runs any number of dump requests to one device at the same time, each in its own session.
+// The device answers requests in order, so incoming messages always belong to the oldest unfinished session.
+// Messages are handed from the MIDI thread to the message thread through a lock-free FIFO, drained in batches by a timer.
+// Nothing is queued while no session is pending, and whatever is still queued when a session starts from idle is thrown away.
+// When a session times out in the middle of its dump, the rest of that dump is thrown away instead of being given to the next session.
+// A dump that never started can't be told apart from the answer to the next request, so then the next session takes what comes.
+class DumpSessionManager : private Timer {
+public:
+	typedef std::function<void(std::vector<MidiMessage> const &)> TFinishedHandler;
+
+	explicit DumpSessionManager(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~DumpSessionManager();
+
+	// Sends the dump request right away, whenDone is called on the message thread. Returns the session id.
+	int requestDump(int slot, TFinishedHandler whenDone);
+	void cancelAll();
+	int numberOfPendingSessions() const;
+
+private:
+	struct Session {
+		int id;
+		int slot;
+		DumpAssembler assembler;
+		TFinishedHandler whenDone;
+		double lastActivity;
+		int64 startTicks;
+	};
+
+	void handleMessage(MidiInput *source, MidiMessage const &message);
+	void timerCallback() override;
+	void discardQueued();
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	midikraft::MidiController::HandlerHandle handle_;
+	SpinLock inputNameLock_;
+	String inputName_;
+	std::deque<Session> sessions_;
+	int nextSessionId_;
+
+	// Single producer (MIDI thread) single consumer (message thread) queue
+	AbstractFifo fifo_;
+	std::vector<MidiMessage> buffer_;
+	std::atomic<int> overflows_;
+	std::atomic<int> pending_; // Number of sessions, read by the MIDI thread
+	bool discardingRest_; // The rest of a timed out dump is still coming in
+	double lastDiscarded_;
+};
@@ -0,0 +1,258 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "FastAutoDetection.h"
+
+#include "Logger.h"
+#include "Settings.h"
+
+#include <algorithm>
+
+namespace {
+	const char *kLastInput = "LastBCRInput";
+	const char *kLastOutput = "LastBCROutput";
+
+	// The BCR2000 answers the identity request within a few milliseconds, these leave room for busy USB hubs
+	const int kBroadcastTimeoutMs = 500;
+	const int kVerifyTimeoutMs = 250;
+
+	int commonPrefixLength(String const &a, String const &b) {
+		int i = 0;
+		while (i < a.length() && i < b.length() && CharacterFunctions::toLowerCase(a[i]) == CharacterFunctions::toLowerCase(b[i])) i++;
+		return i;
+	}
+}
+
+FastAutoDetection::FastAutoDetection(std::shared_ptr<midikraft::BCR2000> bcr) : Thread("FastAutoDetection"), bcr_(bcr),
+	handle_(midikraft::MidiController::makeOneHandle()), listening_(false), tryLastKnownFirst_(true)
+{
+	// Registered once for the lifetime, replies only count while a probe listens for them
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleMessage(source, message);
+	});
+}
+
+FastAutoDetection::~FastAutoDetection()
+{
+	stopThread(2 * kBroadcastTimeoutMs);
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+}
+
+void FastAutoDetection::detect(bool tryLastKnownFirst, std::function<void(bool found)> whenDone)
+{
+	if (isThreadRunning()) {
+		return;
+	}
+	tryLastKnownFirst_ = tryLastKnownFirst;
+	whenDone_ = whenDone;
+	lastInput_ = Settings::instance().get(kLastInput, "");
+	lastOutput_ = Settings::instance().get(kLastOutput, "");
+	inputs_ = MidiInput::getDevices();
+	outputs_ = MidiOutput::getDevices();
+	probes_ = bcr_->deviceDetect(0);
+	// Opening the ports changes the MidiController, that stays on the message thread
+	for (auto const &input : inputs_) {
+		midikraft::MidiController::instance()->enableMidiInput(input.toStdString());
+	}
+	for (auto const &output : outputs_) {
+		midikraft::MidiController::instance()->getMidiOutput(output.toStdString());
+	}
+	startThread();
+}
+
+bool FastAutoDetection::isBusy() const
+{
+	return isThreadRunning();
+}
+
+void FastAutoDetection::run()
+{
+	double startTime = Time::getMillisecondCounterHiRes();
+	bool found = false;
+	std::vector<Connection> connections;
+	if (tryLastKnownFirst_ && tryLastKnown(connections)) {
+		found = true;
+		SimpleLogger::instance()->postMessage("BCR2000 found on its last known ports " + String(connections.front().input) + " / " + String(connections.front().output)
+			+ " in " + String(Time::getMillisecondCounterHiRes() - startTime, 0) + " ms");
+	}
+	else if (!threadShouldExit()) {
+		connections = probeAll();
+		found = !connections.empty();
+		SimpleLogger::instance()->postMessage("Probed all MIDI ports in " + String(Time::getMillisecondCounterHiRes() - startTime, 0) + " ms, found "
+			+ String(connections.size()) + " BCR2000" + (found ? ", using " + String(connections.front().input) + " / " + String(connections.front().output) : String()));
+	}
+	{
+		ScopedLock lock(lock_);
+		connections_ = connections;
+	}
+	if (!threadShouldExit()) {
+		// The BCR2000 is shared with the whole UI, it is only changed on the message thread
+		auto bcr = bcr_;
+		auto whenDone = whenDone_;
+		MessageManager::callAsync([bcr, connections, whenDone, found]() {
+			if (found) {
+				use(*bcr, connections.front());
+			}
+			if (whenDone) {
+				whenDone(found);
+			}
+		});
+	}
+}
+
+std::vector<FastAutoDetection::Connection> FastAutoDetection::connections() const
+{
+	ScopedLock lock(lock_);
+	return connections_;
+}
+
+bool FastAutoDetection::tryLastKnown(std::vector<Connection> &outFound)
+{
+	String input = lastInput_;
+	String output = lastOutput_;
+	if (input.isEmpty() || output.isEmpty() || !inputs_.contains(input) || !outputs_.contains(output)) {
+		return false;
+	}
+	auto replies = probe(StringArray(output), kVerifyTimeoutMs, input.toStdString());
+	auto found = replies.find(input.toStdString());
+	if (found == replies.end()) {
+		return false;
+	}
+	outFound.push_back({ input.toStdString(), output.toStdString(), found->second });
+	return true;
+}
+
+std::vector<FastAutoDetection::Connection> FastAutoDetection::probeAll()
+{
+	auto outputs = outputs_;
+	std::vector<Connection> result;
+	auto replies = probe(outputs, kBroadcastTimeoutMs);
+	for (auto const &reply : replies) {
+		if (threadShouldExit()) break;
+		std::string output;
+		if (findOutputFor(reply.first, outputs, output)) {
+			result.push_back({ reply.first, output, reply.second });
+		}
+	}
+	return result;
+}
+
+bool FastAutoDetection::findOutputFor(std::string const &input, StringArray const &outputs, std::string &outOutput)
+{
+	// USB devices mostly use the same or a very similar name for both directions, so try the most similar output first
+	String inputName(input);
+	String bestGuess;
+	int bestLength = 0;
+	for (auto const &output : outputs) {
+		int length = commonPrefixLength(inputName, output);
+		if (length > bestLength) {
+			bestLength = length;
+			bestGuess = output;
+		}
+	}
+	if (bestGuess.isNotEmpty() && probe(StringArray(bestGuess), kVerifyTimeoutMs, input).count(input)) {
+		outOutput = bestGuess.toStdString();
+		return true;
+	}
+
+	// Otherwise halve the candidates until one is left, that needs log2(n) rounds instead of n
+	StringArray candidates(outputs);
+	candidates.removeString(bestGuess);
+	while (candidates.size() > 1 && !threadShouldExit()) {
+		StringArray firstHalf;
+		for (int i = 0; i < candidates.size() / 2; i++) {
+			firstHalf.add(candidates[i]);
+		}
+		if (probe(firstHalf, kVerifyTimeoutMs, input).count(input)) {
+			candidates = firstHalf;
+		}
+		else {
+			candidates.removeRange(0, firstHalf.size());
+		}
+	}
+	if (candidates.size() == 1 && probe(candidates, kVerifyTimeoutMs, input).count(input)) {
+		outOutput = candidates[0].toStdString();
+		return true;
+	}
+	return false;
+}
+
+std::map<std::string, midikraft::MidiChannel> FastAutoDetection::probe(StringArray const &outputs, int timeoutMs, std::string const &expectedInput)
+{
+	{
+		ScopedLock lock(lock_);
+		replies_.clear();
+		listening_ = true;
+	}
+	replyArrived_.reset();
+
+	// Sent from the message thread, the ports belong to it. The deadline only starts when the requests are out
+	auto sent = std::make_shared<WaitableEvent>();
+	auto probes = probes_;
+	MessageManager::callAsync([outputs, probes, sent]() {
+		for (auto const &output : outputs) {
+			auto midiOutput = midikraft::MidiController::instance()->getMidiOutput(output.toStdString());
+			if (midiOutput) {
+				for (auto const &message : probes) {
+					midiOutput->sendMessageNow(message);
+				}
+			}
+		}
+		sent->signal();
+	});
+	// The message thread might be waiting for this thread to exit instead of sending
+	while (!sent->wait(10) && !threadShouldExit()) {
+	}
+
+	// Every port had its request sent at the same time, so one deadline serves them all
+	double deadline = Time::getMillisecondCounterHiRes() + timeoutMs;
+	while (!threadShouldExit()) {
+		double remaining = deadline - Time::getMillisecondCounterHiRes();
+		if (remaining <= 0.0) break;
+		replyArrived_.wait(static_cast<int>(remaining) + 1);
+		if (!expectedInput.empty()) {
+			ScopedLock lock(lock_);
+			if (replies_.count(expectedInput)) break;
+		}
+	}
+	ScopedLock lock(lock_);
+	listening_ = false;
+	return replies_;
+}
+
+void FastAutoDetection::handleMessage(MidiInput *source, MidiMessage const &message)
+{
+	if (!source || !midikraft::BCR2000::isSysexFromBCR2000(message)) {
+		return;
+	}
+	auto channel = bcr_->channelIfValidDeviceResponse(message);
+	if (channel.isValid()) {
+		ScopedLock lock(lock_);
+		if (!listening_) {
+			return;
+		}
+		auto name = source->getName().toStdString();
+		// No operator[], MidiChannel has no default constructor
+		replies_.erase(name);
+		replies_.insert(std::make_pair(name, channel));
+		replyArrived_.signal();
+	}
+}
+
+void FastAutoDetection::configure(midikraft::BCR2000 &bcr, Connection const &connection)
+{
+	bcr.setInput(connection.input);
+	bcr.setOutput(connection.output);
+	bcr.setChannel(connection.channel);
+	bcr.setWasDetected(true);
+}
+
+void FastAutoDetection::use(midikraft::BCR2000 &bcr, Connection const &connection)
+{
+	configure(bcr, connection);
+	Settings::instance().set(kLastInput, connection.input);
+	Settings::instance().set(kLastOutput, connection.output);
+}
@@ -0,0 +1,72 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+#include <map>
+
+// Finds the MIDI ports of a BCR2000 in the background. The identity request is sent to all outputs at once, and only
+// for the inputs that answered the matching output is searched: first by port name, then by halving the set of outputs
+// the request is sent to. Without any reply this takes one timeout instead of one per port.
+// The last working port pair is remembered in the Settings and tried first on the next start.
+// Probing all ports finds any number of BCR2000s, the first one found configures the BCR2000 given, connections() lists all.
+// The detection thread only waits for replies. Opening the ports, sending the requests, configuring the BCR2000 and writing
+// the Settings all happen on the message thread.
+class FastAutoDetection : private Thread {
+public:
+	struct Connection {
+		std::string input;
+		std::string output;
+		midikraft::MidiChannel channel;
+	};
+
+	explicit FastAutoDetection(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~FastAutoDetection();
+
+	// Call on the message thread. Runs the detection in the background, then configures the BCR2000 with the first device found
+	// and calls whenDone, both on the message thread, with true if a device was found.
+	void detect(bool tryLastKnownFirst, std::function<void(bool found)> whenDone);
+	bool isBusy() const;
+
+	// All devices found by the last detection
+	std::vector<Connection> connections() const;
+
+	static void configure(midikraft::BCR2000 &bcr, Connection const &connection);
+
+private:
+	void run() override;
+	bool tryLastKnown(std::vector<Connection> &outFound);
+	std::vector<Connection> probeAll();
+
+	// Sends the identity request to the outputs, and returns the inputs that replied with the channel they reported.
+	// Returns early as soon as the expected input replied, if one is given.
+	std::map<std::string, midikraft::MidiChannel> probe(StringArray const &outputs, int timeoutMs, std::string const &expectedInput = "");
+	bool findOutputFor(std::string const &input, StringArray const &outputs, std::string &outOutput);
+	static void use(midikraft::BCR2000 &bcr, Connection const &connection);
+	void handleMessage(MidiInput *source, MidiMessage const &message);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	midikraft::MidiController::HandlerHandle handle_;
+	mutable CriticalSection lock_;
+	bool listening_;
+	std::map<std::string, midikraft::MidiChannel> replies_;
+	std::vector<Connection> connections_;
+	WaitableEvent replyArrived_;
+
+	// Set up on the message thread before the detection thread starts
+	bool tryLastKnownFirst_;
+	String lastInput_;
+	String lastOutput_;
+	StringArray inputs_;
+	StringArray outputs_;
+	std::vector<MidiMessage> probes_;
+	std::function<void(bool)> whenDone_;
+};
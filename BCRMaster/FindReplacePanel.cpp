@@ -0,0 +1,229 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "FindReplacePanel.h"
+
+#include "Logger.h"
+
+#include <algorithm>
+
+namespace {
+	const int kRefreshHz = 10;
+	// More rows don't help anybody, the status line still counts all matches
+	const size_t kMaxRows = 5000;
+}
+
+template <>
+void visit(FindReplacePanel::Row const &row, int column, std::function<void(std::string const &)> visitor) {
+	switch (column) {
+	case 1: visitor(row.tabName.toStdString()); break;
+	case 2: visitor(String(row.match.line + 1).toStdString()); break;
+	case 3: visitor(row.match.lineText.trim().toStdString()); break;
+	}
+}
+
+FindReplacePanel::FindReplacePanel(TTabProvider tabProvider, TShowHandler showHandler) : tabProvider_(tabProvider), showHandler_(showHandler),
+	replacing_(false), startTime_(0.0), totalMatches_(0), tableDirty_(false),
+	results_({ "Tab", "Line", "Text" }, {}, [this](int rowSelected) { showRow(rowSelected); })
+{
+	find_.setTextToShowWhenEmpty("Find, e.g. .easypar CC 1 7", Colours::grey);
+	find_.onReturnKey = [this]() { find(); };
+	addAndMakeVisible(find_);
+	replace_.setTextToShowWhenEmpty("Replace with", Colours::grey);
+	addAndMakeVisible(replace_);
+
+	regex_.setButtonText("Regular expression");
+	addAndMakeVisible(regex_);
+	matchCase_.setButtonText("Match case");
+	addAndMakeVisible(matchCase_);
+	wholeWord_.setButtonText("Whole words");
+	addAndMakeVisible(wholeWord_);
+
+	findButton_.setButtonText("Find all");
+	findButton_.onClick = [this]() { find(); };
+	addAndMakeVisible(findButton_);
+	replaceButton_.setButtonText("Replace all");
+	replaceButton_.onClick = [this]() { replaceAll(); };
+	addAndMakeVisible(replaceButton_);
+
+	addAndMakeVisible(status_);
+	addAndMakeVisible(results_);
+	setSize(900, 600);
+}
+
+FindReplacePanel::~FindReplacePanel()
+{
+	stopTimer();
+	search_.cancel();
+}
+
+void FindReplacePanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto findRow = area.removeFromTop(28);
+	findButton_.setBounds(findRow.removeFromRight(120));
+	findRow.removeFromRight(8);
+	find_.setBounds(findRow);
+	area.removeFromTop(8);
+	auto replaceRow = area.removeFromTop(28);
+	replaceButton_.setBounds(replaceRow.removeFromRight(120));
+	replaceRow.removeFromRight(8);
+	replace_.setBounds(replaceRow);
+	area.removeFromTop(8);
+	auto options = area.removeFromTop(24);
+	regex_.setBounds(options.removeFromLeft(180));
+	matchCase_.setBounds(options.removeFromLeft(140));
+	wholeWord_.setBounds(options.removeFromLeft(140));
+	status_.setBounds(area.removeFromBottom(24));
+	area.removeFromTop(8);
+	results_.setBounds(area);
+}
+
+DocumentSearch::Query FindReplacePanel::query() const
+{
+	DocumentSearch::Query result;
+	result.text = find_.getText();
+	result.regex = regex_.getToggleState();
+	result.matchCase = matchCase_.getToggleState();
+	result.wholeWord = wholeWord_.getToggleState();
+	return result;
+}
+
+std::vector<DocumentSearch::Document> FindReplacePanel::snapshot()
+{
+	tabs_ = tabProvider_();
+	editCounts_.clear();
+	std::vector<DocumentSearch::Document> documents;
+	for (int i = 0; i < static_cast<int>(tabs_.size()); i++) {
+		editCounts_.push_back(tabs_[i].editor ? tabs_[i].editor->editCount() : -1);
+		if (tabs_[i].editor) {
+			documents.push_back({ i, tabs_[i].editor->documentText() });
+		}
+	}
+	rows_.clear();
+	totalMatches_ = 0;
+	tableDirty_ = true;
+	return documents;
+}
+
+void FindReplacePanel::find()
+{
+	// Checked before anything is reset, so the results of the last search stay and the error stays visible
+	auto error = DocumentSearch::checkQuery(query());
+	if (error.isNotEmpty()) {
+		status_.setText(error, dontSendNotification);
+		return;
+	}
+	replacing_ = false;
+	startTime_ = Time::getMillisecondCounterHiRes();
+	search_.search(query(), snapshot());
+	status_.setText("Searching " + String(tabs_.size()) + " tabs...", dontSendNotification);
+	startTimerHz(kRefreshHz);
+}
+
+void FindReplacePanel::replaceAll()
+{
+	auto error = DocumentSearch::checkQuery(query());
+	if (error.isNotEmpty()) {
+		status_.setText(error, dontSendNotification);
+		return;
+	}
+	replacing_ = true;
+	startTime_ = Time::getMillisecondCounterHiRes();
+	search_.replace(query(), replace_.getText(), snapshot());
+	status_.setText("Computing replacements in " + String(tabs_.size()) + " tabs...", dontSendNotification);
+	startTimerHz(kRefreshHz);
+}
+
+void FindReplacePanel::timerCallback()
+{
+	// Ask before taking the matches, a document that finished in between would otherwise be left behind after the last tick
+	bool busy = search_.isBusy();
+	std::vector<DocumentSearch::Match> matches;
+	search_.takeMatches(matches);
+	totalMatches_ += matches.size();
+	if (!matches.empty()) {
+		for (auto const &match : matches) {
+			rows_.push_back({ tabs_[match.documentId].name, match });
+		}
+		// Matches arrive in the order the documents finish, keep the first ones by tab and position so the rows shown don't depend on timing
+		std::stable_sort(rows_.begin(), rows_.end(), [](Row const &a, Row const &b) {
+			return a.match.documentId != b.match.documentId ? a.match.documentId < b.match.documentId : a.match.start < b.match.start;
+		});
+		if (rows_.size() > kMaxRows) {
+			rows_.resize(kMaxRows);
+		}
+		tableDirty_ = true;
+	}
+
+	if (busy) {
+		status_.setText("Searched " + String(search_.documentsDone()) + " of " + String(tabs_.size()) + " tabs, " + String(static_cast<int64>(totalMatches_)) + " matches so far", dontSendNotification);
+	}
+	else {
+		stopTimer();
+		if (replacing_) {
+			applyEdits();
+		}
+		else {
+			status_.setText(String(static_cast<int64>(totalMatches_)) + " matches in " + String(tabs_.size()) + " tabs, " + String(Time::getMillisecondCounterHiRes() - startTime_, 0) + " ms"
+				+ (totalMatches_ > kMaxRows ? ", first " + String(static_cast<int64>(kMaxRows)) + " shown" : String()), dontSendNotification);
+		}
+	}
+	if (tableDirty_) {
+		results_.updateData(rows_);
+		tableDirty_ = false;
+	}
+}
+
+void FindReplacePanel::applyEdits()
+{
+	std::vector<DocumentSearch::DocumentEdits> edits;
+	search_.takeEdits(edits);
+	int replaced = 0;
+	int tabsChanged = 0;
+	StringArray skipped;
+	for (auto const &documentEdits : edits) {
+		auto const &tab = tabs_[documentEdits.documentId];
+		if (!tab.editor) {
+			continue;
+		}
+		if (tab.editor->applyEdits(documentEdits.edits, editCounts_[documentEdits.documentId])) {
+			replaced += static_cast<int>(documentEdits.edits.size());
+			tabsChanged++;
+		}
+		else {
+			skipped.add(tab.name);
+		}
+	}
+	String message = "Replaced " + String(replaced) + " matches in " + String(tabsChanged) + " tabs";
+	if (!skipped.isEmpty()) {
+		message += ", skipped " + skipped.joinIntoString(", ") + " because they were edited meanwhile";
+	}
+	status_.setText(message, dontSendNotification);
+	SimpleLogger::instance()->postMessage(message);
+	// The matches shown are outdated now
+	rows_.clear();
+	tableDirty_ = true;
+	replacing_ = false;
+}
+
+void FindReplacePanel::showRow(int row)
+{
+	if (row < 0 || row >= static_cast<int>(rows_.size())) {
+		return;
+	}
+	auto const &match = rows_[row].match;
+	auto editor = tabs_[match.documentId].editor;
+	if (editor) {
+		showHandler_(editor.getComponent());
+		if (editor->editCount() == editCounts_[match.documentId]) {
+			editor->selectRange(match.start, match.start + match.length);
+		}
+		else {
+			editor->jumpToLine(match.line);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCLEditor.h"
+#include "DocumentSearch.h"
+#include "SimpleTable.h"
+
+// Find and replace in all open tabs at once. The documents are copied when a search starts and searched in the background,
+// matches appear in the table as the documents finish. Replace all changes every tab in one undoable step, but leaves
+// tabs alone that were edited while the replacements were computed.
+class FindReplacePanel : public Component,
+	private Timer
+{
+public:
+	struct Tab {
+		Component::SafePointer<BCLEditor> editor;
+		String name;
+	};
+
+	struct Row {
+		String tabName;
+		DocumentSearch::Match match;
+	};
+
+	typedef std::function<std::vector<Tab>()> TTabProvider;
+	typedef std::function<void(BCLEditor *)> TShowHandler;
+
+	FindReplacePanel(TTabProvider tabProvider, TShowHandler showHandler);
+	virtual ~FindReplacePanel();
+
+	void resized() override;
+
+private:
+	void timerCallback() override;
+	void find();
+	void replaceAll();
+	std::vector<DocumentSearch::Document> snapshot();
+	DocumentSearch::Query query() const;
+	void applyEdits();
+	void showRow(int row);
+
+	TTabProvider tabProvider_;
+	TShowHandler showHandler_;
+	DocumentSearch search_;
+	bool replacing_;
+	double startTime_;
+
+	// The tabs of the current search, document ids are indexes into these
+	std::vector<Tab> tabs_;
+	std::vector<int> editCounts_;
+	std::vector<Row> rows_;
+	size_t totalMatches_;
+	bool tableDirty_;
+
+	TextEditor find_;
+	TextEditor replace_;
+	ToggleButton regex_;
+	ToggleButton matchCase_;
+	ToggleButton wholeWord_;
+	TextButton findButton_;
+	TextButton replaceButton_;
+	Label status_;
+	SimpleTable<std::vector<Row>> results_;
+};
@@ -0,0 +1,153 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "LibrarySearchPanel.h"
+
+#include "Settings.h"
+
+namespace {
+	const char *kLibraryDirectories = "PresetLibraryDirectories";
+	const size_t kMaxResults = 500;
+}
+
+template <>
+void visit(PresetLibrary::Match const &match, int column, std::function<void(std::string const &)> visitor) {
+	switch (column) {
+	case 1: visitor(match.presetNames.toStdString()); break;
+	case 2: visitor(match.matchingElements.toStdString()); break;
+	case 3: visitor(match.path.toStdString()); break;
+	}
+}
+
+class LibrarySearchPanel::IndexThread : public Thread {
+public:
+	IndexThread(LibrarySearchPanel *panel, PresetLibrary &library, StringArray const &directories) : Thread("IndexPresetLibrary"),
+		panel_(panel), library_(library), directories_(directories)
+	{
+	}
+
+	void run() override {
+		auto statistics = library_.refresh(directories_, [this](double progress) {
+			showStatus("Indexing... " + String(roundToInt(progress * 100.0)) + "%", false);
+		}, [this]() { return threadShouldExit(); });
+		if (!threadShouldExit()) {
+			showStatus(String(statistics.files) + " files in library, " + String(statistics.parsed) + " read in " + String(statistics.seconds, 2) + " s", true);
+		}
+	}
+
+private:
+	void showStatus(String const &text, bool finished) {
+		Component::SafePointer<LibrarySearchPanel> panel(panel_);
+		MessageManager::callAsync([panel, text, finished]() {
+			if (panel) {
+				if (finished) {
+					panel->runQuery();
+				}
+				panel->statusLabel_.setText(text, dontSendNotification);
+			}
+		});
+	}
+
+	LibrarySearchPanel *panel_;
+	PresetLibrary &library_;
+	StringArray directories_;
+};
+
+LibrarySearchPanel::LibrarySearchPanel(PresetLibrary &library, TOpenHandler openHandler) : library_(library), openHandler_(openHandler),
+	resultTable_({ "Preset", "Matching elements", "File" }, {}, [this](int rowSelected) {
+		if (rowSelected >= 0 && rowSelected < static_cast<int>(results_.size())) {
+			openHandler_(File(results_[rowSelected].path));
+		}
+	})
+{
+	query_.setTextToShowWhenEmpty("Search, e.g. bass encoder12/nrpn0x40", Colours::grey);
+	query_.addListener(this);
+	addAndMakeVisible(query_);
+
+	addFolderButton_.setButtonText("Add folder...");
+	addFolderButton_.onClick = [this]() { addFolder(); };
+	addAndMakeVisible(addFolderButton_);
+
+	rescanButton_.setButtonText("Rescan");
+	rescanButton_.onClick = [this]() { rescan(); };
+	addAndMakeVisible(rescanButton_);
+
+	addAndMakeVisible(statusLabel_);
+	addAndMakeVisible(resultTable_);
+
+	if (library_.size() == 0) {
+		library_.load();
+	}
+	runQuery();
+	rescan();
+	setSize(900, 600);
+}
+
+LibrarySearchPanel::~LibrarySearchPanel()
+{
+	if (indexThread_) {
+		indexThread_->stopThread(5000);
+	}
+}
+
+void LibrarySearchPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto top = area.removeFromTop(28);
+	rescanButton_.setBounds(top.removeFromRight(100));
+	addFolderButton_.setBounds(top.removeFromRight(120).withTrimmedRight(8));
+	query_.setBounds(top.withTrimmedRight(8));
+	statusLabel_.setBounds(area.removeFromBottom(24));
+	resultTable_.setBounds(area.withTrimmedTop(8));
+}
+
+StringArray LibrarySearchPanel::libraryDirectories()
+{
+	return StringArray::fromTokens(String(Settings::instance().get(kLibraryDirectories, "")), ";", "");
+}
+
+void LibrarySearchPanel::textEditorTextChanged(TextEditor &)
+{
+	runQuery();
+}
+
+void LibrarySearchPanel::runQuery()
+{
+	double startTime = Time::getMillisecondCounterHiRes();
+	results_ = library_.search(query_.getText(), kMaxResults);
+	resultTable_.updateData(results_);
+	if (!indexThread_ || !indexThread_->isThreadRunning()) {
+		statusLabel_.setText(String(results_.size()) + " of " + String(library_.size()) + " files shown, query took "
+			+ String(Time::getMillisecondCounterHiRes() - startTime, 1) + " ms", dontSendNotification);
+	}
+}
+
+void LibrarySearchPanel::addFolder()
+{
+	FileChooser chooser("Select a folder with BCR2000 presets to add to the library...", File::getSpecialLocation(File::userDocumentsDirectory));
+	if (chooser.browseForDirectory()) {
+		auto directories = libraryDirectories();
+		directories.addIfNotAlreadyThere(chooser.getResult().getFullPathName());
+		directories.removeEmptyStrings();
+		Settings::instance().set(kLibraryDirectories, directories.joinIntoString(";").toStdString());
+		rescan();
+	}
+}
+
+void LibrarySearchPanel::rescan()
+{
+	auto directories = libraryDirectories();
+	directories.removeEmptyStrings();
+	if (directories.isEmpty()) {
+		statusLabel_.setText("No folders in the library yet, use Add folder... to add some", dontSendNotification);
+		return;
+	}
+	if (indexThread_) {
+		indexThread_->stopThread(5000);
+	}
+	indexThread_ = std::make_unique<IndexThread>(this, library_, directories);
+	indexThread_->startThread();
+}
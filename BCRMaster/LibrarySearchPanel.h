@@ -0,0 +1,46 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "PresetLibrary.h"
+#include "SimpleTable.h"
+
+// Search field over the PresetLibrary, results update with every keystroke. The index is brought up to date
+// in the background whenever the panel is opened or a folder is added, selecting a result opens the file.
+class LibrarySearchPanel : public Component,
+	private TextEditor::Listener
+{
+public:
+	typedef std::function<void(File const &)> TOpenHandler;
+
+	LibrarySearchPanel(PresetLibrary &library, TOpenHandler openHandler);
+	virtual ~LibrarySearchPanel();
+
+	void resized() override;
+
+	static StringArray libraryDirectories();
+
+private:
+	class IndexThread;
+
+	void textEditorTextChanged(TextEditor &editor) override;
+	void runQuery();
+	void addFolder();
+	void rescan();
+
+	PresetLibrary &library_;
+	TOpenHandler openHandler_;
+	std::vector<PresetLibrary::Match> results_;
+	TextEditor query_;
+	TextButton addFolderButton_;
+	TextButton rescanButton_;
+	Label statusLabel_;
+	SimpleTable<std::vector<PresetLibrary::Match>> resultTable_;
+	std::unique_ptr<IndexThread> indexThread_;
+};
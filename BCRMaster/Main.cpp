@@ -7,10 +7,15 @@
 #include "JuceHeader.h"
 
 #include "MainComponent.h"
+#include "BatchConverter.h"
+#include "PresetArchive.h"
+#include "BCR2000Emulator.h"
+#include "DocumentIO.h"
 
 #include "Settings.h"
 
 #include <memory>
+#include <iostream>
 
 //==============================================================================
 class BCRMasterApplication  : public JUCEApplication
@@ -29,6 +34,36 @@ public:
         // This method is where you should put your application's initialization code..
 		Settings::setSettingsID("BCRMaster");
 
+		// Headless modes run without ever creating the main window
+		if (BatchConverter::isBatchCommandLine(commandLine)) {
+			setApplicationReturnValue(BatchConverter::runFromCommandLine(commandLine));
+			quit();
+			return;
+		}
+		if (PresetArchive::isArchiveCommandLine(commandLine)) {
+			setApplicationReturnValue(PresetArchive::runFromCommandLine(commandLine));
+			quit();
+			return;
+		}
+		if (BCR2000Emulator::isEmulatorCommandLine(commandLine)) {
+			File presetDirectory;
+			auto options = BCR2000Emulator::optionsFromCommandLine(commandLine, presetDirectory);
+			emulator = std::make_unique<BCR2000Emulator>();
+			if (presetDirectory.isDirectory()) {
+				emulator->loadPresetsFromDirectory(presetDirectory);
+			}
+			if (emulator->start(options)) {
+				std::cout << "Emulating a BCR2000 on MIDI port '" << options.portName << "', latency " << options.latencyMs << " ms, "
+					<< (options.baudRate > 0 ? String(options.baudRate) + " baud" : String("unlimited speed")) << std::endl;
+			}
+			else {
+				std::cerr << "Could not create virtual MIDI ports, this platform might not support them" << std::endl;
+				setApplicationReturnValue(1);
+				quit();
+			}
+			return;
+		}
+
         mainWindow = std::make_unique<MainWindow> (getApplicationName());
     }
 
@@ -37,6 +72,8 @@ public:
         // Add your application's shutdown code here..
 
         mainWindow = nullptr; // (deletes our window)
+		emulator = nullptr;
+		DocumentIO::shutdown();
     }
 
     //==============================================================================
@@ -101,6 +138,7 @@ public:
 
 private:
     std::unique_ptr<MainWindow> mainWindow;
+	std::unique_ptr<BCR2000Emulator> emulator;
 };
 
 //==============================================================================
@@ -11,26 +11,54 @@
 
 #include "HorizontalLayoutContainer.h"
 
+#include "DeviceBackup.h"
+#include "LibrarySearchPanel.h"
+#include "DiagnosticsPanel.h"
+#include "Trace.h"
+#include "RoutingPanel.h"
+#include "FindReplacePanel.h"
+#include "UnitUploadPanel.h"
+#include "MirrorSyncPanel.h"
+#include "ArchivePickerPanel.h"
+
+class BackupProgressWindow : public ThreadWithProgressWindow {
+public:
+	BackupProgressWindow(DeviceBackup &backup) : ThreadWithProgressWindow("Downloading all presets from the BCR2000...", true, true), backup_(backup), success_(false) {
+	}
+
+	void run() override {
+		success_ = backup_.downloadAll([this](double progress) { setProgress(progress); }, [this]() { return threadShouldExit(); });
+	}
+
+	bool success() const { return success_; }
+
+private:
+	DeviceBackup &backup_;
+	bool success_;
+};
+
 //==============================================================================
-MainComponent::MainComponent() : bcr_(std::make_shared<midikraft::BCR2000>()),
+MainComponent::MainComponent() : bcr_(std::make_shared<midikraft::BCR2000>()), detection_(bcr_),
 	tabs_(TabbedButtonBar::Orientation::TabsAtTop),
-	grid_(4, 8, [this](int no) { retrievePatch(no); }),
+	grid_(4, 8, [this](int no) { retrievePatch(0, no); }),
+	gridTabs_(TabbedButtonBar::Orientation::TabsAtTop),
 	resizerBar_(&stretchableManager_, 1, false),
-	logArea_(new HorizontalLayoutContainer(&logView_, &midiLogView_, -0.5, 0.5), BorderSize<int>(8)),
-	topArea_(new HorizontalLayoutContainer(&tabs_, &grid_, -0.7, -0.3), BorderSize<int>(8)),
+	devices_(bcr_), pendingRefreshes_(0), router_(bcr_),
+	logArea_(new HorizontalLayoutContainer(&logView_, &midiLogPanel_, -0.5, 0.5), BorderSize<int>(8)),
+	topArea_(new HorizontalLayoutContainer(&tabs_, &gridTabs_, -0.7, -0.3), BorderSize<int>(8)),
 	buttons_(301, LambdaButtonStrip::Direction::Horizontal)
 {
 	LambdaButtonStrip::TButtonMap buttons = {
 	{ "Detect", {0, "Detect", [this]() {
-		detectBCR();
+		detectBCR(false);
 	}, 0x44 /* D */, ModifierKeys::ctrlModifier}},
 	{ "Refresh preset list", {1, "Refresh preset list", [this]() {
 		refreshFromBCR();
 	}, 0x52 /* R */, ModifierKeys::ctrlModifier}},
 	{ "Open", { 2, "Open", [this]() {
 		auto active = createNewEditor("New");
-		if (active->loadDocument()) {
-			File loaded(active->currentFileName());
+		File loaded;
+		if (active->loadDocument(loaded)) {
 			addNewEditor(loaded.getFileNameWithoutExtension().toStdString(), active);
 			tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
 			//editor_->grabKeyboardFocus();
@@ -54,23 +82,59 @@ MainComponent::MainComponent() : bcr_(std::make_shared<midikraft::BCR2000>()),
 	}, 0x41 /* A */, ModifierKeys::ctrlModifier}},
 	{ "Send to BCR", { 5, "Send to BCR", [this]() {
 		auto active = activeTab();
-		if (active) {
-			active->sendToBCR();
+		if (active && active->sendToBCR()) {
+			updateLayout();
 		}
 	}, 0x0D /* ENTER */, ModifierKeys::ctrlModifier}},
-	{ "Close", { 6, "Close", [this]() {
+	{ "Send changes to BCR", { 6, "Send changes to BCR", [this]() {
+		auto active = activeTab();
+		if (active && active->sendChangesToBCR()) {
+			updateLayout();
+		}
+	}, 0x0D /* ENTER */, ModifierKeys::ctrlModifier | ModifierKeys::shiftModifier}},
+	{ "Backup all", { 7, "Backup all", [this]() {
+		backupAll();
+	}, 0x42 /* B */, ModifierKeys::ctrlModifier}},
+	{ "Close", { 8, "Close", [this]() {
 		auto active = activeTab();
 		if (active) {
 			tabs_.removeTab(tabs_.getCurrentTabIndex());
 			editors_.removeObject(active, true);
 		}
 	}, 0x57 /* W */, ModifierKeys::ctrlModifier}},
-	{ "About", { 7, "About", [this]() {
+	{ "About", { 9, "About", [this]() {
 		aboutBox();
 	}, -1, 0}},
-	{ "Quit", { 8, "Quit", []() {
+	{ "Quit", { 10, "Quit", []() {
 		JUCEApplicationBase::quit();
-	}, 0x51 /* Q */, ModifierKeys::ctrlModifier}}
+	}, 0x51 /* Q */, ModifierKeys::ctrlModifier}},
+	{ "Search library", { 11, "Search library", [this]() {
+		searchLibrary();
+	}, 0x4C /* L */, ModifierKeys::ctrlModifier}},
+	{ "Diagnostics", { 12, "Diagnostics", [this]() {
+		showDiagnostics();
+	}, -1, 0}},
+	{ "Show controllers", { 13, "Show controllers", [this]() {
+		showLayout();
+	}, 0x4D /* M */, ModifierKeys::ctrlModifier}},
+	{ "MIDI routing", { 14, "MIDI routing", [this]() {
+		showRouting();
+	}, -1, 0}},
+	{ "Find and replace", { 15, "Find and replace", [this]() {
+		findAndReplace();
+	}, 0x46 /* F */, ModifierKeys::ctrlModifier | ModifierKeys::shiftModifier}},
+	{ "Send to all units", { 16, "Send to all units", [this]() {
+		sendToAllUnits();
+	}, 0x0D /* ENTER */, ModifierKeys::ctrlModifier | ModifierKeys::altModifier}},
+	{ "Send tabs to units", { 17, "Send tabs to units", [this]() {
+		sendTabsToUnits();
+	}, -1, 0}},
+	{ "Sync with folder", { 18, "Sync with folder", [this]() {
+		syncWithFolder();
+	}, -1, 0}},
+	{ "Open library file", { 19, "Open library file", [this]() {
+		openArchive();
+	}, -1, 0}}
 	};
 	buttons_.setButtonDefinitions(buttons);
 	commandManager_.registerAllCommandsForTarget(&buttons_);
@@ -92,24 +156,29 @@ MainComponent::MainComponent() : bcr_(std::make_shared<midikraft::BCR2000>()),
 	addAndMakeVisible(topArea_);
 	auto newEditor = createNewEditor("New");
 	addNewEditor("New", newEditor);
+	createUnitGrids();
 
 	// Resizer bar allows to enlarge the log area
 	stretchableManager_.setItemLayout(0, -0.1, -0.9, -0.8); // The editor tab window prefers to get 80%
 	stretchableManager_.setItemLayout(1, 5, 5, 5);  // The resizer is hard-coded to 5 pixels
 	stretchableManager_.setItemLayout(2, -0.1, -0.9, -0.2);
 
-	// Install our MidiLogger
+	// Install our MidiLogger. This is called from whatever thread sends or receives, the log panel queues lock-free and displays in batches
 	midikraft::MidiController::instance()->setMidiLogFunction([this](const MidiMessage& message, const String& source, bool isOut) {
-		midiLogView_.addMessageToList(message, source, isOut);
+		midiLogPanel_.addMessageToList(message, source, isOut);
 	});
 
 	// Make sure you set the size of the component after
 	// you add any child components.
 	setSize(1280, 800);
+
+	// Connect right away, trying the ports that worked last time first
+	detectBCR(true);
 }
 
 MainComponent::~MainComponent()
 {
+	midikraft::MidiController::instance()->setMidiLogFunction([](const MidiMessage&, const String&, bool) {});
 	Logger::setCurrentLogger(nullptr);
 }
 
@@ -130,9 +199,20 @@ void MainComponent::resized()
 
 void MainComponent::refreshListOfPresets()
 {
+	for (int unit = 0; unit < devices_.numberOfUnits(); unit++) {
+		refreshListOfPresets(unit);
+	}
+}
+
+void MainComponent::refreshListOfPresets(int unit)
+{
+	auto grid = gridOfUnit(unit);
+	if (!grid) {
+		return;
+	}
 	int i = 0;
-	for (auto const &preset : bcr_->listOfPresets()) {
-		auto button = grid_.buttonWithIndex(i++);
+	for (auto const &preset : devices_.bcr(unit)->listOfPresets()) {
+		auto button = grid->buttonWithIndex(i++);
 		if (button) {
 			//button->setActive(false);
 			button->setButtonText(preset);
@@ -144,61 +224,375 @@ void MainComponent::refreshListOfPresets()
 	repaint();
 }
 
-void MainComponent::detectBCR()
+void MainComponent::detectBCR(bool tryLastKnownFirst)
 {
-	MouseCursor::showWaitCursor();
-	std::vector<std::shared_ptr<midikraft::SimpleDiscoverableDevice>> devices;
-	devices.push_back(bcr_);
-	autodetector_.autoconfigure(devices);
-	refreshFromBCR();
+	if (detection_.isBusy()) {
+		return;
+	}
+	Component::SafePointer<MainComponent> safeThis(this);
+	detection_.detect(tryLastKnownFirst, [safeThis](bool found) {
+		if (!safeThis) return;
+		if (found) {
+			// A fast detection only finds the unit used last time, Detect probes all ports and finds every unit
+			if (safeThis->devices_.setConnections(safeThis->detection_.connections())) {
+				safeThis->createUnitGrids();
+				if (safeThis->devices_.numberOfUnits() > 1) {
+					SimpleLogger::instance()->postMessage("Found " + String(safeThis->devices_.numberOfUnits()) + " BCR2000 units");
+				}
+			}
+			else {
+				SimpleLogger::instance()->postMessage("Still sending to the BCR2000 units, keeping the units found before");
+			}
+			safeThis->refreshFromBCR();
+		}
+		else {
+			SimpleLogger::instance()->postMessage("No BCR2000 found, check that it is switched on and connected, then press Detect");
+		}
+	});
 }
 
 void MainComponent::refreshFromBCR()
 {
 	MouseCursor::showWaitCursor();
-	bcr_->invalidateListOfPresets();
-	bcr_->refreshListOfPresets([this]() {
-		// Back to the UI thread please
-		MessageManager::callAsync([this]() {
-			refreshListOfPresets(),
-			MouseCursor::hideWaitCursor();
+	// All units are asked at the same time, each on its own ports
+	for (int unit = 0; unit < devices_.numberOfUnits(); unit++) {
+		auto bcr = devices_.bcr(unit);
+		bcr->invalidateListOfPresets();
+		auto startTicks = Trace::now();
+		pendingRefreshes_++;
+		// A detection while the refresh runs renumbers the units, so the answer is matched by its device
+		std::weak_ptr<midikraft::BCR2000> device(bcr);
+		bcr->refreshListOfPresets([this, device, startTicks]() {
+			Trace::record("refreshListOfPresets", startTicks, Trace::now());
+			// Back to the UI thread please
+			MessageManager::callAsync([this, device]() {
+				auto refreshed = device.lock();
+				for (int unit = 0; refreshed && unit < devices_.numberOfUnits(); unit++) {
+					if (devices_.bcr(unit) == refreshed) {
+						refreshListOfPresets(unit);
+					}
+				}
+				if (--pendingRefreshes_ == 0) {
+					MouseCursor::hideWaitCursor();
+				}
+			});
+		});
+	}
+}
+
+void MainComponent::createUnitGrids()
+{
+	gridTabs_.clearTabs();
+	unitGrids_.clear();
+	auto colour = getLookAndFeel().findColour(Label::backgroundColourId);
+	gridTabs_.addTab(devices_.unitName(0), colour, &grid_, false);
+	for (int unit = 1; unit < devices_.numberOfUnits(); unit++) {
+		auto grid = unitGrids_.add(new PatchButtonGrid(4, 8, [this, unit](int no) { retrievePatch(unit, no); }));
+		gridTabs_.addTab(devices_.unitName(unit), colour, grid, false);
+	}
+	// With a single BCR2000 there is nothing to choose from
+	gridTabs_.setTabBarDepth(devices_.numberOfUnits() > 1 ? 30 : 0);
+}
+
+PatchButtonGrid *MainComponent::gridOfUnit(int unit)
+{
+	return unit == 0 ? &grid_ : unitGrids_[unit - 1];
+}
+
+void MainComponent::retrievePatch(int unit, int no)
+{
+	auto grid = gridOfUnit(unit);
+	auto patchName = grid && grid->buttonWithIndex(no) ? grid->buttonWithIndex(no)->getButtonText() : "unnamed";
+	if (unit > 0) {
+		patchName += " (unit " + String(unit + 1) + ")";
+	}
+	std::vector<MidiMessage> cached;
+	if (presetCache_.lookup(deviceKey(unit), no, patchName, cached)) {
+		// Show what we have right away, and check in the background that the device still has the same
+		auto editor = createNewEditor(patchName.toStdString());
+		addNewEditor(patchName.toStdString(), editor);
+		editor->loadDocumentFromSyx(cached);
+		tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
+		Component::SafePointer<BCLEditor> safeEditor(editor);
+		downloadPatch(unit, no, [this, unit, no, patchName, safeEditor](std::vector<MidiMessage> const &messages) {
+			if (presetCache_.store(deviceKey(unit), no, patchName, messages)) {
+				if (safeEditor && !safeEditor->hasUnsavedChanges()) {
+					safeEditor->loadDocumentFromSyx(messages);
+					SimpleLogger::instance()->postMessage("Preset " + patchName + " has changed on the BCR2000, reloaded it");
+				}
+				else {
+					SimpleLogger::instance()->postMessage("Preset " + patchName + " has changed on the BCR2000, open it again to see the current version");
+				}
+			}
 		});
+		return;
+	}
+
+	downloadPatch(unit, no, [this, unit, no, patchName](std::vector<MidiMessage> const &messages) {
+		presetCache_.store(deviceKey(unit), no, patchName, messages);
+		auto editor = createNewEditor(patchName.toStdString());
+		addNewEditor(patchName.toStdString(), editor);
+		editor->loadDocumentFromSyx(messages);
+		tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
 	});
 }
 
-void MainComponent::retrievePatch(int no)
+void MainComponent::downloadPatch(int unit, int no, std::function<void(std::vector<MidiMessage> const &)> whenDone)
+{
+	devices_.dumpSessions(unit).requestDump(no, whenDone);
+}
+
+String MainComponent::deviceKey(int unit) const
+{
+	return String(devices_.bcr(unit)->midiOutput());
+}
+
+void MainComponent::sendToAllUnits()
+{
+	auto active = activeTab();
+	if (!active) {
+		return;
+	}
+	auto sysex = active->compiledSysex();
+	uploadToUnits(std::vector<std::vector<MidiMessage>>(static_cast<size_t>(devices_.numberOfUnits()), sysex));
+}
+
+void MainComponent::sendTabsToUnits()
+{
+	// The first tab goes to the first unit, the second tab to the second, and so on
+	std::vector<std::vector<MidiMessage>> messagesPerUnit;
+	for (int i = 0; i < jmin(tabs_.getNumTabs(), devices_.numberOfUnits()); i++) {
+		auto editor = dynamic_cast<BCLEditor *>(tabs_.getTabContentComponent(i));
+		messagesPerUnit.push_back(editor ? editor->compiledSysex() : std::vector<MidiMessage>());
+	}
+	if (tabs_.getNumTabs() != devices_.numberOfUnits()) {
+		SimpleLogger::instance()->postMessage("There are " + String(tabs_.getNumTabs()) + " tabs for " + String(devices_.numberOfUnits()) + " units, sending the first "
+			+ String(messagesPerUnit.size()));
+	}
+	uploadToUnits(messagesPerUnit);
+}
+
+void MainComponent::uploadToUnits(std::vector<std::vector<MidiMessage>> const &messagesPerUnit)
 {
-	//TODO not really thread safe or even frantic user safe...
-	currentDownload_.clear();
-	midikraft::MidiController::HandlerHandle handle = midikraft::MidiController::makeOneHandle();
-	midikraft::MidiController::instance()->addMessageHandler(handle, [this, handle, no](MidiInput *source, MidiMessage const &message) {
-		if (bcr_->isPartOfDump(message)) {
-			currentDownload_.push_back(message);
+	auto startTime = Time::getMillisecondCounterHiRes();
+	Component::SafePointer<MainComponent> safeThis(this);
+	bool started = devices_.sendToUnits(messagesPerUnit, [safeThis, startTime]() {
+		if (!safeThis) return;
+		auto self = safeThis.getComponent();
+		for (int unit = 0; unit < self->devices_.numberOfUnits(); unit++) {
+			// Whatever was uploaded might have been stored into any slot
+			self->devices_.bcr(unit)->invalidateListOfPresets();
+			self->presetCache_.invalidate(self->deviceKey(unit));
 		}
-		if (bcr_->isDumpFinished(currentDownload_)) {
-			midikraft::MidiController::instance()->removeMessageHandler(handle);
-			MessageManager::callAsync([this, no]() {
-				auto patchName = grid_.buttonWithIndex(no) ? grid_.buttonWithIndex(no)->getButtonText() : "unnamed";
-				auto editor = createNewEditor(patchName.toStdString());
-				addNewEditor(patchName.toStdString(), editor);
-				editor->loadDocumentFromSyx(currentDownload_);
-				tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
-			});
+		for (auto const &status : self->devices_.status()) {
+			SimpleLogger::instance()->postMessage(status.name + ": " + status.summary);
 		}
+		SimpleLogger::instance()->postMessage("Upload to " + String(self->devices_.numberOfUnits()) + " units took "
+			+ String((Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 2) + " s");
 	});
-	midikraft::MidiController::instance()->getMidiOutput(bcr_->midiOutput())->sendMessageNow(bcr_->requestDump(no));
+	if (!started) {
+		SimpleLogger::instance()->postMessage("Still sending to the BCR2000 units, please wait for the upload to finish");
+		return;
+	}
+
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Sending to all units";
+	options.content.setOwned(new UnitUploadPanel(devices_));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::backupAll()
+{
+	FileChooser chooser("Save backup of all presets as...", File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("BCR2000 backup " + Time::getCurrentTime().formatted("%Y-%m-%d") + ".zip"), "*.zip");
+	if (!chooser.browseForFileToSave(true)) {
+		return;
+	}
+	DeviceBackup backup(bcr_);
+	BackupProgressWindow window(backup);
+	if (window.runThread() && window.success()) {
+		for (auto const &dump : backup.dumps()) {
+			presetCache_.store(deviceKey(0), dump.slot, dump.name, dump.messages);
+		}
+		if (backup.writeArchive(chooser.getResult())) {
+			SimpleLogger::instance()->postMessage("Backup of " + String(DeviceBackup::kNumberOfPresets) + " presets written to " + chooser.getResult().getFullPathName()
+				+ ", download took " + String(backup.downloadSeconds(), 2) + " s");
+		}
+		else {
+			SimpleLogger::instance()->postMessage("Failed to write backup to " + chooser.getResult().getFullPathName());
+		}
+	}
+	else {
+		SimpleLogger::instance()->postMessage("Backup aborted after " + String(backup.downloadSeconds(), 2) + " s");
+	}
+}
+
+void MainComponent::searchLibrary()
+{
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Search preset library";
+	options.content.setOwned(new LibrarySearchPanel(library_, [this](File const &file) { openFile(file); }));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::openArchive()
+{
+	FileChooser chooser("Open or create a preset library", File::getSpecialLocation(File::userDocumentsDirectory), "*.bcrlib");
+	if (!chooser.browseForFileToSave(false)) {
+		return;
+	}
+	auto file = chooser.getResult().withFileExtension("bcrlib");
+	auto openHandler = [this](String const &name, std::vector<MidiMessage> const &messages) {
+		auto editor = createNewEditor(name.toStdString());
+		addNewEditor(name.toStdString(), editor);
+		editor->loadDocumentFromSyx(messages);
+		tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
+	};
+
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Preset library " + file.getFileName();
+	options.content.setOwned(new ArchivePickerPanel(file, bcr_, openHandler));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::showDiagnostics()
+{
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Diagnostics";
+	options.content.setOwned(new DiagnosticsPanel());
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::showLayout()
+{
+	if (layoutView_) {
+		layoutView_->getTopLevelComponent()->toFront(true);
+		return;
+	}
+	layoutView_ = new BCRLayoutView(bcr_);
+	updateLayout();
+
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "BCR2000 controllers";
+	options.content.setOwned(layoutView_);
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::updateLayout()
+{
+	// The controller view shows whatever was sent to the device last, or the active tab when it is opened
+	auto active = activeTab();
+	if (layoutView_ && active) {
+		layoutView_->setDefinition(active->documentText().toStdString(), tabs_.getCurrentTabName());
+	}
+}
+
+void MainComponent::showRouting()
+{
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "MIDI routing";
+	options.content.setOwned(new RoutingPanel(router_, String(bcr_->midiInput())));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::findAndReplace()
+{
+	auto tabProvider = [this]() {
+		std::vector<FindReplacePanel::Tab> tabs;
+		for (int i = 0; i < tabs_.getNumTabs(); i++) {
+			auto editor = dynamic_cast<BCLEditor *>(tabs_.getTabContentComponent(i));
+			if (editor) {
+				tabs.push_back({ editor, tabs_.getTabNames()[i] });
+			}
+		}
+		return tabs;
+	};
+	auto showHandler = [this](BCLEditor *editor) {
+		for (int i = 0; i < tabs_.getNumTabs(); i++) {
+			if (tabs_.getTabContentComponent(i) == editor) {
+				tabs_.setCurrentTabIndex(i);
+			}
+		}
+	};
+
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Find and replace in all tabs";
+	options.content.setOwned(new FindReplacePanel(tabProvider, showHandler));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::syncWithFolder()
+{
+	Component::SafePointer<MainComponent> safeThis(this);
+	auto uploadedHandler = [safeThis](int unit) {
+		if (!safeThis || unit >= safeThis->devices_.numberOfUnits()) return;
+		safeThis->presetCache_.invalidate(safeThis->deviceKey(unit));
+		safeThis->refreshFromBCR();
+	};
+
+	DialogWindow::LaunchOptions options;
+	options.dialogTitle = "Sync BCR2000 with folder";
+	options.content.setOwned(new MirrorSyncPanel(devices_, uploadedHandler));
+	options.componentToCentreAround = this;
+	options.escapeKeyTriggersCloseButton = true;
+	options.useNativeTitleBar = false;
+	options.resizable = true;
+	options.launchAsync();
+}
+
+void MainComponent::openFile(File const &file)
+{
+	auto editor = createNewEditor(file.getFileNameWithoutExtension().toStdString());
+	if (editor->loadFile(file)) {
+		addNewEditor(file.getFileNameWithoutExtension().toStdString(), editor);
+		tabs_.setCurrentTabIndex(tabs_.getNumTabs() - 1);
+	}
+	else {
+		SimpleLogger::instance()->postMessage("Could not open " + file.getFullPathName());
+		delete editor;
+	}
 }
 
 BCLEditor *MainComponent::createNewEditor(std::string const &tabName)
 {
-	auto editor = new BCLEditor(bcr_, [this]() { refreshListOfPresets();  });
+	auto editor = new BCLEditor(bcr_, devices_.transmitter(0), [this]() { refreshListOfPresets();  }, [this]() {
+		// Whatever was uploaded might have been stored into any slot
+		presetCache_.invalidate(deviceKey(0));
+	});
 	return editor;
 }
 
 void MainComponent::addNewEditor(std::string const &tabName, BCLEditor *editor) {
 	editors_.add(editor);
+	// The tabbed component shows the editor when its tab is selected, hidden editors release their editor component after a while
 	tabs_.addTab(tabName, getLookAndFeel().findColour(Label::backgroundColourId), editor, false);
-	tabs_.addAndMakeVisible(editor);
 }
 
 BCLEditor * MainComponent::activeTab()
@@ -233,9 +627,10 @@ BCRMenu::BCRMenu(ApplicationCommandManager *commandManager, LambdaButtonStrip *l
 	commandManager_(commandManager), lambdaButtons_(lambdaButtons)
 {
 	menuStructure_ = {
-		{0, { "File", { "New", "Open", "Save", "Save as...", "Close", "Quit" } } },
-		{1, { "BCR2000", { "Detect", "Refresh preset list", "Send to BCR" } } },
-		{2, { "Help", { "About" } } }
+		{0, { "File", { "New", "Open", "Search library", "Open library file", "Save", "Save as...", "Close", "Quit" } } },
+		{1, { "Edit", { "Find and replace" } } },
+		{2, { "BCR2000", { "Detect", "Refresh preset list", "Send to BCR", "Send changes to BCR", "Send to all units", "Send tabs to units", "Sync with folder", "Backup all", "Show controllers", "MIDI routing" } } },
+		{3, { "Help", { "Diagnostics", "About" } } }
 	};
 }
 
@@ -11,10 +11,16 @@
 #include "BCLEditor.h"
 #include "BCR2000.h"
 #include "LogView.h"
-#include "MidiLogView.h"
+#include "MidiLogPanel.h"
 #include "PatchButtonGrid.h"
 #include "InsetBox.h"
-#include "AutoDetection.h"
+#include "FastAutoDetection.h"
+#include "PresetCache.h"
+#include "DumpSession.h"
+#include "PresetLibrary.h"
+#include "BCRLayoutView.h"
+#include "MidiRouter.h"
+#include "DeviceManager.h"
 
 class LogViewLogger;
 
@@ -49,27 +55,52 @@ public:
 	bool perform(const InvocationInfo& info) override;
 
 private:
-	void detectBCR();
+	void detectBCR(bool tryLastKnownFirst);
 	void refreshFromBCR();
-	void retrievePatch(int no);
+	void refreshListOfPresets(int unit);
+	void createUnitGrids();
+	PatchButtonGrid *gridOfUnit(int unit);
+	void retrievePatch(int unit, int no);
+	void downloadPatch(int unit, int no, std::function<void(std::vector<MidiMessage> const &)> whenDone);
+	String deviceKey(int unit) const;
+	void sendToAllUnits();
+	void sendTabsToUnits();
+	void uploadToUnits(std::vector<std::vector<MidiMessage>> const &messagesPerUnit);
+	void syncWithFolder();
+	void backupAll();
+	void searchLibrary();
+	void openArchive();
+	void showDiagnostics();
+	void showLayout();
+	void updateLayout();
+	void showRouting();
+	void findAndReplace();
+	void openFile(File const &file);
 	BCLEditor *createNewEditor(std::string const &tabName);
 	void addNewEditor(std::string const &tabName, BCLEditor *editor);
 	BCLEditor *activeTab();
 
 	void aboutBox();
 
-	midikraft::AutoDetection autodetector_;
 	std::shared_ptr<midikraft::BCR2000> bcr_;
+	FastAutoDetection detection_;
 	TabbedComponent tabs_;
 	OwnedArray<BCLEditor> editors_;
 	LogView logView_;
-	PatchButtonGrid grid_;
+	PatchButtonGrid grid_; // Of the primary unit
+	OwnedArray<PatchButtonGrid> unitGrids_; // Of all other units
+	TabbedComponent gridTabs_;
 	StretchableLayoutManager stretchableManager_;
 	StretchableLayoutResizerBar resizerBar_;
-	MidiLogView midiLogView_;
+	MidiLogPanel midiLogPanel_;
 	std::unique_ptr<LogViewLogger> logger_;
 	std::unique_ptr<BCRMenu> menu_;
-	std::vector<MidiMessage> currentDownload_;
+	DeviceManager devices_;
+	int pendingRefreshes_;
+	PresetCache presetCache_;
+	PresetLibrary library_;
+	Component::SafePointer<BCRLayoutView> layoutView_;
+	MidiRouter router_;
 	MenuBarComponent menuBar_;
 
 	InsetBox topArea_;
@@ -0,0 +1,74 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "MidiLogBuffer.h"
+
+MidiLogBuffer::MidiLogBuffer(int capacity) : enqueuePos_(0), dequeuePos_(0), dropped_(0)
+{
+	size_t size = 1;
+	while (size < static_cast<size_t>(jmax(2, capacity))) {
+		size <<= 1;
+	}
+	cells_.reset(new Cell[size]);
+	mask_ = size - 1;
+	for (size_t i = 0; i < size; i++) {
+		cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool MidiLogBuffer::push(MidiMessage const &message, String const &source, bool isOut)
+{
+	// Bounded multi producer queue after Dmitry Vyukov: claim a cell by advancing the enqueue position, then publish it via its sequence number
+	Cell *cell;
+	size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+	for (;;) {
+		cell = &cells_[pos & mask_];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+		if (difference == 0) {
+			if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			dropped_++;
+			return false;
+		}
+		else {
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	auto &entry = cell->entry;
+	entry.timestamp = Time::getMillisecondCounterHiRes();
+	entry.isOut = isOut;
+	entry.totalSize = message.getRawDataSize();
+	entry.length = static_cast<uint8>(jmin(entry.totalSize, kMaxBytes));
+	memcpy(entry.bytes, message.getRawData(), entry.length);
+	source.copyToUTF8(entry.source, kMaxSourceLength);
+
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+bool MidiLogBuffer::pop(Entry &outEntry)
+{
+	auto &cell = cells_[dequeuePos_ & mask_];
+	size_t sequence = cell.sequence.load(std::memory_order_acquire);
+	if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos_ + 1) < 0) {
+		// Empty
+		return false;
+	}
+	outEntry = cell.entry;
+	cell.sequence.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+	dequeuePos_++;
+	return true;
+}
+
+int MidiLogBuffer::takeDropped()
+{
+	return dropped_.exchange(0);
+}
@@ -0,0 +1,50 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+// Fixed size lock-free queue for MIDI log entries. Any thread may push, which never blocks or allocates,
+// one consumer thread pops. When the queue is full, new entries are dropped and counted.
+// Long sysex messages are truncated, only their first bytes are kept.
+class MidiLogBuffer {
+public:
+	static const int kMaxBytes = 48;
+	static const int kMaxSourceLength = 32;
+
+	struct Entry {
+		double timestamp;
+		bool isOut;
+		int totalSize;
+		uint8 length;
+		uint8 bytes[kMaxBytes];
+		char source[kMaxSourceLength];
+	};
+
+	// The capacity is rounded up to the next power of two
+	explicit MidiLogBuffer(int capacity);
+
+	bool push(MidiMessage const &message, String const &source, bool isOut);
+	bool pop(Entry &outEntry);
+
+	// Number of entries dropped since the last call
+	int takeDropped();
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		Entry entry;
+	};
+
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_;
+	std::atomic<size_t> enqueuePos_;
+	size_t dequeuePos_;
+	std::atomic<int> dropped_;
+};
@@ -0,0 +1,174 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "MidiLogPanel.h"
+
+namespace {
+	const int kQueueCapacity = 16384;
+	const int kHistorySize = 20000;
+	const int kFramesPerSecond = 25;
+	const int kMaxEntriesPerFrame = 8192;
+}
+
+MidiLogPanel::MidiLogPanel() : buffer_(kQueueCapacity), history_(kHistorySize), historyStart_(0), historySize_(0),
+	startTime_(Time::getMillisecondCounterHiRes()), dropped_(0), list_("MIDI Log", this)
+{
+	list_.setRowHeight(18);
+	addAndMakeVisible(list_);
+
+	clearButton_.setButtonText("Clear");
+	clearButton_.onClick = [this]() { clear(); };
+	addAndMakeVisible(clearButton_);
+
+	captureButton_.setButtonText("Capture to file");
+	captureButton_.onClick = [this]() {
+		if (captureButton_.getToggleState()) {
+			FileChooser chooser("Capture MIDI log to...", File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("midilog.txt"), "*.txt");
+			if (!chooser.browseForFileToSave(true) || !startCapture(chooser.getResult())) {
+				captureButton_.setToggleState(false, dontSendNotification);
+			}
+		}
+		else {
+			stopCapture();
+		}
+	};
+	addAndMakeVisible(captureButton_);
+	addAndMakeVisible(statusLabel_);
+
+	startTimerHz(kFramesPerSecond);
+}
+
+MidiLogPanel::~MidiLogPanel()
+{
+	stopTimer();
+	stopCapture();
+}
+
+void MidiLogPanel::addMessageToList(MidiMessage const &message, String const &source, bool isOut)
+{
+	buffer_.push(message, source, isOut);
+}
+
+void MidiLogPanel::clear()
+{
+	historyStart_ = 0;
+	historySize_ = 0;
+	list_.updateContent();
+	list_.repaint();
+}
+
+bool MidiLogPanel::startCapture(File const &file)
+{
+	stopCapture();
+	file.deleteFile();
+	capture_.reset(file.createOutputStream());
+	if (!capture_ || !capture_->openedOk()) {
+		capture_.reset();
+		return false;
+	}
+	captureFile_ = file;
+	return true;
+}
+
+void MidiLogPanel::stopCapture()
+{
+	if (capture_) {
+		capture_->flush();
+		capture_.reset();
+	}
+}
+
+bool MidiLogPanel::isCapturing() const
+{
+	return capture_ != nullptr;
+}
+
+void MidiLogPanel::resized()
+{
+	auto area = getLocalBounds();
+	auto buttonRow = area.removeFromBottom(28).withTrimmedTop(4);
+	clearButton_.setBounds(buttonRow.removeFromLeft(80));
+	captureButton_.setBounds(buttonRow.removeFromLeft(140).withTrimmedLeft(8));
+	statusLabel_.setBounds(buttonRow.withTrimmedLeft(8));
+	list_.setBounds(area);
+}
+
+int MidiLogPanel::getNumRows()
+{
+	return static_cast<int>(historySize_);
+}
+
+void MidiLogPanel::paintListBoxItem(int rowNumber, Graphics& g, int width, int height, bool rowIsSelected)
+{
+	if (rowNumber < 0 || rowNumber >= static_cast<int>(historySize_)) {
+		return;
+	}
+	auto const &entry = entryForRow(rowNumber);
+	if (rowIsSelected) {
+		g.fillAll(getLookAndFeel().findColour(TextEditor::highlightColourId));
+	}
+	g.setColour(entry.isOut ? Colours::lightblue : Colours::lightgreen);
+	g.setFont(Font(Font::getDefaultMonospacedFontName(), height * 0.7f, Font::plain));
+	g.drawText(formatEntry(entry, startTime_), 4, 0, width - 8, height, Justification::centredLeft, true);
+}
+
+void MidiLogPanel::timerCallback()
+{
+	int drained = 0;
+	MidiLogBuffer::Entry entry;
+	String captured;
+	while (drained < kMaxEntriesPerFrame && buffer_.pop(entry)) {
+		// Ring of the most recent entries, the oldest is overwritten
+		size_t index = (historyStart_ + historySize_) % history_.size();
+		history_[index] = entry;
+		if (historySize_ < history_.size()) {
+			historySize_++;
+		}
+		else {
+			historyStart_ = (historyStart_ + 1) % history_.size();
+		}
+		if (capture_) {
+			captured << formatEntry(entry, startTime_) << "\n";
+		}
+		drained++;
+	}
+	int newlyDropped = buffer_.takeDropped();
+	dropped_ += newlyDropped;
+	if (capture_ && newlyDropped > 0) {
+		// The queue doesn't know where the lost messages were, so the marker goes after the ones drained this frame
+		captured << "*** " << newlyDropped << " messages dropped, the MIDI log queue was full ***\n";
+	}
+
+	if (capture_ && captured.isNotEmpty()) {
+		capture_->writeText(captured, false, false, nullptr);
+		capture_->flush();
+	}
+	if (drained > 0 || newlyDropped > 0) {
+		bool wasAtEnd = list_.getVerticalScrollBar().getCurrentRangeStart() + list_.getVerticalScrollBar().getCurrentRangeSize() >= list_.getVerticalScrollBar().getMaximumRangeLimit() - 1;
+		list_.updateContent();
+		list_.repaint();
+		if (wasAtEnd) {
+			list_.scrollToEnsureRowIsOnscreen(static_cast<int>(historySize_) - 1);
+		}
+		statusLabel_.setText(String(historySize_) + " messages" + (dropped_ > 0 ? ", " + String(dropped_) + " dropped" : String())
+			+ (capture_ ? ", capturing to " + captureFile_.getFileName() : String()), dontSendNotification);
+	}
+}
+
+MidiLogBuffer::Entry const &MidiLogPanel::entryForRow(int row) const
+{
+	return history_[(historyStart_ + static_cast<size_t>(row)) % history_.size()];
+}
+
+String MidiLogPanel::formatEntry(MidiLogBuffer::Entry const &entry, double startTime)
+{
+	String result = String((entry.timestamp - startTime) / 1000.0, 3).paddedLeft(' ', 10) + (entry.isOut ? "  OUT " : "  IN  ") + String(CharPointer_UTF8(entry.source)) + ": ";
+	result += String::toHexString(entry.bytes, entry.length, 1);
+	if (entry.totalSize > entry.length) {
+		result += " ... (" + String(entry.totalSize) + " bytes)";
+	}
+	return result;
+}
@@ -0,0 +1,59 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "MidiLogBuffer.h"
+
+// MIDI log that keeps up with full MIDI bandwidth: messages are pushed lock-free into a MidiLogBuffer from any thread,
+// and drained in batches at a capped frame rate. Only a fixed number of entries is kept for display, and the list
+// only paints the visible rows. Optionally everything is also captured to a text file.
+//
+// The capture is lossy, it writes exactly what the list shows: sysex longer than MidiLogBuffer::kMaxBytes is cut off with
+// its total size noted, and messages the full queue had to drop are reported as a marker line instead of silently missing.
+class MidiLogPanel : public Component,
+	private ListBoxModel,
+	private Timer
+{
+public:
+	MidiLogPanel();
+	virtual ~MidiLogPanel();
+
+	// Thread safe, can be called from the MIDI thread
+	void addMessageToList(MidiMessage const &message, String const &source, bool isOut);
+
+	void clear();
+	bool startCapture(File const &file);
+	void stopCapture();
+	bool isCapturing() const;
+
+	void resized() override;
+
+private:
+	// ListBoxModel
+	int getNumRows() override;
+	void paintListBoxItem(int rowNumber, Graphics& g, int width, int height, bool rowIsSelected) override;
+
+	void timerCallback() override;
+	MidiLogBuffer::Entry const &entryForRow(int row) const;
+	static String formatEntry(MidiLogBuffer::Entry const &entry, double startTime);
+
+	MidiLogBuffer buffer_;
+	std::vector<MidiLogBuffer::Entry> history_;
+	size_t historyStart_;
+	size_t historySize_;
+	double startTime_;
+	int dropped_;
+
+	ListBox list_;
+	TextButton clearButton_;
+	ToggleButton captureButton_;
+	Label statusLabel_;
+	std::unique_ptr<FileOutputStream> capture_;
+	File captureFile_;
+};
@@ -0,0 +1,271 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "MidiRouter.h"
+
+#include "Logger.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const int kQueueSize = 4096;
+	const int kHighestPriority = 10; // Of JUCE's 0 to 10, still a normal scheduling class
+	// The router thread also wakes up without input, so retired tables can be deleted even when nothing is played
+	const int kIdleWaitMs = 50;
+	const int kReclaimIntervalMs = 100;
+	const double kLatencyBucketUs = 10.0;
+	// Timestamps further away than this are not from the input driver's clock, then the time of arrival in our handler is used
+	const double kMaxTimestampSkewMs = 1000.0;
+}
+
+MidiRouter::MidiRouter(std::shared_ptr<midikraft::BCR2000> bcr) : Thread("MidiRouter"), bcr_(bcr), handle_(midikraft::MidiController::makeOneHandle()), running_(false),
+	fifo_(kQueueSize), events_(kQueueSize), table_(nullptr), passes_(0), routed_(0), dropped_(0), maxLatencyUs_(0)
+{
+	for (auto &bucket : latency_) {
+		bucket = 0;
+	}
+}
+
+MidiRouter::~MidiRouter()
+{
+	stop();
+	table_.store(nullptr);
+}
+
+bool MidiRouter::start(String const &inputName, String const &outputName)
+{
+	stop();
+	if (!MidiInput::getDevices().contains(inputName) || !MidiOutput::getDevices().contains(outputName)) {
+		return false;
+	}
+	if (bcr_ && outputName == String(bcr_->midiOutput())) {
+		SimpleLogger::instance()->postMessage("Not routing to " + outputName + ", that is the BCR2000 itself");
+		return false;
+	}
+	auto output = midikraft::MidiController::instance()->getMidiOutput(outputName.toStdString());
+	if (!output) {
+		return false;
+	}
+	send_ = [output](MidiMessage const &message) { output->sendMessageNow(message); };
+	inputName_ = inputName;
+	fifo_.reset();
+	midikraft::MidiController::instance()->enableMidiInput(inputName.toStdString());
+	startThread(kHighestPriority);
+	midikraft::MidiController::instance()->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+		handleMessage(source, message);
+	});
+	running_ = true;
+	SimpleLogger::instance()->postMessage("Routing MIDI from " + inputName + " to " + outputName);
+	return true;
+}
+
+void MidiRouter::stop()
+{
+	if (!running_) {
+		return;
+	}
+	midikraft::MidiController::instance()->removeMessageHandler(handle_);
+	stopThread(1000);
+	running_ = false;
+	// Without the router thread nobody can be using a retired table anymore
+	retired_.clear();
+	stopTimer();
+}
+
+bool MidiRouter::isRunning() const
+{
+	return running_;
+}
+
+void MidiRouter::setTable(std::unique_ptr<RoutingTable> table)
+{
+	// Sequentially consistent, like the load and increment in run: a pass counted after the load below has loaded the new table
+	table_.store(table.get());
+	if (current_) {
+		retired_.emplace_back(passes_.load(), std::move(current_));
+	}
+	current_ = std::move(table);
+	if (!isThreadRunning()) {
+		retired_.clear();
+	}
+	else if (!retired_.empty()) {
+		startTimer(kReclaimIntervalMs);
+	}
+}
+
+void MidiRouter::timerCallback()
+{
+	// A table replaced during pass n is no longer looked at when pass n has finished
+	auto passes = passes_.load();
+	retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [passes](std::pair<uint64, std::unique_ptr<RoutingTable const>> const &retired) {
+		return passes > retired.first;
+	}), retired_.end());
+	if (retired_.empty()) {
+		stopTimer();
+	}
+}
+
+void MidiRouter::handleMessage(MidiInput *source, MidiMessage const &message)
+{
+	// Called on the MIDI thread
+	if (source && source->getName() != inputName_) {
+		return;
+	}
+	int size = message.getRawDataSize();
+	if (message.isSysEx() || size > 3) {
+		return;
+	}
+	double now = Time::getMillisecondCounterHiRes();
+	int start1, size1, start2, size2;
+	fifo_.prepareToWrite(1, start1, size1, start2, size2);
+	if (size1 == 0) {
+		dropped_++;
+		return;
+	}
+	auto &event = events_[start1];
+	double timestamp = message.getTimeStamp() * 1000.0;
+	event.receivedMs = std::abs(now - timestamp) < kMaxTimestampSkewMs ? jmin(timestamp, now) : now;
+	event.receivedTicks = Trace::now();
+	event.size = size;
+	memcpy(event.bytes, message.getRawData(), static_cast<size_t>(size));
+	fifo_.finishedWrite(1);
+	notify();
+}
+
+void MidiRouter::run()
+{
+	while (!threadShouldExit()) {
+		wait(kIdleWaitMs);
+		// The table is loaded once per pass, see timerCallback
+		auto table = table_.load();
+		int start1, size1, start2, size2;
+		fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+		for (int i = start1; i < start1 + size1; i++) {
+			route(events_[i], table);
+		}
+		for (int i = start2; i < start2 + size2; i++) {
+			route(events_[i], table);
+		}
+		fifo_.finishedRead(size1 + size2);
+		passes_++;
+	}
+}
+
+void MidiRouter::route(Event const &event, RoutingTable const *table)
+{
+	uint8 status = event.bytes[0];
+	bool thru = !table || table->isThru();
+	bool sent = false;
+	if (status < 0xf0) {
+		int channel = status & 0x0f;
+		if (table && (status & 0xf0) == 0xb0 && event.size == 3) {
+			int rule = table->firstRule(channel, event.bytes[1] & 0x7f);
+			if (rule >= 0) {
+				thru = false;
+				sent = true;
+			}
+			for (; rule >= 0; rule = table->rule(rule).next) {
+				auto const &mapping = table->rule(rule);
+				int value = mapping.values[event.bytes[2] & 0x7f];
+				switch (mapping.type) {
+				case RoutingTable::TargetType::CC:
+					send_(MidiMessage::controllerEvent(mapping.channel + 1, mapping.number, value));
+					break;
+				case RoutingTable::TargetType::NRPN:
+					send_(MidiMessage::controllerEvent(mapping.channel + 1, 99, mapping.number >> 7));
+					send_(MidiMessage::controllerEvent(mapping.channel + 1, 98, mapping.number & 0x7f));
+					send_(MidiMessage::controllerEvent(mapping.channel + 1, 6, mapping.fourteenBit ? value >> 7 : value));
+					if (mapping.fourteenBit) {
+						send_(MidiMessage::controllerEvent(mapping.channel + 1, 38, value & 0x7f));
+					}
+					break;
+				case RoutingTable::TargetType::SysEx: {
+					// The message was allocated when the table was built and is only used by this thread, so its bytes are just patched.
+					// MidiMessage has no non-const access to its data, but owns it.
+					auto data = const_cast<uint8 *>(mapping.sysex.getRawData());
+					if (mapping.lowValuePosition >= 0) {
+						data[mapping.valuePosition] = static_cast<uint8>((value >> 7) & 0x7f);
+						data[mapping.lowValuePosition] = static_cast<uint8>(value & 0x7f);
+					}
+					else {
+						data[mapping.valuePosition] = static_cast<uint8>(value & 0x7f);
+					}
+					send_(mapping.sysex);
+					break;
+				}
+				}
+			}
+		}
+		if (thru) {
+			uint8 bytes[3] = { static_cast<uint8>((status & 0xf0) | (table ? table->outputChannel(channel) : channel)), event.bytes[1], event.bytes[2] };
+			send_(MidiMessage(bytes, event.size));
+			sent = true;
+		}
+	}
+	else if (thru) {
+		// Clock, start, stop and the like
+		send_(MidiMessage(event.bytes, event.size));
+		sent = true;
+	}
+	if (!sent) {
+		return;
+	}
+	routed_++;
+	recordLatency((Time::getMillisecondCounterHiRes() - event.receivedMs) * 1000.0);
+	Trace::record("router.route", event.receivedTicks, Trace::now());
+}
+
+void MidiRouter::recordLatency(double microseconds)
+{
+	int bucket = jlimit(0, kLatencyBuckets - 1, static_cast<int>(microseconds / kLatencyBucketUs));
+	latency_[bucket].fetch_add(1, std::memory_order_relaxed);
+	auto us = static_cast<uint64>(jmax(0.0, microseconds));
+	auto max = maxLatencyUs_.load(std::memory_order_relaxed);
+	while (us > max && !maxLatencyUs_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+	}
+}
+
+MidiRouter::Statistics MidiRouter::statistics() const
+{
+	Statistics result;
+	result.routed = routed_.load();
+	result.dropped = dropped_.load();
+	result.maxUs = static_cast<double>(maxLatencyUs_.load());
+
+	std::array<uint64, kLatencyBuckets> buckets;
+	uint64 total = 0;
+	for (int i = 0; i < kLatencyBuckets; i++) {
+		buckets[i] = latency_[i].load(std::memory_order_relaxed);
+		total += buckets[i];
+	}
+	auto percentile = [&](double p) {
+		// Upper bound of the bucket containing the percentile, or the maximum for the overflow bucket
+		uint64 seen = 0;
+		for (int i = 0; i < kLatencyBuckets; i++) {
+			seen += buckets[i];
+			if (total > 0 && seen >= p * total) {
+				return i == kLatencyBuckets - 1 ? result.maxUs : (i + 1) * kLatencyBucketUs;
+			}
+		}
+		return 0.0;
+	};
+	result.p50Us = percentile(0.5);
+	result.p99Us = percentile(0.99);
+	result.p999Us = percentile(0.999);
+	return result;
+}
+
+void MidiRouter::resetStatistics()
+{
+	routed_ = 0;
+	dropped_ = 0;
+	maxLatencyUs_ = 0;
+	for (auto &bucket : latency_) {
+		bucket = 0;
+	}
+}
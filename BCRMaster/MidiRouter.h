@@ -0,0 +1,90 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+#include "MidiController.h"
+
+#include "RoutingTable.h"
+
+#include <array>
+#include <atomic>
+
+// Forwards what arrives on one MIDI input to one output, translated by a RoutingTable, e.g. to put the BCR2000 in front of synths.
+// The MIDI thread only copies incoming messages into a lock-free FIFO and wakes the router thread, which runs at JUCE's highest
+// thread priority - that is not a realtime scheduling class, so a busy system can still delay it -, looks up the table and sends. Nothing on that path allocates or locks, except the waking of the thread.
+//
+// The table can be replaced at any time from the message thread without stopping the router. The router thread counts the passes
+// it makes over the FIFO, and a replaced table is only deleted once a pass has finished that started after the replacement.
+//
+// Latency is measured from the input's timestamp to the return of the last send, and kept in a histogram with 10 us resolution.
+// Sysex coming in is never forwarded - that is the BCR2000 talking to us, not to the synths. For the same reason the BCR2000's
+// own output is refused as a destination, the device would see its own controller messages come back.
+class MidiRouter : private Thread, private Timer {
+public:
+	struct Statistics {
+		uint64 routed;
+		uint64 dropped;
+		double p50Us;
+		double p99Us;
+		double p999Us;
+		double maxUs;
+	};
+
+	explicit MidiRouter(std::shared_ptr<midikraft::BCR2000> bcr);
+	virtual ~MidiRouter();
+
+	// Fails if a port can't be opened, or the output is the BCR2000's
+	bool start(String const &inputName, String const &outputName);
+	void stop();
+	bool isRunning() const;
+
+	// Takes over the table, can be called at any time
+	void setTable(std::unique_ptr<RoutingTable> table);
+
+	Statistics statistics() const;
+	void resetStatistics();
+
+private:
+	struct Event {
+		double receivedMs;
+		int64 receivedTicks;
+		int size;
+		uint8 bytes[3];
+	};
+
+	static const int kLatencyBuckets = 201; // 10 us each, the last one collects everything above 2 ms
+
+	void handleMessage(MidiInput *source, MidiMessage const &message);
+	void run() override;
+	void route(Event const &event, RoutingTable const *table);
+	void timerCallback() override;
+	void recordLatency(double microseconds);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	midikraft::MidiController::HandlerHandle handle_;
+	String inputName_; // Only changed while no handler is registered
+	std::function<void(MidiMessage const &)> send_;
+	bool running_;
+
+	// Single producer (MIDI thread) single consumer (router thread) queue
+	AbstractFifo fifo_;
+	std::vector<Event> events_;
+
+	std::atomic<RoutingTable const *> table_;
+	std::atomic<uint64> passes_;
+	// Replaced tables with the pass count at the time they were replaced, only touched on the message thread
+	std::vector<std::pair<uint64, std::unique_ptr<RoutingTable const>>> retired_;
+	std::unique_ptr<RoutingTable const> current_;
+
+	std::atomic<uint64> routed_;
+	std::atomic<uint64> dropped_;
+	std::array<std::atomic<uint64>, kLatencyBuckets> latency_;
+	std::atomic<uint64> maxLatencyUs_;
+};
@@ -0,0 +1,382 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "MirrorSyncPanel.h"
+
+#include "Logger.h"
+#include "Settings.h"
+
+#include <algorithm>
+#include <set>
+
+namespace {
+	const char *kMirrorFolder = "MirrorFolder";
+	const int kRefreshHz = 10;
+	// Dumps requested ahead of the answers, enough to keep the device busy but few enough to tell them apart by name
+	const int kPipelineDepth = 2;
+	const double kNamesTimeoutMs = 10000.0;
+
+	String stateText(DeviceMirror::State state) {
+		switch (state) {
+		case DeviceMirror::State::Same: return "Same";
+		case DeviceMirror::State::Differs: return "Differs";
+		case DeviceMirror::State::Unknown: return "Unknown";
+		case DeviceMirror::State::NoTarget: return "No file";
+		}
+		return {};
+	}
+
+	bool needsUpload(DeviceMirror::State state) {
+		return state == DeviceMirror::State::Differs || state == DeviceMirror::State::Unknown;
+	}
+}
+
+template <>
+void visit(DeviceMirror::SlotDiff const &diff, int column, std::function<void(std::string const &)> visitor) {
+	switch (column) {
+	case 1: visitor(String(diff.slot + 1).toStdString()); break;
+	case 2: visitor(diff.deviceName.toStdString()); break;
+	case 3: visitor(diff.targetName.toStdString()); break;
+	case 4: visitor(stateText(diff.state).toStdString()); break;
+	}
+}
+
+MirrorSyncPanel::MirrorSyncPanel(DeviceManager &devices, std::function<void(int unit)> uploadedHandler) : devices_(devices), uploadedHandler_(uploadedHandler),
+	phase_(Phase::Idle), generation_(0), dumpsInFlight_(0), pendingDumps_(0), dumpsTotal_(0), mirrorUnit_(0), startTime_(0.0), progress_(0.0),
+	dumpsComplete_(false), verifiedComplete_(false), progressBar_(progress_),
+	table_({ "Slot", "On device", "In folder", "State" }, {}, [](int) {})
+{
+	for (int i = 0; i < devices_.numberOfUnits(); i++) {
+		units_.addItem(devices_.unitName(i), i + 1);
+	}
+	units_.setSelectedId(1, dontSendNotification);
+	units_.onChange = [this]() {
+		// The comparison was for another unit
+		if (phase_ == Phase::Idle) {
+			mirror_.reset();
+			diffs_.clear();
+			table_.updateData(diffs_);
+			syncButton_.setEnabled(false);
+			status_.setText({}, dontSendNotification);
+		}
+	};
+	addAndMakeVisible(units_);
+
+	folder_.setText(Settings::instance().get(kMirrorFolder, ""), dontSendNotification);
+	addAndMakeVisible(folder_);
+	chooseButton_.setButtonText("Choose folder...");
+	chooseButton_.onClick = [this]() { chooseFolder(); };
+	addAndMakeVisible(chooseButton_);
+
+	compareButton_.setButtonText("Compare");
+	compareButton_.onClick = [this]() { compare(); };
+	addAndMakeVisible(compareButton_);
+	syncButton_.setButtonText("Upload differences");
+	syncButton_.onClick = [this]() { sync(); };
+	syncButton_.setEnabled(false);
+	addAndMakeVisible(syncButton_);
+
+	addAndMakeVisible(progressBar_);
+	addAndMakeVisible(status_);
+	addAndMakeVisible(table_);
+	setSize(800, 700);
+}
+
+MirrorSyncPanel::~MirrorSyncPanel()
+{
+	stopTimer();
+}
+
+void MirrorSyncPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto folderRow = area.removeFromTop(28);
+	units_.setBounds(folderRow.removeFromLeft(250));
+	folderRow.removeFromLeft(8);
+	chooseButton_.setBounds(folderRow.removeFromRight(120));
+	folderRow.removeFromRight(8);
+	folder_.setBounds(folderRow);
+	area.removeFromTop(8);
+	auto actionRow = area.removeFromTop(28);
+	syncButton_.setBounds(actionRow.removeFromRight(150));
+	actionRow.removeFromRight(8);
+	compareButton_.setBounds(actionRow.removeFromRight(120));
+	area.removeFromTop(8);
+	progressBar_.setBounds(area.removeFromTop(20));
+	status_.setBounds(area.removeFromBottom(24));
+	table_.setBounds(area.reduced(0, 8));
+}
+
+void MirrorSyncPanel::chooseFolder()
+{
+	FileChooser chooser("Folder with the presets for the device, named like 01 Name.syx or 01 Name.bcl", File(folder_.getText()));
+	if (chooser.browseForDirectory()) {
+		folder_.setText(chooser.getResult().getFullPathName(), dontSendNotification);
+		Settings::instance().set(kMirrorFolder, chooser.getResult().getFullPathName().toStdString());
+	}
+}
+
+int MirrorSyncPanel::unit() const
+{
+	return jlimit(0, devices_.numberOfUnits() - 1, units_.getSelectedId() - 1);
+}
+
+void MirrorSyncPanel::setPhase(Phase phase)
+{
+	phase_ = phase;
+	bool idle = phase == Phase::Idle;
+	units_.setEnabled(idle);
+	chooseButton_.setEnabled(idle);
+	compareButton_.setEnabled(idle);
+	syncButton_.setEnabled(idle && std::any_of(diffs_.begin(), diffs_.end(), [](DeviceMirror::SlotDiff const &diff) { return needsUpload(diff.state); }));
+	if (idle) {
+		stopTimer();
+	}
+	else {
+		progress_ = 0.0;
+		startTimerHz(kRefreshHz);
+	}
+}
+
+void MirrorSyncPanel::compare()
+{
+	File folder(folder_.getText());
+	if (phase_ != Phase::Idle) {
+		return;
+	}
+	if (folder_.getText().isEmpty() || !folder.isDirectory()) {
+		status_.setText("Choose the folder to compare the device with first", dontSendNotification);
+		return;
+	}
+	problems_.clear();
+	targets_ = DeviceMirror::readTargets(folder, problems_);
+	mirrorUnit_ = unit();
+	auto bcr = devices_.bcr(mirrorUnit_);
+	// Keeps the stored hashes, but only the slots the device dumps now are compared
+	mirror_ = std::make_unique<DeviceMirror>(String(bcr->midiOutput()));
+	startTime_ = Time::getMillisecondCounterHiRes();
+	verifiedComplete_ = false;
+	dumpsTotal_ = 0;
+	setPhase(Phase::Verifying);
+	status_.setText("Reading the preset names from the device...", dontSendNotification);
+
+	// The names the device lists are what every dump is checked against
+	int generation = ++generation_;
+	Component::SafePointer<MirrorSyncPanel> safeThis(this);
+	bcr->invalidateListOfPresets();
+	bcr->refreshListOfPresets([safeThis, generation]() {
+		MessageManager::callAsync([safeThis, generation]() {
+			if (safeThis && safeThis->generation_ == generation) {
+				safeThis->verify();
+			}
+		});
+	});
+}
+
+void MirrorSyncPanel::verify()
+{
+	auto listOfPresets = devices_.bcr(mirrorUnit_)->listOfPresets();
+	std::vector<int> slots;
+	for (int slot = 0; slot < DeviceMirror::kNumberOfSlots; slot++) {
+		slots.push_back(slot);
+	}
+	status_.setText("Verifying the device...", dontSendNotification);
+	requestDumps(slots, [listOfPresets](int slot) {
+		return slot < static_cast<int>(listOfPresets.size()) ? String(listOfPresets[slot]).trim() : String();
+	}, [this](int slot, std::vector<MidiMessage> const &dump) {
+		mirror_->updateFromDump(slot, dump);
+	});
+}
+
+void MirrorSyncPanel::requestDumps(std::vector<int> const &slots, std::function<String(int slot)> expectedName, std::function<void(int slot, std::vector<MidiMessage> const &)> handler)
+{
+	generation_++;
+	queuedSlots_.assign(slots.begin(), slots.end());
+	expectedName_ = expectedName;
+	dumpHandler_ = handler;
+	dumpsInFlight_ = 0;
+	pendingDumps_ = static_cast<int>(slots.size());
+	dumpsTotal_ = pendingDumps_;
+	dumpsComplete_ = true;
+	if (slots.empty()) {
+		dumpsFinished();
+		return;
+	}
+	requestNextDumps();
+}
+
+void MirrorSyncPanel::requestNextDumps()
+{
+	// The sessions answer in order, so the name of each dump tells whether it really is the slot it was matched with
+	int generation = generation_;
+	Component::SafePointer<MirrorSyncPanel> safeThis(this);
+	while (dumpsInFlight_ < kPipelineDepth && !queuedSlots_.empty()) {
+		int slot = queuedSlots_.front();
+		queuedSlots_.pop_front();
+		dumpsInFlight_++;
+		devices_.dumpSessions(mirrorUnit_).requestDump(slot, [safeThis, generation, slot](std::vector<MidiMessage> const &dump) {
+			if (!safeThis || safeThis->generation_ != generation) return;
+			safeThis->dumpsInFlight_--;
+			auto expected = safeThis->expectedName_(slot);
+			auto received = DeviceMirror::presetName(dump);
+			if (expected.isNotEmpty() && received != expected) {
+				safeThis->abortDumps("Slot " + String(slot + 1) + " should hold " + expected + ", but the dump received for it is " + received);
+				return;
+			}
+			safeThis->dumpHandler_(slot, dump);
+			if (--safeThis->pendingDumps_ == 0) {
+				safeThis->dumpsFinished();
+			}
+			else {
+				safeThis->requestNextDumps();
+			}
+		});
+	}
+}
+
+void MirrorSyncPanel::abortDumps(String const &reason)
+{
+	// Late answers of this run belong to no request anymore
+	SimpleLogger::instance()->postMessage(reason);
+	generation_++;
+	queuedSlots_.clear();
+	dumpsInFlight_ = 0;
+	pendingDumps_ = 0;
+	dumpsComplete_ = false;
+	dumpsFinished();
+}
+
+void MirrorSyncPanel::timerCallback()
+{
+	if (mirrorUnit_ >= devices_.numberOfUnits()) {
+		return;
+	}
+	if (phase_ == Phase::Uploading) {
+		progress_ = devices_.status()[mirrorUnit_].progress;
+		return;
+	}
+	if (phase_ == Phase::Verifying || phase_ == Phase::Checking) {
+		progress_ = dumpsTotal_ > 0 ? 1.0 - pendingDumps_ / (double)dumpsTotal_ : 1.0;
+		if (phase_ == Phase::Verifying && dumpsTotal_ == 0 && Time::getMillisecondCounterHiRes() - startTime_ > kNamesTimeoutMs) {
+			abortDumps("The BCR2000 did not list its presets, nothing was verified");
+			return;
+		}
+		if (dumpsInFlight_ > 0 && devices_.dumpSessions(mirrorUnit_).numberOfPendingSessions() == 0) {
+			// The session of a requested dump timed out, the slots not received stay unknown
+			abortDumps(String(pendingDumps_) + " presets were not received from the BCR2000");
+		}
+	}
+}
+
+void MirrorSyncPanel::dumpsFinished()
+{
+	auto seconds = (Time::getMillisecondCounterHiRes() - startTime_) / 1000.0;
+	if (phase_ == Phase::Verifying) {
+		verifiedComplete_ = dumpsComplete_;
+	}
+	// A mirror that missed a dump would claim slots are in sync without having seen them
+	if (verifiedComplete_ && dumpsComplete_) {
+		mirror_->save();
+	}
+	else {
+		SimpleLogger::instance()->postMessage("Not all presets could be verified, the mirror of " + devices_.unitName(mirrorUnit_) + " is not saved");
+	}
+	if (phase_ == Phase::Checking) {
+		showDiff("Uploaded " + String(uploading_.size()) + " presets in " + String(seconds, 2) + " s");
+		if (uploadedHandler_) {
+			uploadedHandler_(mirrorUnit_);
+		}
+	}
+	else {
+		showDiff((dumpsComplete_ ? "Verified in " : "Verification stopped after ") + String(seconds, 2) + " s");
+	}
+}
+
+void MirrorSyncPanel::showDiff(String const &prefix)
+{
+	diffs_ = mirror_->compare(targets_);
+	table_.updateData(diffs_);
+	std::map<DeviceMirror::State, int> counts;
+	for (auto const &diff : diffs_) {
+		counts[diff.state]++;
+	}
+	String text = prefix + ": " + String(counts[DeviceMirror::State::Same]) + " same, " + String(counts[DeviceMirror::State::Differs]) + " differ, "
+		+ String(counts[DeviceMirror::State::Unknown]) + " unknown, " + String(counts[DeviceMirror::State::NoTarget]) + " without file";
+	if (!problems_.isEmpty()) {
+		text += ", " + String(problems_.size()) + " files skipped, see the log";
+		for (auto const &problem : problems_) {
+			SimpleLogger::instance()->postMessage(problem);
+		}
+		problems_.clear();
+	}
+	status_.setText(text, dontSendNotification);
+	SimpleLogger::instance()->postMessage(devices_.unitName(mirrorUnit_) + ": " + text);
+	setPhase(Phase::Idle);
+}
+
+void MirrorSyncPanel::sync()
+{
+	if (phase_ != Phase::Idle || !mirror_) {
+		return;
+	}
+	uploading_.clear();
+	for (auto const &target : targets_) {
+		auto diff = std::find_if(diffs_.begin(), diffs_.end(), [&target](DeviceMirror::SlotDiff const &d) { return d.slot == target.slot; });
+		if (diff != diffs_.end() && needsUpload(diff->state)) {
+			uploading_.push_back(target);
+		}
+	}
+	messageSlots_.clear();
+	std::vector<std::vector<MidiMessage>> messagesPerUnit(static_cast<size_t>(mirrorUnit_ + 1));
+	messagesPerUnit[mirrorUnit_] = DeviceMirror::uploadMessages(*devices_.bcr(mirrorUnit_), uploading_, messageSlots_);
+
+	startTime_ = Time::getMillisecondCounterHiRes();
+	int generation = ++generation_;
+	Component::SafePointer<MirrorSyncPanel> safeThis(this);
+	// Goes through the unit's own transmitter, which counts the upload, so the editors of that unit send everything next time instead of a delta
+	bool started = devices_.sendToUnits(messagesPerUnit, [safeThis, generation]() {
+		if (safeThis && safeThis->generation_ == generation) {
+			safeThis->uploadFinished();
+		}
+	});
+	if (!started) {
+		status_.setText("Still sending to the BCR2000 units, please wait for the upload to finish", dontSendNotification);
+		return;
+	}
+	setPhase(Phase::Uploading);
+}
+
+void MirrorSyncPanel::uploadFinished()
+{
+	auto status = devices_.status()[mirrorUnit_];
+	std::set<int> failedSlots;
+	for (auto const &error : status.errors) {
+		int message = error.lineNumber - 1;
+		int slot = message >= 0 && message < static_cast<int>(messageSlots_.size()) ? messageSlots_[message] : -1;
+		SimpleLogger::instance()->postMessage("Slot " + String(slot + 1) + ": " + String(error.errorText));
+		failedSlots.insert(slot);
+	}
+
+	// Find out what the device made of every preset that went through, all of them are in an unknown state until then
+	std::vector<int> checkSlots;
+	for (auto const &target : uploading_) {
+		mirror_->forget(target.slot);
+		if (!status.aborted && !failedSlots.count(target.slot)) {
+			checkSlots.push_back(target.slot);
+		}
+	}
+	SimpleLogger::instance()->postMessage(devices_.unitName(mirrorUnit_) + ": " + status.summary);
+	setPhase(Phase::Checking);
+	requestDumps(checkSlots, [this](int slot) {
+		auto target = std::find_if(uploading_.begin(), uploading_.end(), [slot](DeviceMirror::Target const &t) { return t.slot == slot; });
+		return target != uploading_.end() ? DeviceMirror::presetName(target->lines) : String();
+	}, [this](int slot, std::vector<MidiMessage> const &dump) {
+		auto target = std::find_if(uploading_.begin(), uploading_.end(), [slot](DeviceMirror::Target const &t) { return t.slot == slot; });
+		if (target != uploading_.end()) {
+			mirror_->updateFromUpload(*target, dump);
+		}
+	});
+}
@@ -0,0 +1,83 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "DeviceManager.h"
+#include "DeviceMirror.h"
+#include "SimpleTable.h"
+
+#include <deque>
+
+// Compares the presets of a unit with a folder and uploads only the slots that differ.
+// Comparing always verifies the device: it dumps every slot, a few requests ahead of the answers, and checks that each dump
+// carries the name the device lists for the slot it was requested for. A mismatch or a missing dump ends the run, and the
+// mirror of a run that didn't see every dump is never saved. The upload sends all differing presets in one transmission,
+// then dumps the slots it stored into so the mirror knows what the device made of them.
+class MirrorSyncPanel : public Component,
+	private Timer
+{
+public:
+	MirrorSyncPanel(DeviceManager &devices, std::function<void(int unit)> uploadedHandler);
+	virtual ~MirrorSyncPanel();
+
+	void resized() override;
+
+private:
+	enum class Phase {
+		Idle,
+		Verifying,
+		Uploading,
+		Checking
+	};
+
+	void timerCallback() override;
+	void chooseFolder();
+	void compare();
+	void sync();
+	void verify();
+	void requestDumps(std::vector<int> const &slots, std::function<String(int slot)> expectedName, std::function<void(int slot, std::vector<MidiMessage> const &)> handler);
+	void requestNextDumps();
+	void abortDumps(String const &reason);
+	void dumpsFinished();
+	void uploadFinished();
+	void showDiff(String const &prefix);
+	int unit() const;
+	void setPhase(Phase phase);
+
+	DeviceManager &devices_;
+	std::function<void(int)> uploadedHandler_;
+	std::unique_ptr<DeviceMirror> mirror_;
+	std::vector<DeviceMirror::Target> targets_;
+	std::vector<DeviceMirror::SlotDiff> diffs_;
+	std::vector<DeviceMirror::Target> uploading_;
+	std::vector<int> messageSlots_;
+	StringArray problems_;
+	Phase phase_;
+	int generation_;
+	std::deque<int> queuedSlots_;
+	std::function<String(int)> expectedName_;
+	std::function<void(int, std::vector<MidiMessage> const &)> dumpHandler_;
+	int dumpsInFlight_;
+	int pendingDumps_;
+	int dumpsTotal_;
+	int mirrorUnit_;
+	double startTime_;
+	double progress_;
+	bool dumpsComplete_;
+	bool verifiedComplete_;
+
+	ComboBox units_;
+	Label folder_;
+	TextButton chooseButton_;
+	TextButton compareButton_;
+	TextButton syncButton_;
+	ProgressBar progressBar_;
+	Label status_;
+	SimpleTable<std::vector<DeviceMirror::SlotDiff>> table_;
+};
@@ -0,0 +1,564 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PresetArchive.h"
+
+#include "BatchConverter.h"
+#include "ContentHash.h"
+#include "DeviceMirror.h"
+#include "DumpSession.h"
+#include "SyxCompilationCache.h"
+#include "SyxScanner.h"
+#include "Trace.h"
+
+#include "Sysex.h"
+
+#include <iomanip>
+#include <iostream>
+#include <set>
+
+namespace {
+	const int kMagic = 0x4c524342; // "BCRL"
+	const int kIndexMagic = 0x49524342; // "BCRI"
+	const int kTrailerMagic = 0x54524342; // "BCRT"
+	const int kVersion = 1;
+	const int64 kHeaderSize = 8;
+	const int64 kTrailerSize = 12;
+	const int kCompressionLevel = 9;
+	// Name terminator, slot, hash, offset and both sizes - no index entry can be shorter
+	const int64 kMinEntrySize = 1 + 1 + 8 + 8 + 4 + 4;
+	const int64 kScanChunkSize = 64 * 1024;
+
+	const char *kLibraryFlag = "--library";
+	const char *kAddFlag = "--add";
+	const char *kExportFlag = "--export";
+	const char *kListFlag = "--list";
+	const char *kCompactFlag = "--compact";
+
+	int slotFromFileName(String const &fileName) {
+		auto number = fileName.initialSectionContainingOnly("0123456789");
+		int slot = number.getIntValue() - 1;
+		return number.isNotEmpty() && slot >= 0 && slot < DeviceMirror::kNumberOfSlots ? slot : -1;
+	}
+}
+
+PresetArchive::PresetArchive() : indexOffset_(0), validEnd_(0)
+{
+}
+
+bool PresetArchive::open(File const &file, String &outError)
+{
+	Trace::Span span("archive.open");
+	file_ = file;
+	entries_.clear();
+	byName_.clear();
+	byHash_.clear();
+	if (!file.existsAsFile()) {
+		FileOutputStream out(file);
+		if (!out.openedOk()) {
+			outError = "Could not create " + file.getFullPathName();
+			return false;
+		}
+		out.writeInt(kMagic);
+		out.writeInt(kVersion);
+		indexOffset_ = out.getPosition();
+		if (!writeIndexAndTrailer(out, entries_)) {
+			outError = "Could not write " + file.getFullPathName();
+			return false;
+		}
+		validEnd_ = out.getPosition();
+		return true;
+	}
+
+	FileInputStream in(file);
+	if (!in.openedOk()) {
+		outError = "Could not open " + file.getFullPathName();
+		return false;
+	}
+	if (in.getTotalLength() < kHeaderSize + kTrailerSize || in.readInt() != kMagic) {
+		outError = file.getFileName() + " is no preset library";
+		return false;
+	}
+	if (in.readInt() > kVersion) {
+		outError = file.getFileName() + " was written by a newer version of this program";
+		return false;
+	}
+	// Only the trailer and the index are read, the presets stay on disk until somebody asks for them. Normally the trailer is at
+	// the very end, after an incomplete append it is the last one whose index ends right where it starts
+	int64 end = in.getTotalLength();
+	for (int64 magicAt = findTrailerMagic(in, end); magicAt >= 0; magicAt = findTrailerMagic(in, magicAt + 3)) {
+		int64 trailerStart = magicAt - 8;
+		in.setPosition(trailerStart);
+		int64 indexOffset = in.readInt64();
+		if (indexOffset < kHeaderSize || indexOffset >= trailerStart) {
+			continue;
+		}
+		in.setPosition(indexOffset);
+		String ignored;
+		if (readIndex(in, trailerStart, ignored)) {
+			indexOffset_ = indexOffset;
+			validEnd_ = magicAt + 4;
+			return true;
+		}
+	}
+	outError = file.getFileName() + " is damaged, its index can't be found";
+	return false;
+}
+
+int64 PresetArchive::findTrailerMagic(FileInputStream &in, int64 end)
+{
+	// The last position before end holding the trailer magic, with room for the index offset in front of it
+	const char magic[4] = { 'B', 'C', 'R', 'T' };
+	int64 lowest = kHeaderSize + 8;
+	MemoryBlock chunk;
+	int64 chunkEnd = end;
+	while (chunkEnd - 4 >= lowest) {
+		int64 chunkStart = jmax(lowest, chunkEnd - kScanChunkSize);
+		chunk.setSize(static_cast<size_t>(chunkEnd - chunkStart));
+		if (!in.setPosition(chunkStart) || in.read(chunk.getData(), static_cast<int>(chunk.getSize())) != static_cast<int>(chunk.getSize())) {
+			return -1;
+		}
+		auto bytes = static_cast<const char *>(chunk.getData());
+		for (int64 i = static_cast<int64>(chunk.getSize()) - 4; i >= 0; i--) {
+			if (memcmp(bytes + i, magic, 4) == 0) {
+				return chunkStart + i;
+			}
+		}
+		// Overlap by three bytes, a magic might straddle the chunks
+		chunkEnd = chunkStart + 3;
+		if (chunkStart == lowest) {
+			break;
+		}
+	}
+	return -1;
+}
+
+File PresetArchive::file() const
+{
+	return file_;
+}
+
+bool PresetArchive::readIndex(FileInputStream &in, int64 indexEnd, String &outError)
+{
+	int64 indexOffset = in.getPosition();
+	if (in.readInt() != kIndexMagic) {
+		outError = file_.getFileName() + " is damaged, its index is missing";
+		return false;
+	}
+	// Don't allocate for more entries than the index has room for
+	int count = in.readInt();
+	if (count < 0 || count > (indexEnd - in.getPosition()) / kMinEntrySize) {
+		outError = file_.getFileName() + " is damaged, its index is invalid";
+		return false;
+	}
+	std::vector<Entry> entries(static_cast<size_t>(count));
+	for (auto &entry : entries) {
+		entry.name = in.readString();
+		entry.slot = in.readCompressedInt() - 1;
+		entry.hash = static_cast<uint64>(in.readInt64());
+		entry.offset = in.readInt64();
+		entry.compressedSize = in.readInt();
+		entry.size = in.readInt();
+		if (in.isExhausted() || entry.offset < kHeaderSize || entry.compressedSize < 0 || entry.size < 0 || entry.offset + entry.compressedSize > indexOffset) {
+			outError = file_.getFileName() + " is damaged, its index is invalid";
+			return false;
+		}
+	}
+	if (in.getPosition() != indexEnd) {
+		outError = file_.getFileName() + " is damaged, its index is invalid";
+		return false;
+	}
+	entries_ = std::move(entries);
+	for (int i = 0; i < static_cast<int>(entries_.size()); i++) {
+		byName_[entries_[i].name] = i;
+		byHash_[entries_[i].hash] = i;
+	}
+	return true;
+}
+
+bool PresetArchive::writeIndexAndTrailer(FileOutputStream &out, std::vector<Entry> const &entries)
+{
+	int64 indexOffset = out.getPosition();
+	out.writeInt(kIndexMagic);
+	out.writeInt(static_cast<int>(entries.size()));
+	for (auto const &entry : entries) {
+		out.writeString(entry.name);
+		out.writeCompressedInt(entry.slot + 1);
+		out.writeInt64(static_cast<int64>(entry.hash));
+		out.writeInt64(entry.offset);
+		out.writeInt(entry.compressedSize);
+		out.writeInt(entry.size);
+	}
+	out.writeInt64(indexOffset);
+	out.writeInt(kTrailerMagic);
+	out.flush();
+	return !out.getStatus().failed();
+}
+
+int PresetArchive::size() const
+{
+	return static_cast<int>(entries_.size());
+}
+
+PresetArchive::Entry const &PresetArchive::entry(int index) const
+{
+	return entries_[index];
+}
+
+int PresetArchive::indexOf(String const &name) const
+{
+	auto found = byName_.find(name);
+	return found != byName_.end() ? found->second : -1;
+}
+
+bool PresetArchive::read(int index, std::vector<MidiMessage> &outMessages, String &outError) const
+{
+	Trace::Span span("archive.read");
+	if (index < 0 || index >= size()) {
+		outError = "No preset number " + String(index + 1) + " in " + file_.getFileName();
+		return false;
+	}
+	auto const &entry = entries_[index];
+	FileInputStream in(file_);
+	MemoryBlock compressed;
+	if (!in.openedOk() || !in.setPosition(entry.offset) || in.readIntoMemoryBlock(compressed, entry.compressedSize) != static_cast<size_t>(entry.compressedSize)) {
+		outError = "Could not read " + entry.name + " from " + file_.getFileName();
+		return false;
+	}
+	MemoryBlock raw;
+	{
+		GZIPDecompressorInputStream decompressor(new MemoryInputStream(compressed, false), true);
+		decompressor.readIntoMemoryBlock(raw, entry.size);
+	}
+	outMessages.clear();
+	SyxScanner::forEachMessage(static_cast<const uint8 *>(raw.getData()), raw.getSize(), [&outMessages](SyxScanner::MessageView const &message) {
+		outMessages.push_back(message.toMidiMessage());
+	});
+	if (raw.getSize() != static_cast<size_t>(entry.size) || ContentHash::of(outMessages).value() != entry.hash) {
+		outError = entry.name + " is damaged in " + file_.getFileName();
+		outMessages.clear();
+		return false;
+	}
+	return true;
+}
+
+int PresetArchive::append(std::vector<Preset> const &presets, String &outError)
+{
+	Trace::Span span("archive.append");
+	std::vector<Entry> entries = entries_;
+	std::map<uint64, int> byHash = byHash_;
+	FileOutputStream out(file_);
+	if (!out.openedOk()) {
+		outError = "Could not open " + file_.getFullPathName() + " for writing";
+		return -1;
+	}
+	// Everything goes behind the last valid trailer, which stays valid until the new one is written
+	if (out.getPosition() != validEnd_ && (!out.setPosition(validEnd_) || !out.truncate().wasOk())) {
+		outError = "Could not cut off the incomplete end of " + file_.getFullPathName();
+		return -1;
+	}
+	int64 start = out.getPosition();
+	int added = 0;
+	for (auto const &preset : presets) {
+		auto hash = ContentHash::of(preset.messages).value();
+		if (preset.messages.empty() || byHash.find(hash) != byHash.end()) {
+			continue;
+		}
+		MemoryOutputStream raw;
+		for (auto const &message : preset.messages) {
+			raw.write(message.getRawData(), static_cast<size_t>(message.getRawDataSize()));
+		}
+		MemoryOutputStream compressed;
+		{
+			GZIPCompressorOutputStream compressor(compressed, kCompressionLevel);
+			compressor.write(raw.getData(), raw.getDataSize());
+			compressor.flush();
+		}
+		Entry entry;
+		entry.name = preset.name;
+		entry.slot = preset.slot;
+		entry.hash = hash;
+		entry.offset = out.getPosition();
+		entry.compressedSize = static_cast<int>(compressed.getDataSize());
+		entry.size = static_cast<int>(raw.getDataSize());
+		out.write(compressed.getData(), compressed.getDataSize());
+		byHash[hash] = static_cast<int>(entries.size());
+		entries.push_back(entry);
+		added++;
+	}
+	if (added == 0) {
+		return 0;
+	}
+	int64 indexOffset = out.getPosition();
+	if (!writeIndexAndTrailer(out, entries)) {
+		// Cut off what was written, so the old trailer is at the end again
+		out.setPosition(start);
+		out.truncate();
+		outError = "Could not write to " + file_.getFullPathName();
+		return -1;
+	}
+	indexOffset_ = indexOffset;
+	validEnd_ = out.getPosition();
+	entries_ = std::move(entries);
+	byHash_ = std::move(byHash);
+	for (int i = size() - added; i < size(); i++) {
+		byName_[entries_[i].name] = i;
+	}
+	if (unusedBytes() > indexOffset_ - kHeaderSize - unusedBytes()) {
+		// The presets are appended already, if compacting fails the library just stays bigger than it needs to be
+		String ignored;
+		compact(ignored);
+	}
+	return added;
+}
+
+int64 PresetArchive::unusedBytes() const
+{
+	int64 used = 0;
+	for (auto const &entry : entries_) {
+		used += entry.compressedSize;
+	}
+	return indexOffset_ - kHeaderSize - used;
+}
+
+bool PresetArchive::compact(String &outError)
+{
+	Trace::Span span("archive.compact");
+	// Copied into a new file that replaces the library only once it is complete
+	TemporaryFile temp(file_);
+	std::vector<Entry> entries = entries_;
+	int64 indexOffset;
+	int64 validEnd;
+	{
+		FileInputStream in(file_);
+		FileOutputStream out(temp.getFile());
+		if (!in.openedOk() || !out.openedOk()) {
+			outError = "Could not compact " + file_.getFullPathName();
+			return false;
+		}
+		out.writeInt(kMagic);
+		out.writeInt(kVersion);
+		for (auto &entry : entries) {
+			MemoryBlock block;
+			if (!in.setPosition(entry.offset) || in.readIntoMemoryBlock(block, entry.compressedSize) != static_cast<size_t>(entry.compressedSize)) {
+				outError = "Could not read " + entry.name + " from " + file_.getFileName();
+				return false;
+			}
+			entry.offset = out.getPosition();
+			out.write(block.getData(), block.getSize());
+		}
+		indexOffset = out.getPosition();
+		if (!writeIndexAndTrailer(out, entries)) {
+			outError = "Could not write " + temp.getFile().getFullPathName();
+			return false;
+		}
+		validEnd = out.getPosition();
+	}
+	if (!temp.overwriteTargetFileWithTemporary()) {
+		outError = "Could not replace " + file_.getFullPathName();
+		return false;
+	}
+	// Same entries in the same order, only the offsets changed
+	entries_ = std::move(entries);
+	indexOffset_ = indexOffset;
+	validEnd_ = validEnd;
+	return true;
+}
+
+std::vector<PresetArchive::Preset> PresetArchive::importFile(File const &file, midikraft::BCR2000 &bcr)
+{
+	std::vector<Preset> result;
+	int slot = slotFromFileName(file.getFileNameWithoutExtension());
+	if (BatchConverter::isSyxFile(file)) {
+		// Split after every $end, a file can hold a whole backup
+		Preset preset;
+		for (auto const &message : Sysex::loadSysex(file.getFullPathName().toStdString())) {
+			preset.messages.push_back(message);
+			if (DumpAssembler::isEndOfDump(message)) {
+				result.push_back(preset);
+				preset.messages.clear();
+			}
+		}
+		if (!preset.messages.empty()) {
+			result.push_back(preset);
+		}
+	}
+	else if (BatchConverter::isTextFile(file)) {
+		// Compile line by line and number the messages like the editor does, so the stored sysex is what an upload sends
+		Preset preset;
+		int index = 0;
+		for (auto const &line : StringArray::fromLines(file.loadFileAsString())) {
+			for (auto const &message : bcr.convertToSyx(line.toStdString(), true)) {
+				preset.messages.push_back(SyxCompilationCache::withMessageIndex(message, index++));
+			}
+		}
+		if (!preset.messages.empty()) {
+			result.push_back(preset);
+		}
+	}
+	for (size_t i = 0; i < result.size(); i++) {
+		auto name = DeviceMirror::presetName(result[i].messages);
+		if (name.isEmpty()) {
+			name = file.getFileNameWithoutExtension() + (result.size() > 1 ? " " + String(i + 1) : String());
+		}
+		result[i].name = name;
+		result[i].slot = result.size() > 1 ? -1 : slot;
+	}
+	return result;
+}
+
+bool PresetArchive::exportPreset(int index, File const &syxFile, String &outError) const
+{
+	std::vector<MidiMessage> messages;
+	if (!read(index, messages, outError)) {
+		return false;
+	}
+	// An existing file is only replaced by a complete one
+	TemporaryFile temp(syxFile);
+	Sysex::saveSysex(temp.getFile().getFullPathName().toStdString(), messages);
+	if (!temp.getFile().existsAsFile() || !temp.overwriteTargetFileWithTemporary()) {
+		outError = "Could not write " + syxFile.getFullPathName();
+		return false;
+	}
+	return true;
+}
+
+int PresetArchive::exportAll(File const &directory, StringArray &outErrors) const
+{
+	directory.createDirectory();
+	std::set<String> written;
+	int result = 0;
+	for (int i = 0; i < size(); i++) {
+		// A library can have several presets of the same name, keep them all
+		auto target = directory.getChildFile(exportFileName(entries_[i]));
+		if (written.count(target.getFileName())) {
+			target = target.getNonexistentSibling();
+		}
+		written.insert(target.getFileName());
+		String error;
+		if (exportPreset(i, target, error)) {
+			result++;
+		}
+		else {
+			outErrors.add(error);
+		}
+	}
+	return result;
+}
+
+String PresetArchive::exportFileName(Entry const &entry)
+{
+	return (entry.slot >= 0 ? String(entry.slot + 1).paddedLeft('0', 2) + " " : String()) + File::createLegalFileName(entry.name) + ".syx";
+}
+
+bool PresetArchive::isArchiveCommandLine(String const &commandLine)
+{
+	return StringArray::fromTokens(commandLine, true).contains(kLibraryFlag);
+}
+
+int PresetArchive::runFromCommandLine(String const &commandLine)
+{
+	BatchConverter::attachConsole();
+
+	auto tokens = StringArray::fromTokens(commandLine, true);
+	File archiveFile;
+	StringArray toAdd;
+	File exportDirectory;
+	bool list = false;
+	bool compacting = false;
+	bool adding = false;
+	for (int i = 0; i < tokens.size(); i++) {
+		auto token = tokens[i].unquoted();
+		if (token.isEmpty()) {
+			continue;
+		}
+		else if (token == kLibraryFlag && i + 1 < tokens.size()) {
+			archiveFile = File::getCurrentWorkingDirectory().getChildFile(tokens[++i].unquoted());
+			adding = false;
+		}
+		else if (token == kAddFlag) {
+			adding = true;
+		}
+		else if (token == kExportFlag && i + 1 < tokens.size()) {
+			exportDirectory = File::getCurrentWorkingDirectory().getChildFile(tokens[++i].unquoted());
+			adding = false;
+		}
+		else if (token == kListFlag) {
+			list = true;
+			adding = false;
+		}
+		else if (token == kCompactFlag) {
+			compacting = true;
+			adding = false;
+		}
+		else if (adding) {
+			toAdd.add(token);
+		}
+	}
+	if (archiveFile == File() || (toAdd.isEmpty() && exportDirectory == File() && !list && !compacting)) {
+		std::cerr << "Usage: BCRMaster --library <file.bcrlib> [--add <file or directory> ...] [--export <directory>] [--list] [--compact]" << std::endl;
+		return 1;
+	}
+
+	PresetArchive archive;
+	String error;
+	double startTime = Time::getMillisecondCounterHiRes();
+	if (!archive.open(archiveFile, error)) {
+		std::cerr << error << std::endl;
+		return 2;
+	}
+	std::cout << "Opened " << archive.size() << " presets in " << String(Time::getMillisecondCounterHiRes() - startTime, 1) << " ms" << std::endl;
+
+	int failures = 0;
+	if (!toAdd.isEmpty()) {
+		startTime = Time::getMillisecondCounterHiRes();
+		midikraft::BCR2000 bcr;
+		std::vector<Preset> presets;
+		for (auto const &file : BatchConverter::expandInputs(toAdd)) {
+			auto imported = importFile(file, bcr);
+			if (imported.empty()) {
+				std::cerr << file.getFileName() << ": no preset found" << std::endl;
+				failures++;
+			}
+			presets.insert(presets.end(), imported.begin(), imported.end());
+		}
+		int added = archive.append(presets, error);
+		if (added < 0) {
+			std::cerr << error << std::endl;
+			return 2;
+		}
+		std::cout << "Added " << added << " of " << presets.size() << " presets, the others were already in the library, in "
+			<< String(Time::getMillisecondCounterHiRes() - startTime, 1) << " ms" << std::endl;
+	}
+	if (compacting) {
+		startTime = Time::getMillisecondCounterHiRes();
+		auto unused = archive.unusedBytes();
+		if (!archive.compact(error)) {
+			std::cerr << error << std::endl;
+			return 2;
+		}
+		std::cout << "Compacted, " << unused << " unused bytes removed in " << String(Time::getMillisecondCounterHiRes() - startTime, 1) << " ms" << std::endl;
+	}
+	if (list) {
+		for (int i = 0; i < archive.size(); i++) {
+			auto const &entry = archive.entry(i);
+			std::cout << std::setw(5) << (i + 1) << "  " << (entry.slot >= 0 ? String(entry.slot + 1).paddedLeft(' ', 2) : String("  ")) << "  "
+				<< entry.name << "  " << entry.size << " bytes" << std::endl;
+		}
+	}
+	if (exportDirectory != File()) {
+		startTime = Time::getMillisecondCounterHiRes();
+		StringArray errors;
+		int exported = archive.exportAll(exportDirectory, errors);
+		for (auto const &exportError : errors) {
+			std::cerr << exportError << std::endl;
+		}
+		failures += errors.size();
+		std::cout << "Exported " << exported << " presets to " << exportDirectory.getFullPathName() << " in "
+			<< String(Time::getMillisecondCounterHiRes() - startTime, 1) << " ms" << std::endl;
+	}
+	return failures == 0 ? 0 : 2;
+}
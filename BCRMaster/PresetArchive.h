@@ -0,0 +1,87 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+#include <map>
+
+// A library of many presets in a single .bcrlib file. Every preset is stored as its own zlib compressed block of sysex,
+// followed by an index of all presets and a fixed size trailer pointing to the index:
+//
+//   header   "BCRL", version
+//   block    compressed sysex of one preset, any number of times
+//   index    "BCRI", number of entries, then per entry name, slot, content hash, offset, compressed and uncompressed size
+//   trailer  offset of the index, "BCRT"
+//
+// Opening reads only the trailer and the index, and any preset can then be read with one seek and decompressing just its block.
+// Appending writes the new blocks, a new index and a new trailer at the end, so existing blocks are never rewritten. If an append
+// doesn't complete, the file no longer ends with a trailer: opening then scans back for the last trailer with a complete index,
+// and the next append cuts off what came after it. Old indexes stay behind as unused bytes until they take up more space than
+// the presets, then the library is compacted into a new file that replaces the old one.
+class PresetArchive {
+public:
+	struct Entry {
+		String name;
+		int slot; // Zero-based, -1 if the preset didn't come from a slot
+		uint64 hash; // ContentHash of the sysex
+		int64 offset;
+		int compressedSize;
+		int size;
+	};
+
+	struct Preset {
+		String name;
+		int slot;
+		std::vector<MidiMessage> messages;
+	};
+
+	PresetArchive();
+
+	// Creates the file if it doesn't exist
+	bool open(File const &file, String &outError);
+	File file() const;
+
+	int size() const;
+	Entry const &entry(int index) const;
+	// Index of the last preset appended under this name, or -1
+	int indexOf(String const &name) const;
+
+	bool read(int index, std::vector<MidiMessage> &outMessages, String &outError) const;
+
+	// Presets with content already in the archive are skipped. Returns the number of presets added, or -1 on error.
+	int append(std::vector<Preset> const &presets, String &outError);
+	// Bytes of old indexes and incomplete appends
+	int64 unusedBytes() const;
+	// Rewrites the library without unused bytes
+	bool compact(String &outError);
+
+	// Reads .syx and .bcl files, a .syx file with several presets is split at every $end
+	static std::vector<Preset> importFile(File const &file, midikraft::BCR2000 &bcr);
+	bool exportPreset(int index, File const &syxFile, String &outError) const;
+	// Writes every preset into its own .syx file, named with slot and name. Returns the number of files written.
+	int exportAll(File const &directory, StringArray &outErrors) const;
+	static String exportFileName(Entry const &entry);
+
+	// Command line entry points used by the application before any window is created
+	static bool isArchiveCommandLine(String const &commandLine);
+	static int runFromCommandLine(String const &commandLine);
+
+private:
+	static int64 findTrailerMagic(FileInputStream &in, int64 end);
+	bool readIndex(FileInputStream &in, int64 indexEnd, String &outError);
+	bool writeIndexAndTrailer(FileOutputStream &out, std::vector<Entry> const &entries);
+
+	File file_;
+	int64 indexOffset_;
+	int64 validEnd_; // End of the last trailer, anything behind it is left over from an incomplete append
+	std::vector<Entry> entries_;
+	std::map<String, int> byName_;
+	std::map<uint64, int> byHash_;
+};
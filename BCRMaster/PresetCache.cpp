@@ -0,0 +1,128 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PresetCache.h"
+
+#include "ContentHash.h"
+
+#include "Sysex.h"
+
+namespace {
+	const char *kIndexFileName = "index.xml";
+	const char *kIndexTag = "PresetCache";
+	const char *kSlotTag = "Slot";
+	const char *kNumberAttribute = "number";
+	const char *kNameAttribute = "name";
+	const char *kFingerprintAttribute = "fingerprint";
+}
+
+PresetCache::PresetCache() : PresetCache(File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("BCRMaster").getChildFile("PresetCache"))
+{
+}
+
+PresetCache::PresetCache(File const &directory) : directory_(directory)
+{
+}
+
+bool PresetCache::lookup(String const &device, int slot, String const &presetName, std::vector<MidiMessage> &outMessages)
+{
+	auto &index = deviceIndex(device);
+	auto found = index.find(slot);
+	if (found == index.end() || found->second.name != presetName) {
+		return false;
+	}
+	auto file = contentFile(device, found->second.fingerprint);
+	if (!file.existsAsFile()) {
+		index.erase(found);
+		return false;
+	}
+	outMessages = Sysex::loadSysex(file.getFullPathName().toStdString());
+	if (ContentHash::of(outMessages).toString() != found->second.fingerprint) {
+		// Damaged cache file, don't trust it
+		index.erase(found);
+		file.deleteFile();
+		outMessages.clear();
+		return false;
+	}
+	return true;
+}
+
+bool PresetCache::store(String const &device, int slot, String const &presetName, std::vector<MidiMessage> const &messages)
+{
+	auto fingerprint = ContentHash::of(messages).toString();
+	auto &index = deviceIndex(device);
+	auto found = index.find(slot);
+	bool changed = found == index.end() || found->second.fingerprint != fingerprint;
+	if (!changed && found->second.name == presetName) {
+		return false;
+	}
+
+	auto file = contentFile(device, fingerprint);
+	if (!file.existsAsFile()) {
+		file.getParentDirectory().createDirectory();
+		TemporaryFile temp(file);
+		Sysex::saveSysex(temp.getFile().getFullPathName().toStdString(), messages);
+		temp.overwriteTargetFileWithTemporary();
+	}
+	Entry entry;
+	entry.name = presetName;
+	entry.fingerprint = fingerprint;
+	index[slot] = entry;
+	saveIndex(device);
+	return changed;
+}
+
+void PresetCache::invalidate(String const &device)
+{
+	indices_[device].clear();
+	deviceDirectory(device).deleteRecursively();
+}
+
+PresetCache::TDeviceIndex &PresetCache::deviceIndex(String const &device)
+{
+	auto found = indices_.find(device);
+	if (found != indices_.end()) {
+		return found->second;
+	}
+	auto &index = indices_[device];
+	auto indexFile = deviceDirectory(device).getChildFile(kIndexFileName);
+	if (indexFile.existsAsFile()) {
+		std::unique_ptr<XmlElement> xml(XmlDocument::parse(indexFile));
+		if (xml && xml->hasTagName(kIndexTag)) {
+			forEachXmlChildElementWithTagName(*xml, slot, kSlotTag) {
+				Entry entry;
+				entry.name = slot->getStringAttribute(kNameAttribute);
+				entry.fingerprint = slot->getStringAttribute(kFingerprintAttribute);
+				index[slot->getIntAttribute(kNumberAttribute)] = entry;
+			}
+		}
+	}
+	return index;
+}
+
+void PresetCache::saveIndex(String const &device)
+{
+	XmlElement xml(kIndexTag);
+	for (auto const &slot : indices_[device]) {
+		auto element = xml.createNewChildElement(kSlotTag);
+		element->setAttribute(kNumberAttribute, slot.first);
+		element->setAttribute(kNameAttribute, slot.second.name);
+		element->setAttribute(kFingerprintAttribute, slot.second.fingerprint);
+	}
+	auto directory = deviceDirectory(device);
+	directory.createDirectory();
+	xml.writeToFile(directory.getChildFile(kIndexFileName), String());
+}
+
+File PresetCache::deviceDirectory(String const &device) const
+{
+	return directory_.getChildFile(File::createLegalFileName(device.isEmpty() ? String("unknown") : device));
+}
+
+File PresetCache::contentFile(String const &device, String const &fingerprint) const
+{
+	return deviceDirectory(device).getChildFile(fingerprint + ".syx");
+}
@@ -0,0 +1,44 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <map>
+
+// Persistent cache of the presets downloaded from the devices, so a preset can be shown before the dump from the device arrived.
+// The content is stored content-addressed by its fingerprint, and for each device an index records which content was last seen in which slot,
+// together with the preset name the device listed at that time.
+class PresetCache {
+public:
+	PresetCache();
+	explicit PresetCache(File const &directory);
+
+	// Only returns true if the slot is cached and the device still lists it under the same name
+	bool lookup(String const &device, int slot, String const &presetName, std::vector<MidiMessage> &outMessages);
+
+	// Returns true if the content differs from what was cached for this slot before
+	bool store(String const &device, int slot, String const &presetName, std::vector<MidiMessage> const &messages);
+
+	// Forget everything about a device, e.g. after something was uploaded to it
+	void invalidate(String const &device);
+
+private:
+	struct Entry {
+		String name;
+		String fingerprint;
+	};
+	typedef std::map<int, Entry> TDeviceIndex;
+
+	TDeviceIndex &deviceIndex(String const &device);
+	void saveIndex(String const &device);
+	File deviceDirectory(String const &device) const;
+	File contentFile(String const &device, String const &fingerprint) const;
+
+	File directory_;
+	std::map<String, TDeviceIndex> indices_;
+};
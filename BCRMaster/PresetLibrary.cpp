@@ -0,0 +1,559 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PresetLibrary.h"
+
+#include "BCLDecoder.h"
+#include "BCLDelta.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <iterator>
+
+namespace {
+	const int kIndexMagic = 0x49434c42; // "BLCI"
+	const int kIndexVersion = 1;
+	const size_t kMaxElementsPerMatch = 4;
+
+	const char *typeName(PresetLibrary::MessageType type) {
+		switch (type) {
+		case PresetLibrary::MessageType::CC: return "cc";
+		case PresetLibrary::MessageType::NRPN: return "nrpn";
+		case PresetLibrary::MessageType::Note: return "note";
+		case PresetLibrary::MessageType::ProgramChange: return "pc";
+		case PresetLibrary::MessageType::PitchBend: return "pb";
+		case PresetLibrary::MessageType::AfterTouch: return "at";
+		case PresetLibrary::MessageType::SysEx: return "sysex";
+		default: return "other";
+		}
+	}
+
+	bool hasParameter(PresetLibrary::MessageType type) {
+		return type == PresetLibrary::MessageType::CC || type == PresetLibrary::MessageType::NRPN
+			|| type == PresetLibrary::MessageType::Note || type == PresetLibrary::MessageType::ProgramChange;
+	}
+
+	// Accepts decimal, 0x40 and $40, returns -1 if the text is no number
+	int parseNumber(std::string const &text) {
+		size_t start = 0;
+		int base = 10;
+		if (text.size() > 1 && text[0] == '$') {
+			start = 1;
+			base = 16;
+		}
+		else if (text.size() > 2 && text[0] == '0' && text[1] == 'x') {
+			start = 2;
+			base = 16;
+		}
+		if (start >= text.size()) return -1;
+		int result = 0;
+		for (size_t i = start; i < text.size(); i++) {
+			int digit = CharacterFunctions::getHexDigitValue(static_cast<juce_wchar>(text[i]));
+			if (digit < 0 || digit >= base || result > 0xffff) return -1;
+			result = result * base + digit;
+		}
+		return result;
+	}
+
+	std::vector<std::string> words(std::string const &normalizedLine) {
+		std::vector<std::string> result;
+		size_t start = 0;
+		while (start < normalizedLine.size()) {
+			auto end = normalizedLine.find(' ', start);
+			if (end == std::string::npos) end = normalizedLine.size();
+			result.push_back(normalizedLine.substr(start, end - start));
+			start = end + 1;
+		}
+		return result;
+	}
+
+	bool termMatches(std::string const &token, std::string const &term) {
+		// Terms ending with a number must match exactly, or cc1 would also find cc10 to cc127
+		if (!term.empty() && std::isdigit(static_cast<unsigned char>(term.back()))) {
+			return token == term;
+		}
+		return token.compare(0, term.size(), term) == 0;
+	}
+
+	// Collects names and element definitions from the BCL lines of one file
+	class EntryParser {
+	public:
+		explicit EntryParser(PresetLibrary::Entry &entry) : entry_(entry), inPreset_(false), inControl_(false), controlDefined_(false) {
+			current_.control = PresetLibrary::ControlType::Encoder;
+			current_.controlNumber = 0;
+		}
+
+		void line(const char *text, size_t length) {
+			auto normalized = BCLDelta::normalize(std::string(text, length));
+			if (normalized.empty()) {
+				return;
+			}
+			auto tokens = words(normalized);
+			if (normalized[0] == '$') {
+				inPreset_ = tokens[0] == "$preset";
+				inControl_ = (tokens[0] == "$encoder" || tokens[0] == "$button") && tokens.size() > 1;
+				controlDefined_ = false;
+				if (inControl_) {
+					current_.control = tokens[0] == "$encoder" ? PresetLibrary::ControlType::Encoder : PresetLibrary::ControlType::Button;
+					current_.controlNumber = static_cast<uint16>(std::max(0, parseNumber(tokens[1])));
+				}
+			}
+			else if (inPreset_ && tokens[0] == ".name") {
+				auto first = normalized.find('\'');
+				auto last = normalized.rfind('\'');
+				if (first != std::string::npos && last > first + 1) {
+					auto name = String(normalized.substr(first + 1, last - first - 1)).trim();
+					if (name.isNotEmpty()) {
+						entry_.presetNames.addIfNotAlreadyThere(name);
+					}
+				}
+			}
+			else if (inControl_ && !controlDefined_ && tokens[0] == ".easypar" && tokens.size() > 2) {
+				parseEasyPar(tokens);
+			}
+			else if (inControl_ && !controlDefined_ && tokens[0] == ".tx" && tokens.size() > 1) {
+				parseTx(tokens);
+			}
+		}
+
+	private:
+		void parseEasyPar(std::vector<std::string> const &tokens) {
+			auto const &type = tokens[1];
+			auto assignment = current_;
+			assignment.channel = static_cast<uint8>(std::max(0, parseNumber(tokens[2])));
+			assignment.parameter = tokens.size() > 3 ? static_cast<uint16>(std::max(0, parseNumber(tokens[3]))) : 0;
+			if (type == "cc") assignment.type = PresetLibrary::MessageType::CC;
+			else if (type == "nrpn") assignment.type = PresetLibrary::MessageType::NRPN;
+			else if (type == "note") assignment.type = PresetLibrary::MessageType::Note;
+			else if (type == "pc") assignment.type = PresetLibrary::MessageType::ProgramChange;
+			else if (type == "pb") assignment.type = PresetLibrary::MessageType::PitchBend;
+			else if (type == "after" || type == "aftertouch") assignment.type = PresetLibrary::MessageType::AfterTouch;
+			else assignment.type = PresetLibrary::MessageType::Other;
+			if (!hasParameter(assignment.type)) {
+				assignment.parameter = 0;
+			}
+			add(assignment);
+		}
+
+		void parseTx(std::vector<std::string> const &tokens) {
+			// Only the first byte tells what the element sends, the rest is data or value placeholders
+			int status = parseNumber(tokens[1]);
+			if (status < 0x80 || status > 0xff) {
+				return;
+			}
+			auto assignment = current_;
+			assignment.channel = static_cast<uint8>(status < 0xf0 ? (status & 0x0f) + 1 : 0);
+			int data = tokens.size() > 2 ? parseNumber(tokens[2]) : -1;
+			assignment.parameter = static_cast<uint16>(std::max(0, data));
+			switch (status & 0xf0) {
+			case 0x80: // Fall through
+			case 0x90: assignment.type = PresetLibrary::MessageType::Note; break;
+			case 0xb0: assignment.type = PresetLibrary::MessageType::CC; break;
+			case 0xc0: assignment.type = PresetLibrary::MessageType::ProgramChange; break;
+			case 0xd0: assignment.type = PresetLibrary::MessageType::AfterTouch; break;
+			case 0xe0: assignment.type = PresetLibrary::MessageType::PitchBend; break;
+			case 0xf0: assignment.type = PresetLibrary::MessageType::SysEx; break;
+			default: assignment.type = PresetLibrary::MessageType::Other; break;
+			}
+			if (!hasParameter(assignment.type) || data < 0) {
+				assignment.parameter = 0;
+			}
+			add(assignment);
+		}
+
+		void add(PresetLibrary::Assignment const &assignment) {
+			entry_.assignments.push_back(assignment);
+			controlDefined_ = true;
+		}
+
+		PresetLibrary::Entry &entry_;
+		PresetLibrary::Assignment current_;
+		bool inPreset_;
+		bool inControl_;
+		bool controlDefined_;
+	};
+}
+
+class PresetLibrary::ParseJob : public ThreadPoolJob {
+public:
+	ParseJob(std::vector<Entry> &entries, std::vector<int> const &toParse, std::atomic<int> &next, std::atomic<int> &done, std::atomic<bool> &abort) : ThreadPoolJob("Index presets"),
+		entries_(entries), toParse_(toParse), next_(next), done_(done), abort_(abort)
+	{
+	}
+
+	JobStatus runJob() override {
+		// All jobs pull from the same list, so a few big archives don't leave the other threads idle
+		int i;
+		while (!abort_ && (i = next_++) < static_cast<int>(toParse_.size())) {
+			auto &entry = entries_[toParse_[i]];
+			parseFile(File(entry.path), entry);
+			done_++;
+		}
+		return jobHasFinished;
+	}
+
+private:
+	std::vector<Entry> &entries_;
+	std::vector<int> const &toParse_;
+	std::atomic<int> &next_;
+	std::atomic<int> &done_;
+	std::atomic<bool> &abort_;
+};
+
+PresetLibrary::PresetLibrary() : PresetLibrary(File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("BCRMaster").getChildFile("PresetLibrary.index"))
+{
+}
+
+PresetLibrary::PresetLibrary(File const &indexFile) : indexFile_(indexFile)
+{
+}
+
+bool PresetLibrary::load()
+{
+	FileInputStream in(indexFile_);
+	if (!in.openedOk() || in.readInt() != kIndexMagic || in.readInt() != kIndexVersion) {
+		return false;
+	}
+	std::vector<Entry> entries(static_cast<size_t>(std::max(0, in.readInt())));
+	for (auto &entry : entries) {
+		entry.path = in.readString();
+		entry.modified = in.readInt64();
+		entry.size = in.readInt64();
+		int numNames = in.readCompressedInt();
+		for (int i = 0; i < numNames; i++) {
+			entry.presetNames.add(in.readString());
+		}
+		entry.assignments.resize(static_cast<size_t>(std::max(0, in.readCompressedInt())));
+		for (auto &assignment : entry.assignments) {
+			assignment.control = static_cast<ControlType>(in.readByte());
+			assignment.controlNumber = static_cast<uint16>(in.readShort());
+			assignment.type = static_cast<MessageType>(in.readByte());
+			assignment.channel = static_cast<uint8>(in.readByte());
+			assignment.parameter = static_cast<uint16>(in.readShort());
+		}
+		if (in.isExhausted() && &entry != &entries.back()) {
+			// Truncated index file, better to start from scratch
+			return false;
+		}
+	}
+
+	ScopedLock lock(lock_);
+	entries_ = std::move(entries);
+	rebuildTokenIndex();
+	return true;
+}
+
+bool PresetLibrary::save() const
+{
+	indexFile_.getParentDirectory().createDirectory();
+	TemporaryFile temp(indexFile_);
+	{
+		FileOutputStream out(temp.getFile());
+		if (!out.openedOk()) {
+			return false;
+		}
+		out.writeInt(kIndexMagic);
+		out.writeInt(kIndexVersion);
+		out.writeInt(static_cast<int>(entries_.size()));
+		for (auto const &entry : entries_) {
+			out.writeString(entry.path);
+			out.writeInt64(entry.modified);
+			out.writeInt64(entry.size);
+			out.writeCompressedInt(entry.presetNames.size());
+			for (auto const &name : entry.presetNames) {
+				out.writeString(name);
+			}
+			out.writeCompressedInt(static_cast<int>(entry.assignments.size()));
+			for (auto const &assignment : entry.assignments) {
+				out.writeByte(static_cast<char>(assignment.control));
+				out.writeShort(static_cast<short>(assignment.controlNumber));
+				out.writeByte(static_cast<char>(assignment.type));
+				out.writeByte(static_cast<char>(assignment.channel));
+				out.writeShort(static_cast<short>(assignment.parameter));
+			}
+		}
+		out.flush();
+		if (out.getStatus().failed()) {
+			return false;
+		}
+	}
+	return temp.overwriteTargetFileWithTemporary();
+}
+
+PresetLibrary::RefreshStatistics PresetLibrary::refresh(StringArray const &directories, std::function<void(double)> progressHandler, std::function<bool()> shouldAbort)
+{
+	double startTime = Time::getMillisecondCounterHiRes();
+	RefreshStatistics statistics = { 0, 0, 0, 0.0 };
+
+	Array<File> files;
+	for (auto const &directory : directories) {
+		File root(directory);
+		if (root.isDirectory()) {
+			files.addArray(root.findChildFiles(File::findFiles, true, "*.syx;*.bcl;*.bcr"));
+		}
+	}
+
+	std::map<String, Entry> previous;
+	{
+		ScopedLock lock(lock_);
+		for (auto const &entry : entries_) {
+			previous[entry.path] = entry;
+		}
+	}
+
+	// Everything that didn't change since the last refresh is taken over from the index
+	std::vector<Entry> entries(static_cast<size_t>(files.size()));
+	std::vector<int> toParse;
+	for (int i = 0; i < files.size(); i++) {
+		auto const &file = files.getReference(i);
+		auto found = previous.find(file.getFullPathName());
+		if (found != previous.end() && found->second.modified == file.getLastModificationTime().toMilliseconds() && found->second.size == file.getSize()) {
+			entries[i] = std::move(found->second);
+			previous.erase(found);
+		}
+		else {
+			entries[i].path = file.getFullPathName();
+			toParse.push_back(i);
+		}
+	}
+
+	std::atomic<int> next(0);
+	std::atomic<int> done(0);
+	std::atomic<bool> abort(false);
+	{
+		ThreadPool pool(SystemStats::getNumCpus());
+		for (int i = 0; i < SystemStats::getNumCpus(); i++) {
+			pool.addJob(new ParseJob(entries, toParse, next, done, abort), true);
+		}
+		// Don't let the pool destructor interrupt running jobs, wait until all are done
+		while (pool.getNumJobs() > 0) {
+			if (progressHandler && !toParse.empty()) {
+				progressHandler(done / static_cast<double>(toParse.size()));
+			}
+			if (shouldAbort && shouldAbort()) {
+				abort = true;
+			}
+			Thread::sleep(20);
+		}
+	}
+
+	statistics.files = files.size();
+	statistics.parsed = done;
+	statistics.seconds = (Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+	if (abort) {
+		// Keep the old index rather than one with holes
+		return statistics;
+	}
+	for (auto const &removed : previous) {
+		// Files that were parsed again are still in previous, only count the ones that are gone
+		if (!File(removed.first).existsAsFile()) statistics.removed++;
+	}
+
+	ScopedLock lock(lock_);
+	entries_ = std::move(entries);
+	rebuildTokenIndex();
+	save();
+	statistics.seconds = (Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+	return statistics;
+}
+
+bool PresetLibrary::parseFile(File const &file, Entry &outEntry)
+{
+	outEntry.path = file.getFullPathName();
+	outEntry.modified = file.getLastModificationTime().toMilliseconds();
+	outEntry.size = file.getSize();
+	outEntry.presetNames.clear();
+	outEntry.assignments.clear();
+
+	EntryParser parser(outEntry);
+	int lines = 0;
+	auto sink = [&parser, &lines](const char *text, size_t length) {
+		parser.line(text, length);
+		lines++;
+	};
+	if (file.getFileExtension().toLowerCase() == ".syx") {
+		SyxScanner scanner(file);
+		if (!scanner.openedOk()) {
+			return false;
+		}
+		BCLDecoder::decode(scanner, sink);
+	}
+	else {
+		MemoryMappedFile mapping(file, MemoryMappedFile::readOnly);
+		auto text = static_cast<const char *>(mapping.getData());
+		if (text == nullptr) {
+			return false;
+		}
+		size_t size = mapping.getSize();
+		size_t start = 0;
+		while (start < size) {
+			auto end = start;
+			while (end < size && text[end] != '\n') end++;
+			auto length = end - start;
+			if (length > 0 && text[start + length - 1] == '\r') length--;
+			sink(text + start, length);
+			start = end + 1;
+		}
+	}
+	return lines > 0;
+}
+
+String PresetLibrary::describe(Assignment const &assignment)
+{
+	String result = assignment.control == ControlType::Encoder ? "Encoder " : "Button ";
+	result << static_cast<int>(assignment.controlNumber) << ": " << String(typeName(assignment.type)).toUpperCase();
+	if (hasParameter(assignment.type)) {
+		result << " " << static_cast<int>(assignment.parameter);
+	}
+	if (assignment.channel != 0) {
+		result << " ch " << static_cast<int>(assignment.channel);
+	}
+	return result;
+}
+
+size_t PresetLibrary::size() const
+{
+	ScopedLock lock(lock_);
+	return entries_.size();
+}
+
+void PresetLibrary::nameTokens(String const &text, TTokenSink const &sink)
+{
+	std::string word;
+	for (auto c : text.toLowerCase().toStdString()) {
+		if (std::isalnum(static_cast<unsigned char>(c)) || (c & 0x80)) {
+			word.push_back(c);
+		}
+		else if (!word.empty()) {
+			sink(word);
+			word.clear();
+		}
+	}
+	if (!word.empty()) {
+		sink(word);
+	}
+}
+
+void PresetLibrary::assignmentTokens(Assignment const &assignment, TTokenSink const &sink)
+{
+	std::string control = (assignment.control == ControlType::Encoder ? "encoder" : "button") + std::to_string(assignment.controlNumber);
+	std::string message = typeName(assignment.type);
+	sink(message);
+	if (hasParameter(assignment.type)) {
+		message += std::to_string(assignment.parameter);
+		sink(message);
+	}
+	sink(control);
+	sink(control + "/" + message);
+	if (assignment.channel != 0) {
+		sink("ch" + std::to_string(assignment.channel));
+	}
+}
+
+std::string PresetLibrary::normalizeTerm(std::string const &term)
+{
+	// Turn nrpn0x40 into nrpn64, for each part of encoder12/nrpn$40
+	std::string result;
+	size_t start = 0;
+	while (start <= term.size()) {
+		auto end = term.find('/', start);
+		if (end == std::string::npos) end = term.size();
+		auto part = term.substr(start, end - start);
+		size_t letters = 0;
+		while (letters < part.size() && std::isalpha(static_cast<unsigned char>(part[letters]))) letters++;
+		int number = parseNumber(part.substr(letters));
+		if (!result.empty()) result.push_back('/');
+		result += number >= 0 ? part.substr(0, letters) + std::to_string(number) : part;
+		start = end + 1;
+	}
+	return result;
+}
+
+void PresetLibrary::rebuildTokenIndex()
+{
+	tokens_.clear();
+	for (int i = 0; i < static_cast<int>(entries_.size()); i++) {
+		auto add = [this, i](std::string const &token) {
+			auto &postings = tokens_[token];
+			// Entries are visited in order, so the list stays sorted and only needs a check against the last
+			if (postings.empty() || postings.back() != i) {
+				postings.push_back(i);
+			}
+		};
+		auto const &entry = entries_[i];
+		for (auto const &name : entry.presetNames) {
+			nameTokens(name, add);
+		}
+		nameTokens(File(entry.path).getFileNameWithoutExtension(), add);
+		for (auto const &assignment : entry.assignments) {
+			assignmentTokens(assignment, add);
+		}
+	}
+}
+
+std::vector<PresetLibrary::Match> PresetLibrary::search(String const &query, size_t maxResults) const
+{
+	std::vector<std::string> terms;
+	for (auto const &term : StringArray::fromTokens(query.toLowerCase(), false)) {
+		if (term.isNotEmpty()) {
+			terms.push_back(normalizeTerm(term.toStdString()));
+		}
+	}
+
+	ScopedLock lock(lock_);
+	std::vector<int> hits;
+	if (terms.empty()) {
+		for (int i = 0; i < static_cast<int>(entries_.size()) && hits.size() < maxResults; i++) {
+			hits.push_back(i);
+		}
+	}
+	for (size_t t = 0; t < terms.size(); t++) {
+		auto const &term = terms[t];
+		std::vector<int> termHits;
+		for (auto it = tokens_.lower_bound(term); it != tokens_.end() && it->first.compare(0, term.size(), term) == 0; ++it) {
+			if (termMatches(it->first, term)) {
+				termHits.insert(termHits.end(), it->second.begin(), it->second.end());
+			}
+		}
+		std::sort(termHits.begin(), termHits.end());
+		termHits.erase(std::unique(termHits.begin(), termHits.end()), termHits.end());
+		if (t == 0) {
+			hits = std::move(termHits);
+		}
+		else {
+			std::vector<int> both;
+			std::set_intersection(hits.begin(), hits.end(), termHits.begin(), termHits.end(), std::back_inserter(both));
+			hits = std::move(both);
+		}
+		if (hits.empty()) break;
+	}
+
+	std::vector<Match> result;
+	for (auto i : hits) {
+		if (result.size() >= maxResults) break;
+		auto const &entry = entries_[i];
+		Match match;
+		match.path = entry.path;
+		match.presetNames = entry.presetNames.isEmpty() ? File(entry.path).getFileNameWithoutExtension() : entry.presetNames.joinIntoString(", ");
+		// Show the elements that made this a hit
+		StringArray elements;
+		for (auto const &assignment : entry.assignments) {
+			bool matches = false;
+			assignmentTokens(assignment, [&terms, &matches](std::string const &token) {
+				for (auto const &term : terms) {
+					if (termMatches(token, term)) matches = true;
+				}
+			});
+			if (matches && elements.size() < static_cast<int>(kMaxElementsPerMatch)) {
+				elements.add(describe(assignment));
+			}
+		}
+		match.matchingElements = elements.joinIntoString("; ");
+		result.push_back(match);
+	}
+	return result;
+}
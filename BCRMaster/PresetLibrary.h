@@ -0,0 +1,84 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <map>
+
+// Searchable index over the .bcl and .syx preset files on disk. For every file it records the preset names and which MIDI message
+// each encoder and button sends, and keeps that in a compact binary index file so only new or modified files need to be read again.
+//
+// Queries are a list of terms which all must match:
+//   plain words match the preset and file names, by prefix ("bass" finds "Bassline 2")
+//   encoder12, button3, cc7, nrpn64, note60, pc5, ch2 match element definitions, numbers may be given as 0x40 or $40
+//   encoder12/nrpn0x40 matches only if that very encoder sends that message
+class PresetLibrary {
+public:
+	enum class ControlType : uint8 { Encoder = 0, Button = 1 };
+	enum class MessageType : uint8 { Other = 0, CC, NRPN, Note, ProgramChange, PitchBend, AfterTouch, SysEx };
+
+	struct Assignment {
+		ControlType control;
+		uint16 controlNumber;
+		MessageType type;
+		uint8 channel; // 1-based, 0 if not applicable
+		uint16 parameter;
+	};
+
+	struct Entry {
+		String path;
+		int64 modified;
+		int64 size;
+		StringArray presetNames;
+		std::vector<Assignment> assignments;
+	};
+
+	struct Match {
+		String path;
+		String presetNames;
+		String matchingElements;
+	};
+
+	struct RefreshStatistics {
+		int files;
+		int parsed;
+		int removed;
+		double seconds;
+	};
+
+	PresetLibrary();
+	explicit PresetLibrary(File const &indexFile);
+
+	// Read the index file written by the last refresh, returns false if there was none or it is not readable
+	bool load();
+
+	// Bring the index up to date with the directories, parsing the files in parallel. Blocks, so call it from a background thread.
+	RefreshStatistics refresh(StringArray const &directories, std::function<void(double)> progressHandler, std::function<bool()> shouldAbort);
+
+	std::vector<Match> search(String const &query, size_t maxResults) const;
+	size_t size() const;
+
+	static bool parseFile(File const &file, Entry &outEntry);
+	static String describe(Assignment const &assignment);
+
+private:
+	class ParseJob;
+	typedef std::function<void(std::string const &)> TTokenSink;
+
+	bool save() const;
+	void rebuildTokenIndex();
+	static void nameTokens(String const &text, TTokenSink const &sink);
+	static void assignmentTokens(Assignment const &assignment, TTokenSink const &sink);
+	static std::string normalizeTerm(std::string const &term);
+
+	File indexFile_;
+	mutable CriticalSection lock_;
+	std::vector<Entry> entries_;
+	// Token to the sorted list of entries containing it
+	std::map<std::string, std::vector<int>> tokens_;
+};
@@ -0,0 +1,167 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "RoutingPanel.h"
+
+#include "Logger.h"
+#include "Settings.h"
+
+namespace {
+	const char *kRouterInput = "RouterInput";
+	const char *kRouterOutput = "RouterOutput";
+	const int kRefreshHz = 2;
+
+	const char *kExample =
+		"# One mapping per line, see the README for the details\n"
+		"# cc 1 7 -> nrpn 2 1234 range 0 16383 curve exp\n"
+		"# cc 1 8 -> sysex F0 43 10 4C 02 01 vv F7\n"
+		"# cc 1 9 -> cc 3 74 curve log invert\n"
+		"# channel 5 -> channel 6\n"
+		"# thru off\n";
+
+	File mappingFile() {
+		return File::getSpecialLocation(File::userApplicationDataDirectory).getChildFile("BCRMaster").getChildFile("Routing.txt");
+	}
+}
+
+RoutingPanel::RoutingPanel(MidiRouter &router, String const &defaultInput) : router_(router)
+{
+	inputLabel_.setText("From", dontSendNotification);
+	addAndMakeVisible(inputLabel_);
+	addAndMakeVisible(inputs_);
+	outputLabel_.setText("To", dontSendNotification);
+	addAndMakeVisible(outputLabel_);
+	addAndMakeVisible(outputs_);
+	refreshPorts(defaultInput);
+
+	startButton_.onClick = [this]() { toggleRouting(); };
+	addAndMakeVisible(startButton_);
+	updateStartButton();
+
+	mappings_.setMultiLine(true, false);
+	mappings_.setReturnKeyStartsNewLine(true);
+	mappings_.setFont(Font(Font::getDefaultMonospacedFontName(), 14.0f, Font::plain));
+	mappings_.setText(storedMappings(), dontSendNotification);
+	addAndMakeVisible(mappings_);
+
+	applyButton_.setButtonText("Apply mappings");
+	applyButton_.onClick = [this]() { apply(); };
+	addAndMakeVisible(applyButton_);
+
+	resetButton_.setButtonText("Reset statistics");
+	resetButton_.onClick = [this]() { router_.resetStatistics(); };
+	addAndMakeVisible(resetButton_);
+
+	errors_.setColour(Label::textColourId, Colours::orange);
+	addAndMakeVisible(errors_);
+	addAndMakeVisible(statistics_);
+
+	timerCallback();
+	startTimerHz(kRefreshHz);
+	setSize(800, 500);
+}
+
+RoutingPanel::~RoutingPanel()
+{
+	stopTimer();
+}
+
+void RoutingPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	auto ports = area.removeFromTop(28);
+	startButton_.setBounds(ports.removeFromRight(120));
+	ports.removeFromRight(8);
+	inputLabel_.setBounds(ports.removeFromLeft(50));
+	auto half = ports.getWidth() / 2;
+	inputs_.setBounds(ports.removeFromLeft(half - 50));
+	outputLabel_.setBounds(ports.removeFromLeft(50));
+	outputs_.setBounds(ports);
+
+	statistics_.setBounds(area.removeFromBottom(24));
+	auto buttons = area.removeFromBottom(36).withTrimmedTop(8);
+	applyButton_.setBounds(buttons.removeFromLeft(140));
+	resetButton_.setBounds(buttons.removeFromRight(140));
+	errors_.setBounds(area.removeFromBottom(48));
+	area.removeFromTop(8);
+	mappings_.setBounds(area);
+}
+
+String RoutingPanel::storedMappings()
+{
+	auto file = mappingFile();
+	return file.existsAsFile() ? file.loadFileAsString() : String(kExample);
+}
+
+void RoutingPanel::apply()
+{
+	StringArray errors;
+	auto table = RoutingTable::parse(mappings_.getText(), errors);
+	auto rules = table->numberOfRules();
+	router_.setTable(std::move(table));
+	errors_.setText(errors.joinIntoString("\n"), dontSendNotification);
+
+	auto file = mappingFile();
+	file.getParentDirectory().createDirectory();
+	if (!file.replaceWithText(mappings_.getText())) {
+		errors_.setText("Could not store mappings in " + file.getFullPathName(), dontSendNotification);
+	}
+	SimpleLogger::instance()->postMessage("Routing " + String(rules) + " mappings" + (errors.isEmpty() ? String() : ", " + String(errors.size()) + " lines with errors ignored"));
+}
+
+void RoutingPanel::toggleRouting()
+{
+	if (router_.isRunning()) {
+		router_.stop();
+	}
+	else {
+		apply();
+		auto input = inputs_.getText();
+		auto output = outputs_.getText();
+		if (router_.start(input, output)) {
+			Settings::instance().set(kRouterInput, input.toStdString());
+			Settings::instance().set(kRouterOutput, output.toStdString());
+		}
+		else {
+			errors_.setText("Could not open " + input + " and " + output, dontSendNotification);
+		}
+	}
+	updateStartButton();
+}
+
+void RoutingPanel::refreshPorts(String const &defaultInput)
+{
+	auto inputs = MidiInput::getDevices();
+	auto outputs = MidiOutput::getDevices();
+	inputs_.addItemList(inputs, 1);
+	outputs_.addItemList(outputs, 1);
+
+	String input = Settings::instance().get(kRouterInput, defaultInput.toStdString());
+	String output = Settings::instance().get(kRouterOutput, "");
+	inputs_.setSelectedItemIndex(jmax(0, inputs.indexOf(input)), dontSendNotification);
+	outputs_.setSelectedItemIndex(jmax(0, outputs.indexOf(output)), dontSendNotification);
+}
+
+void RoutingPanel::updateStartButton()
+{
+	startButton_.setButtonText(router_.isRunning() ? "Stop routing" : "Start routing");
+	inputs_.setEnabled(!router_.isRunning());
+	outputs_.setEnabled(!router_.isRunning());
+}
+
+void RoutingPanel::timerCallback()
+{
+	auto statistics = router_.statistics();
+	String text = String(static_cast<int64>(statistics.routed)) + " messages routed";
+	if (statistics.routed > 0) {
+		text += ", latency p50 " + String(statistics.p50Us, 0) + " us, p99 " + String(statistics.p99Us, 0) + " us, p99.9 " + String(statistics.p999Us, 0)
+			+ " us, max " + String(statistics.maxUs, 0) + " us";
+	}
+	if (statistics.dropped > 0) {
+		text += ", " + String(static_cast<int64>(statistics.dropped)) + " dropped";
+	}
+	statistics_.setText(text, dontSendNotification);
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "MidiRouter.h"
+
+// Edits the mapping text of the MidiRouter, chooses its ports and shows how many messages it routed and how fast.
+// The router keeps running when the panel is closed. The mapping text is stored in the application data directory.
+class RoutingPanel : public Component,
+	private Timer
+{
+public:
+	RoutingPanel(MidiRouter &router, String const &defaultInput);
+	virtual ~RoutingPanel();
+
+	void resized() override;
+
+	// The mapping text applied last, or an example if there is none yet
+	static String storedMappings();
+
+private:
+	void timerCallback() override;
+	void apply();
+	void toggleRouting();
+	void refreshPorts(String const &defaultInput);
+	void updateStartButton();
+
+	MidiRouter &router_;
+	Label inputLabel_;
+	ComboBox inputs_;
+	Label outputLabel_;
+	ComboBox outputs_;
+	TextButton startButton_;
+	TextEditor mappings_;
+	TextButton applyButton_;
+	TextButton resetButton_;
+	Label errors_;
+	Label statistics_;
+};
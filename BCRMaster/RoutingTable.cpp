@@ -0,0 +1,177 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "RoutingTable.h"
+
+#include <cmath>
+
+namespace {
+	const int kNoValue = -1;
+	const double kCurveSteepness = 4.0;
+
+	// Accepts decimal, 0x40 and $40, returns kNoValue if the text is no number
+	int parseNumber(String const &text) {
+		if (text.startsWith("$")) {
+			return text.length() > 1 && text.substring(1).containsOnly("0123456789abcdefABCDEF") ? text.substring(1).getHexValue32() : kNoValue;
+		}
+		if (text.startsWithIgnoreCase("0x")) {
+			return text.length() > 2 && text.substring(2).containsOnly("0123456789abcdefABCDEF") ? text.substring(2).getHexValue32() : kNoValue;
+		}
+		return text.containsOnly("0123456789") && text.isNotEmpty() ? text.getIntValue() : kNoValue;
+	}
+
+	int parseChannel(String const &text) {
+		int channel = parseNumber(text);
+		return channel >= 1 && channel <= 16 ? channel - 1 : kNoValue;
+	}
+
+	double applyCurve(String const &curve, double x) {
+		if (curve == "exp") return (std::exp(kCurveSteepness * x) - 1.0) / (std::exp(kCurveSteepness) - 1.0);
+		if (curve == "log") return std::log(1.0 + (std::exp(kCurveSteepness) - 1.0) * x) / kCurveSteepness;
+		if (curve == "s") return 0.5 - 0.5 * std::cos(MathConstants<double>::pi * x);
+		return x;
+	}
+}
+
+RoutingTable::RoutingTable() : firstRule_(16 * 128, -1), thru_(true)
+{
+	for (int i = 0; i < 16; i++) {
+		channelMap_[i] = i;
+	}
+}
+
+std::unique_ptr<RoutingTable> RoutingTable::parse(String const &text, StringArray &outErrors)
+{
+	std::unique_ptr<RoutingTable> result(new RoutingTable());
+	auto lines = StringArray::fromLines(text);
+	for (int i = 0; i < lines.size(); i++) {
+		auto line = lines[i].upToFirstOccurrenceOf("#", false, false).trim();
+		if (line.isEmpty()) {
+			continue;
+		}
+		auto error = result->parseLine(StringArray::fromTokens(line.toLowerCase(), " \t", ""));
+		if (error.isNotEmpty()) {
+			outErrors.add("Line " + String(i + 1) + ": " + error);
+		}
+	}
+	return result;
+}
+
+String RoutingTable::parseLine(StringArray const &input)
+{
+	StringArray tokens(input);
+	tokens.removeEmptyStrings();
+	if (tokens[0] == "thru") {
+		if (tokens.size() != 2 || (tokens[1] != "on" && tokens[1] != "off")) return "expected thru on or thru off";
+		thru_ = tokens[1] == "on";
+		return {};
+	}
+
+	int arrow = tokens.indexOf("->");
+	if (arrow < 0) return "expected -> between input and output";
+
+	if (tokens[0] == "channel") {
+		if (arrow != 2 || tokens.size() != 5 || tokens[3] != "channel") return "expected channel <1-16> -> channel <1-16>";
+		int from = parseChannel(tokens[1]);
+		int to = parseChannel(tokens[4]);
+		if (from == kNoValue || to == kNoValue) return "channels must be between 1 and 16";
+		channelMap_[from] = to;
+		return {};
+	}
+
+	if (tokens[0] != "cc" || arrow != 3) return "expected cc <channel> <controller> -> ...";
+	int inputChannel = parseChannel(tokens[1]);
+	int controller = parseNumber(tokens[2]);
+	if (inputChannel == kNoValue) return "channels must be between 1 and 16";
+	if (controller < 0 || controller > 127) return "controller must be between 0 and 127";
+
+	Rule rule;
+	rule.valuePosition = -1;
+	rule.lowValuePosition = -1;
+	rule.channel = 0;
+	rule.number = 0;
+	int next = arrow + 1;
+	auto const &type = tokens[next++];
+	if (type == "cc" || type == "nrpn") {
+		rule.type = type == "cc" ? TargetType::CC : TargetType::NRPN;
+		rule.channel = parseChannel(tokens[next++]);
+		rule.number = parseNumber(tokens[next++]);
+		if (rule.channel == kNoValue) return "channels must be between 1 and 16";
+		if (rule.number < 0 || rule.number > (rule.type == TargetType::CC ? 127 : 16383)) return "output number out of range";
+	}
+	else if (type == "sysex") {
+		rule.type = TargetType::SysEx;
+		std::vector<uint8> bytes;
+		while (next < tokens.size()) {
+			auto const &token = tokens[next++];
+			if (token == "vv" || token == "vh") {
+				rule.valuePosition = static_cast<int>(bytes.size());
+				bytes.push_back(0);
+			}
+			else if (token == "vl") {
+				rule.lowValuePosition = static_cast<int>(bytes.size());
+				bytes.push_back(0);
+			}
+			else if (token.length() <= 2 && token.containsOnly("0123456789abcdef")) {
+				bytes.push_back(static_cast<uint8>(token.getHexValue32()));
+				if (bytes.back() == 0xf7) break;
+			}
+			else {
+				return "unexpected " + token + " in sysex, use hex bytes and vv, vh, vl";
+			}
+		}
+		if (bytes.size() < 3 || bytes.front() != 0xf0 || bytes.back() != 0xf7) return "sysex must start with F0 and end with F7";
+		if (static_cast<int>(bytes.size()) > kMaxSysexSize) return "sysex longer than " + String(kMaxSysexSize) + " bytes";
+		if (rule.valuePosition < 0) return "sysex needs a vv or vh byte for the value";
+		rule.sysex = MidiMessage(bytes.data(), static_cast<int>(bytes.size()));
+	}
+	else {
+		return "output must be cc, nrpn or sysex";
+	}
+
+	// Options
+	int minimum = 0;
+	int maximum = 127;
+	String curve = "linear";
+	bool invert = false;
+	while (next < tokens.size()) {
+		auto const &option = tokens[next++];
+		if (option == "range" && next + 1 < tokens.size()) {
+			minimum = parseNumber(tokens[next++]);
+			maximum = parseNumber(tokens[next++]);
+			if (minimum == kNoValue || maximum == kNoValue || jmax(minimum, maximum) > 16383) return "range must be between 0 and 16383";
+		}
+		else if (option == "curve" && next < tokens.size()) {
+			curve = tokens[next++];
+			if (curve != "linear" && curve != "exp" && curve != "log" && curve != "s") return "unknown curve " + curve;
+		}
+		else if (option == "invert") {
+			invert = true;
+		}
+		else {
+			return "unexpected " + option;
+		}
+	}
+	if (rule.type == TargetType::CC && jmax(minimum, maximum) > 127) return "range of cc must be between 0 and 127";
+	if (rule.type == TargetType::SysEx && jmax(minimum, maximum) > 127 && rule.lowValuePosition < 0) return "range above 127 needs vh and vl in the sysex";
+	rule.fourteenBit = jmax(minimum, maximum) > 127;
+	computeValues(rule, curve, invert, minimum, maximum);
+
+	int index = static_cast<int>(rules_.size());
+	rule.next = firstRule_[inputChannel * 128 + controller];
+	firstRule_[inputChannel * 128 + controller] = index;
+	rules_.push_back(rule);
+	return {};
+}
+
+void RoutingTable::computeValues(Rule &rule, String const &curve, bool invert, int minimum, int maximum)
+{
+	for (int i = 0; i < 128; i++) {
+		double y = applyCurve(curve, i / 127.0);
+		if (invert) y = 1.0 - y;
+		rule.values[i] = static_cast<uint16>(jlimit(0, 16383, roundToInt(minimum + y * (maximum - minimum))));
+	}
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <array>
+
+// The parameter mappings of the MidiRouter, parsed from a text with one mapping per line:
+//
+//   cc 1 7 -> nrpn 2 1234 range 0 16383 curve exp    controller 7 on channel 1 becomes 14 bit NRPN 1234 on channel 2
+//   cc 1 8 -> sysex F0 43 10 4C 02 01 vv F7          vv is the 7 bit value, vh and vl are the upper and lower 7 bits of larger ranges
+//   cc 1 9 -> cc 3 74 curve log invert               curves are linear, exp, log and s, invert flips the direction
+//   channel 5 -> channel 6                           everything not mapped on channel 5 goes out on channel 6
+//   thru off                                         drop everything not mapped, default is on
+//
+// Channels are 1 to 16, numbers decimal, 0x or $ hex, sysex bytes always hex. Lines starting with # are comments.
+// A controller may have several mappings, it is sent to all of them. Every curve is computed into a lookup table here,
+// and sysex messages are built here, so routing a message later only needs table lookups and never allocates.
+class RoutingTable {
+public:
+	enum class TargetType { CC, NRPN, SysEx };
+
+	struct Rule {
+		TargetType type;
+		int channel; // 0-15
+		int number;
+		bool fourteenBit;
+		std::array<uint16, 128> values; // Output value for every input value
+		int valuePosition; // Sysex byte receiving vv or vh, -1 if none
+		int lowValuePosition; // Sysex byte receiving vl, -1 if none
+		mutable MidiMessage sysex; // Only ever written to by the router thread, see MidiRouter::route
+		int next; // Next rule for the same controller, -1 at the end
+	};
+
+	// Returns a table even if there were errors, containing all lines that could be read
+	static std::unique_ptr<RoutingTable> parse(String const &text, StringArray &outErrors);
+
+	int firstRule(int channel, int controller) const { return firstRule_[channel * 128 + controller]; }
+	Rule const &rule(int index) const { return rules_[index]; }
+	int outputChannel(int channel) const { return channelMap_[channel]; }
+	bool isThru() const { return thru_; }
+	int numberOfRules() const { return static_cast<int>(rules_.size()); }
+
+	static const int kMaxSysexSize = 64;
+
+private:
+	RoutingTable();
+
+	String parseLine(StringArray const &tokens);
+	static void computeValues(Rule &rule, String const &curve, bool invert, int minimum, int maximum);
+
+	std::vector<Rule> rules_;
+	std::vector<int> firstRule_;
+	std::array<int, 16> channelMap_;
+	bool thru_;
+};
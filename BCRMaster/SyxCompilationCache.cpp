@@ -0,0 +1,120 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SyxCompilationCache.h"
+
+#include "Trace.h"
+
+namespace {
+	// Position of the two 7 bit message index bytes in the raw message F0 00 20 32 <device> <model> <command> <msb> <lsb> ... F7
+	const int kIndexMSBOffset = 7;
+	const int kIndexLSBOffset = 8;
+}
+
+SyxCompilationCache::SyxCompilationCache(std::shared_ptr<midikraft::BCR2000> bcr) : bcr_(bcr)
+{
+}
+
+void SyxCompilationCache::documentChanged(CodeDocument const &document, int firstChangedLine)
+{
+	int numLines = document.getNumLines();
+	if (firstChangedLine < 0 || firstChangedLine >= static_cast<int>(lines_.size())) {
+		// Nothing cached in that area, just make the structure match
+		lines_.resize(static_cast<size_t>(numLines));
+		if (firstChangedLine >= 0 && firstChangedLine < numLines) {
+			lines_[firstChangedLine].valid = false;
+		}
+		return;
+	}
+
+	// An insert of n line breaks creates n new lines after the first changed one, a delete across n line breaks merges n lines into it
+	int delta = numLines - static_cast<int>(lines_.size());
+	auto firstAfter = lines_.begin() + firstChangedLine + 1;
+	if (delta > 0) {
+		lines_.insert(firstAfter, static_cast<size_t>(delta), CachedLine());
+	}
+	else if (delta < 0) {
+		lines_.erase(firstAfter, firstAfter + std::min(-delta, static_cast<int>(lines_.end() - firstAfter)));
+	}
+	lines_[firstChangedLine].valid = false;
+}
+
+void SyxCompilationCache::invalidateAll()
+{
+	lines_.clear();
+}
+
+std::vector<MidiMessage> SyxCompilationCache::compile(CodeDocument const &document, std::vector<int> *messageLines)
+{
+	std::vector<int> allLines(static_cast<size_t>(document.getNumLines()));
+	for (size_t i = 0; i < allLines.size(); i++) {
+		allLines[i] = static_cast<int>(i);
+	}
+	return compileLines(document, allLines, messageLines);
+}
+
+std::vector<MidiMessage> SyxCompilationCache::compileLines(CodeDocument const &document, std::vector<int> const &lines, std::vector<int> *messageLines)
+{
+	refresh(document);
+	std::vector<MidiMessage> result;
+	if (messageLines) {
+		messageLines->clear();
+	}
+	int index = 0;
+	for (int lineNo : lines) {
+		if (lineNo >= 0 && lineNo < static_cast<int>(lines_.size())) {
+			for (auto const &message : lines_[lineNo].messages) {
+				result.push_back(withMessageIndex(message, index++));
+				if (messageLines) {
+					messageLines->push_back(lineNo);
+				}
+			}
+		}
+	}
+	return result;
+}
+
+void SyxCompilationCache::refresh(CodeDocument const &document)
+{
+	int numLines = document.getNumLines();
+	if (static_cast<int>(lines_.size()) != numLines) {
+		// We lost track of the document structure, start over
+		lines_.clear();
+		lines_.resize(static_cast<size_t>(numLines));
+	}
+	for (int i = 0; i < numLines; i++) {
+		if (!lines_[i].valid) {
+			refreshLine(document, i);
+		}
+	}
+}
+
+void SyxCompilationCache::refreshLine(CodeDocument const &document, int lineNo)
+{
+	auto &cached = lines_[lineNo];
+	auto text = document.getLine(lineNo);
+	if (text.isEmpty() && lineNo == document.getNumLines() - 1) {
+		// The empty line after the final line break is not part of the verbatim encoding
+		cached.messages.clear();
+	}
+	else {
+		// Verbatim flag, otherwise the line numbers won't match
+		Trace::Span span("convertToSyx");
+		cached.messages = bcr_->convertToSyx(text.trimCharactersAtEnd("\r\n").toStdString(), true);
+	}
+	cached.valid = true;
+}
+
+MidiMessage SyxCompilationCache::withMessageIndex(MidiMessage const &message, int index)
+{
+	if (message.getRawDataSize() <= kIndexLSBOffset) {
+		return message;
+	}
+	std::vector<uint8> data(message.getRawData(), message.getRawData() + message.getRawDataSize());
+	data[kIndexMSBOffset] = static_cast<uint8>((index >> 7) & 0x7f);
+	data[kIndexLSBOffset] = static_cast<uint8>(index & 0x7f);
+	return MidiMessage(data.data(), static_cast<int>(data.size()));
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "BCR2000.h"
+
+// Keeps the verbatim sysex encoding of a CodeDocument line by line, so only lines changed since the last compile need to be encoded again.
+// The message index inside each sysex message is restamped on compile, so the result is numbered exactly like a full verbatim conversion
+// and the line numbers in the device's error replies still match the document.
+class SyxCompilationCache {
+public:
+	explicit SyxCompilationCache(std::shared_ptr<midikraft::BCR2000> bcr);
+
+	// To be called from the CodeDocument::Listener callbacks, after the document has changed
+	void documentChanged(CodeDocument const &document, int firstChangedLine);
+	void invalidateAll();
+
+	// All messages of the document
+	std::vector<MidiMessage> compile(CodeDocument const &document, std::vector<int> *messageLines = nullptr);
+
+	// Only the messages of the given zero-based lines, in the order given, numbered consecutively.
+	// If messageLines is given, it receives the document line of each message returned
+	std::vector<MidiMessage> compileLines(CodeDocument const &document, std::vector<int> const &lines, std::vector<int> *messageLines = nullptr);
+
+	static MidiMessage withMessageIndex(MidiMessage const &message, int index);
+
+private:
+	struct CachedLine {
+		CachedLine() : valid(false) {}
+		bool valid;
+		std::vector<MidiMessage> messages;
+	};
+
+	void refresh(CodeDocument const &document);
+	void refreshLine(CodeDocument const &document, int lineNo);
+
+	std::shared_ptr<midikraft::BCR2000> bcr_;
+	std::vector<CachedLine> lines_;
+};
@@ -0,0 +1,158 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SyxScanner.h"
+
+#include "BCR2000.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCR_SCANNER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Layout of a BCR2000 message: F0 00 20 32 <device> <model> <command> <index msb> <index lsb> <data> F7
+	const size_t kCommandOffset = 6;
+	const size_t kTextOffset = 9;
+	const uint8 kBCLTextCommand = 0x20;
+
+#if BCR_SCANNER_SSE2
+	int firstSetBit(uint32 mask) {
+#if JUCE_MSVC
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+#endif
+}
+
+bool SyxScanner::MessageView::isFromBCR2000() const
+{
+	// Asks the BCR2000 itself, with only the header up to the command byte copied. That fits into the MidiMessage without
+	// allocating, the payload is never copied
+	if (size <= kCommandOffset + 1) {
+		return false;
+	}
+	uint8 header[kCommandOffset + 2];
+	memcpy(header, data, kCommandOffset + 1);
+	header[kCommandOffset + 1] = 0xf7;
+	return midikraft::BCR2000::isSysexFromBCR2000(MidiMessage(header, sizeof(header)));
+}
+
+const char * SyxScanner::MessageView::bclText(size_t &length) const
+{
+	if (size <= kTextOffset || !isFromBCR2000() || data[kCommandOffset] != kBCLTextCommand) {
+		return nullptr;
+	}
+	// Without the trailing F7
+	length = size - kTextOffset - 1;
+	return reinterpret_cast<const char *>(data + kTextOffset);
+}
+
+MidiMessage SyxScanner::MessageView::toMidiMessage() const
+{
+	return MidiMessage(data, static_cast<int>(size));
+}
+
+SyxScanner::SyxScanner(File const &file)
+{
+	if (file.existsAsFile() && file.getSize() > 0) {
+		mapping_ = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly);
+		if (mapping_->getData() == nullptr) {
+			mapping_.reset();
+		}
+	}
+}
+
+bool SyxScanner::openedOk() const
+{
+	return mapping_ != nullptr;
+}
+
+size_t SyxScanner::fileSize() const
+{
+	return mapping_ ? mapping_->getSize() : 0;
+}
+
+void SyxScanner::forEachMessage(TMessageVisitor const &visitor) const
+{
+	if (mapping_) {
+		forEachMessage(static_cast<const uint8 *>(mapping_->getData()), mapping_->getSize(), visitor);
+	}
+}
+
+void SyxScanner::forEachBCR2000Message(TMessageVisitor const &visitor) const
+{
+	forEachMessage([&visitor](MessageView const &message) {
+		if (message.isFromBCR2000()) {
+			visitor(message);
+		}
+	});
+}
+
+std::vector<MidiMessage> SyxScanner::loadBCR2000Messages() const
+{
+	std::vector<MidiMessage> result;
+	forEachBCR2000Message([&result](MessageView const &message) {
+		result.push_back(message.toMidiMessage());
+	});
+	return result;
+}
+
+void SyxScanner::forEachMessage(const uint8 *data, size_t size, TMessageVisitor const &visitor)
+{
+	// Sysex payload bytes are all below 0x80, so the byte ending a message is simply the next status byte.
+	// Anything else than F7 there means the message was truncated, and scanning continues from that byte.
+	size_t position = findStatusByte(data, size);
+	while (position < size) {
+		if (data[position] != 0xf0) {
+			position += 1 + findStatusByte(data + position + 1, size - position - 1);
+			continue;
+		}
+		size_t end = position + 1 + findStatusByte(data + position + 1, size - position - 1);
+		if (end < size && data[end] == 0xf7) {
+			visitor({ data + position, end - position + 1 });
+			position = end + 1 + findStatusByte(data + end + 1, size - end - 1);
+		}
+		else {
+			position = end;
+		}
+	}
+}
+
+size_t SyxScanner::findStatusByte(const uint8 *data, size_t size)
+{
+	size_t i = 0;
+#if BCR_SCANNER_SSE2
+	// The sign bit of every byte is exactly the status bit, so no compare is needed
+	for (; i + 16 <= size; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+		if (mask != 0) {
+			return i + firstSetBit(static_cast<uint32>(mask));
+		}
+	}
+#else
+	// Eight bytes at a time, only the position search is done byte by byte
+	for (; i + 8 <= size; i += 8) {
+		uint64 word;
+		memcpy(&word, data + i, sizeof(word));
+		if ((word & 0x8080808080808080ULL) != 0) {
+			break;
+		}
+	}
+#endif
+	for (; i < size; i++) {
+		if (data[i] & 0x80) {
+			return i;
+		}
+	}
+	return size;
+}
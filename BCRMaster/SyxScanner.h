@@ -0,0 +1,47 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+// Reads sysex files without copying them. The file is memory mapped and the F0/F7 framing is found with a vectorized
+// scan for status bytes, every message is handed out as a view into the mapping. Meant for archives with hundreds of
+// presets, where building one MidiMessage per BCL line dominates load time and memory.
+class SyxScanner {
+public:
+	// A complete sysex message including the F0 and F7 bytes. Only valid as long as the scanner is alive.
+	struct MessageView {
+		const uint8 *data;
+		size_t size;
+
+		bool isFromBCR2000() const;
+		// If this is a BCL text message, returns the pointer to the text and stores its length
+		const char *bclText(size_t &length) const;
+		MidiMessage toMidiMessage() const;
+	};
+	typedef std::function<void(MessageView const &)> TMessageVisitor;
+
+	explicit SyxScanner(File const &file);
+
+	bool openedOk() const;
+	size_t fileSize() const;
+
+	// Visits all complete sysex messages in file order, truncated messages are skipped
+	void forEachMessage(TMessageVisitor const &visitor) const;
+	void forEachBCR2000Message(TMessageVisitor const &visitor) const;
+
+	// Only the messages that are from a BCR2000, as MidiMessages for the APIs that need them
+	std::vector<MidiMessage> loadBCR2000Messages() const;
+
+	static void forEachMessage(const uint8 *data, size_t size, TMessageVisitor const &visitor);
+
+	// Returns the offset of the first byte with the high bit set, or size if there is none
+	static size_t findStatusByte(const uint8 *data, size_t size);
+
+private:
+	std::unique_ptr<MemoryMappedFile> mapping_;
+};
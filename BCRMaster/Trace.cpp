@@ -0,0 +1,254 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "Trace.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+namespace {
+	const int kMaxOperations = 64;
+	const int kEventCapacity = 1 << 16; // Must be a power of two
+
+	struct Operation {
+		std::atomic<const char *> name;
+		std::atomic<uint64> count;
+		std::atomic<uint64> totalMicros;
+		std::atomic<uint64> maxMicros;
+		std::atomic<uint64> buckets[Trace::kNumBuckets];
+	};
+
+	struct Event {
+		// 0 while the event is written, otherwise its sequence number plus one. Lets the export skip events overwritten meanwhile
+		std::atomic<uint64> sequence;
+		// Atomic, because the export may read them while they are overwritten. Relaxed is enough, the sequence orders them
+		std::atomic<const char *> name;
+		std::atomic<uint64> threadId;
+		std::atomic<int64> startTicks;
+		std::atomic<int64> endTicks;
+	};
+
+	// Zero initialized as they have static storage duration
+	Operation sOperations[kMaxOperations];
+	Event sEvents[kEventCapacity];
+	std::atomic<uint64> sNextEvent(0);
+	const int64 sOriginTicks = Time::getHighResolutionTicks();
+
+	double ticksToMicros(int64 ticks) {
+		return ticks * 1.0e6 / static_cast<double>(Time::getHighResolutionTicksPerSecond());
+	}
+
+	Operation *operationFor(const char *name) {
+		for (auto &operation : sOperations) {
+			const char *existing = operation.name.load(std::memory_order_acquire);
+			if (existing == nullptr) {
+				// Claim the free slot, unless another thread was faster
+				if (operation.name.compare_exchange_strong(existing, name)) {
+					return &operation;
+				}
+			}
+			if (existing == name || strcmp(existing, name) == 0) {
+				return &operation;
+			}
+		}
+		return nullptr;
+	}
+
+	int bucketFor(uint64 micros) {
+		int bucket = 0;
+		while (micros > 0 && bucket < Trace::kNumBuckets - 1) {
+			micros >>= 1;
+			bucket++;
+		}
+		return bucket;
+	}
+}
+
+std::atomic<bool> Trace::enabled_(false);
+
+void Trace::setEnabled(bool enabled)
+{
+	enabled_ = enabled;
+}
+
+void Trace::record(const char *name, int64 startTicks, int64 endTicks)
+{
+	if (!isEnabled()) {
+		return;
+	}
+	auto operation = operationFor(name);
+	if (operation) {
+		auto micros = static_cast<uint64>(jmax(0.0, ticksToMicros(endTicks - startTicks)));
+		operation->count.fetch_add(1, std::memory_order_relaxed);
+		operation->totalMicros.fetch_add(micros, std::memory_order_relaxed);
+		operation->buckets[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+		uint64 previousMax = operation->maxMicros.load(std::memory_order_relaxed);
+		while (micros > previousMax && !operation->maxMicros.compare_exchange_weak(previousMax, micros, std::memory_order_relaxed)) {}
+	}
+
+	uint64 sequence = sNextEvent.fetch_add(1, std::memory_order_relaxed);
+	auto &event = sEvents[sequence & (kEventCapacity - 1)];
+	event.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name.store(name, std::memory_order_relaxed);
+	event.threadId.store(static_cast<uint64>(reinterpret_cast<pointer_sized_int>(Thread::getCurrentThreadId())), std::memory_order_relaxed);
+	event.startTicks.store(startTicks, std::memory_order_relaxed);
+	event.endTicks.store(endTicks, std::memory_order_relaxed);
+	event.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+double Trace::Histogram::meanMs() const
+{
+	return count > 0 ? totalMs / count : 0.0;
+}
+
+double Trace::Histogram::percentileMs(double p) const
+{
+	uint64 target = static_cast<uint64>(std::ceil(p * count));
+	uint64 seen = 0;
+	for (int i = 0; i < kNumBuckets; i++) {
+		seen += buckets[i];
+		if (seen >= target && seen > 0) {
+			return jmin(maxMs, (i == 0 ? 1.0 : static_cast<double>(1ull << i)) / 1000.0);
+		}
+	}
+	return maxMs;
+}
+
+std::vector<Trace::Histogram> Trace::histograms()
+{
+	std::vector<Histogram> result;
+	for (auto &operation : sOperations) {
+		const char *name = operation.name.load(std::memory_order_acquire);
+		if (name == nullptr) {
+			break;
+		}
+		Histogram histogram;
+		histogram.name = name;
+		histogram.count = operation.count.load(std::memory_order_relaxed);
+		histogram.totalMs = operation.totalMicros.load(std::memory_order_relaxed) / 1000.0;
+		histogram.maxMs = operation.maxMicros.load(std::memory_order_relaxed) / 1000.0;
+		for (int i = 0; i < kNumBuckets; i++) {
+			histogram.buckets[i] = operation.buckets[i].load(std::memory_order_relaxed);
+		}
+		result.push_back(histogram);
+	}
+	return result;
+}
+
+void Trace::reset()
+{
+	// The operation names stay registered, only the numbers are cleared
+	for (auto &operation : sOperations) {
+		operation.count = 0;
+		operation.totalMicros = 0;
+		operation.maxMicros = 0;
+		for (auto &bucket : operation.buckets) {
+			bucket = 0;
+		}
+	}
+	for (auto &event : sEvents) {
+		event.sequence = 0;
+	}
+}
+
+bool Trace::exportChromeTrace(File const &file)
+{
+	TemporaryFile temp(file);
+	{
+		FileOutputStream out(temp.getFile());
+		if (!out.openedOk()) {
+			return false;
+		}
+		out << "{\"traceEvents\":[\n";
+		uint64 end = sNextEvent.load(std::memory_order_acquire);
+		uint64 begin = end > kEventCapacity ? end - kEventCapacity : 0;
+		bool first = true;
+		for (uint64 sequence = begin; sequence < end; sequence++) {
+			auto const &event = sEvents[sequence & (kEventCapacity - 1)];
+			if (event.sequence.load(std::memory_order_acquire) != sequence + 1) {
+				continue;
+			}
+			const char *name = event.name.load(std::memory_order_relaxed);
+			auto threadId = event.threadId.load(std::memory_order_relaxed);
+			auto startTicks = event.startTicks.load(std::memory_order_relaxed);
+			auto endTicks = event.endTicks.load(std::memory_order_relaxed);
+			double startMicros = ticksToMicros(startTicks - sOriginTicks);
+			double durationMicros = ticksToMicros(endTicks - startTicks);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (event.sequence.load(std::memory_order_relaxed) != sequence + 1) {
+				// Overwritten while we were reading it
+				continue;
+			}
+			if (!first) out << ",\n";
+			first = false;
+			out << "{\"name\":\"" << name << "\",\"cat\":\"bcr\",\"ph\":\"X\",\"pid\":1,\"tid\":" << String(static_cast<int64>(threadId % 1000000007ull))
+				<< ",\"ts\":" << String(startMicros, 3) << ",\"dur\":" << String(durationMicros, 3) << "}";
+		}
+		out << "\n]}\n";
+		out.flush();
+		if (out.getStatus().failed()) {
+			return false;
+		}
+	}
+	return temp.overwriteTargetFileWithTemporary();
+}
+
+#if JUCE_LINUX
+namespace {
+	int64 procStatusBytes(const char *field) {
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line)) {
+			if (line.compare(0, strlen(field), field) == 0) {
+				return String(line.substr(strlen(field))).getLargeIntValue() * 1024;
+			}
+		}
+		return -1;
+	}
+}
+#endif
+
+int64 Trace::residentBytes()
+{
+#if JUCE_LINUX
+	return procStatusBytes("VmRSS:");
+#elif JUCE_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? static_cast<int64>(counters.WorkingSetSize) : -1;
+#else
+	return -1;
+#endif
+}
+
+int64 Trace::peakResidentBytes()
+{
+#if JUCE_LINUX
+	return procStatusBytes("VmHWM:");
+#elif JUCE_WINDOWS
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? static_cast<int64>(counters.PeakWorkingSetSize) : -1;
+#else
+	return -1;
+#endif
+}
+
+void Trace::resetPeakResidentBytes()
+{
+#if JUCE_LINUX
+	// Since Linux 4.0, resets VmHWM to the current resident size
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+
+// Lightweight tracing of the hot paths. Spans are recorded into per-operation latency histograms with power of two buckets
+// and into a ring buffer of events that can be exported in the Chrome trace format (load it in chrome://tracing or Perfetto).
+// Disabled, a span costs one relaxed atomic load, so the spans stay compiled into release builds.
+//
+// Operation names must be string literals, they are stored as pointers.
+class Trace {
+public:
+	static const int kNumBuckets = 32; // Bucket n holds durations from 2^(n-1) to 2^n microseconds
+
+	class Span {
+	public:
+		explicit Span(const char *name) : name_(isEnabled() ? name : nullptr), start_(name_ ? now() : 0) {}
+		~Span() { if (name_) record(name_, start_, now()); }
+
+	private:
+		const char *name_;
+		int64 start_;
+		JUCE_DECLARE_NON_COPYABLE(Span)
+	};
+
+	struct Histogram {
+		String name;
+		uint64 count;
+		double totalMs;
+		double maxMs;
+		uint64 buckets[kNumBuckets];
+
+		double meanMs() const;
+		// Upper bound of the bucket containing the percentile, p between 0 and 1
+		double percentileMs(double p) const;
+	};
+
+	static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+	static void setEnabled(bool enabled);
+
+	// High resolution ticks, for spans that start and end in different places, e.g. a request and its reply.
+	// record does nothing while tracing is disabled
+	static int64 now() { return Time::getHighResolutionTicks(); }
+	static void record(const char *name, int64 startTicks, int64 endTicks);
+
+	static std::vector<Histogram> histograms();
+	static void reset();
+	static bool exportChromeTrace(File const &file);
+
+	// Memory of the whole process, -1 where the platform can't tell. The peak can only be reset on Linux
+	static int64 residentBytes();
+	static int64 peakResidentBytes();
+	static void resetPeakResidentBytes();
+
+private:
+	static std::atomic<bool> enabled_;
+};
@@ -0,0 +1,84 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "UnitUploadPanel.h"
+
+namespace {
+	const int kRefreshHz = 10;
+	const int kRowHeight = 50;
+}
+
+UnitUploadPanel::UnitUploadPanel(DeviceManager &devices) : devices_(devices)
+{
+	abortButton_.setButtonText("Abort all");
+	abortButton_.onClick = [this]() { devices_.abortAll(); };
+	addAndMakeVisible(abortButton_);
+
+	createRows(devices_.numberOfUnits());
+	timerCallback();
+	startTimerHz(kRefreshHz);
+	setSize(800, jmax(200, 52 + kRowHeight * static_cast<int>(rows_.size())));
+}
+
+UnitUploadPanel::~UnitUploadPanel()
+{
+	stopTimer();
+}
+
+void UnitUploadPanel::resized()
+{
+	auto area = getLocalBounds().reduced(8);
+	abortButton_.setBounds(area.removeFromBottom(28).removeFromRight(120));
+	area.removeFromBottom(8);
+	for (auto &row : rows_) {
+		auto rowArea = area.removeFromTop(kRowHeight);
+		auto top = rowArea.removeFromTop(22);
+		row->name.setBounds(top.removeFromLeft(250));
+		row->progressBar.setBounds(top.removeFromLeft(150).reduced(2));
+		row->summary.setBounds(top);
+		row->firstError.setBounds(rowArea.removeFromTop(22));
+	}
+}
+
+void UnitUploadPanel::createRows(int numberOfUnits)
+{
+	rows_.clear();
+	progress_.clear();
+	for (int i = 0; i < numberOfUnits; i++) {
+		progress_.push_back(0.0);
+		auto row = std::make_unique<Row>(progress_.back());
+		addAndMakeVisible(row->name);
+		addAndMakeVisible(row->progressBar);
+		addAndMakeVisible(row->summary);
+		row->firstError.setColour(Label::textColourId, Colours::orange);
+		addAndMakeVisible(row->firstError);
+		rows_.push_back(std::move(row));
+	}
+	resized();
+}
+
+void UnitUploadPanel::timerCallback()
+{
+	auto status = devices_.status();
+	if (status.size() != rows_.size()) {
+		// Detected again while the panel was open
+		createRows(static_cast<int>(status.size()));
+	}
+	for (size_t i = 0; i < status.size(); i++) {
+		auto &row = *rows_[i];
+		progress_[i] = status[i].progress;
+		row.name.setText(status[i].name, dontSendNotification);
+		row.summary.setText(status[i].summary, dontSendNotification);
+		if (!status[i].errors.empty()) {
+			auto const &error = status[i].errors.front();
+			row.firstError.setText("Message " + String(error.lineNumber) + ": " + String(error.errorText), dontSendNotification);
+		}
+		else {
+			row.firstError.setText({}, dontSendNotification);
+		}
+	}
+	abortButton_.setEnabled(devices_.isBusy());
+}
@@ -0,0 +1,42 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "DeviceManager.h"
+
+#include <deque>
+
+// Shows the upload progress, throughput and errors of every unit of the DeviceManager, one row per unit
+class UnitUploadPanel : public Component,
+	private Timer
+{
+public:
+	explicit UnitUploadPanel(DeviceManager &devices);
+	virtual ~UnitUploadPanel();
+
+	void resized() override;
+
+private:
+	struct Row {
+		Row(double &progress) : progressBar(progress) {}
+
+		Label name;
+		ProgressBar progressBar;
+		Label summary;
+		Label firstError;
+	};
+
+	void timerCallback() override;
+	void createRows(int numberOfUnits);
+
+	DeviceManager &devices_;
+	std::deque<double> progress_; // The progress bars keep references, so the values must not move
+	std::vector<std::unique_ptr<Row>> rows_;
+	TextButton abortButton_;
+};